@@ -1,7 +1,8 @@
 #include "AudioController.h"
 #include "ConfigManager.h"
 #include "NfcController.h"
-#include "AudioFileSourceSD.h"
+#include "BlobStore.h"
+#include "AudioFileSourceFS.h"
 #include "AudioFileSourceBuffer.h"
 #include "AudioGeneratorWAV.h"
 #include "AudioOutputI2S.h"
@@ -196,9 +197,10 @@ bool AudioController::play(const String& filePath) {
             return false;
         }
         
-        String trackPath = playlist[currentPlaylistIndex];
-        Serial.printf("AudioController: Playing track %d: %s\n", currentPlaylistIndex, trackPath.c_str());
-        return play(trackPath); // Recursive call with specific file
+        char trackPath[TrackId::PATH_MAX_LEN];
+        BlobStore::getInstance().resolve(playlist[currentPlaylistIndex], trackPath, sizeof(trackPath));
+        Serial.printf("AudioController: Playing track %d: %s\n", currentPlaylistIndex, trackPath);
+        return play(String(trackPath)); // Recursive call with specific file
     }
 
     // Check if file exists
@@ -223,9 +225,9 @@ bool AudioController::play(const String& filePath) {
     cleanupAudioComponents();
     
     // Create new components (following the working example)
-    audioFile = new AudioFileSourceSD(filePath.c_str());
+    audioFile = new AudioFileSourceFS(FileManager::getInstance().getFS(), filePath.c_str());
     if (!audioFile) {
-        Serial.println("AudioController: Failed to create AudioFileSourceSD");
+        Serial.println("AudioController: Failed to create AudioFileSourceFS");
         return false;
     }
     
@@ -310,7 +312,7 @@ bool AudioController::resume() {
         }
         
         // Create new audio file source
-        audioFile = new AudioFileSourceSD(currentTrackPath.c_str());
+        audioFile = new AudioFileSourceFS(FileManager::getInstance().getFS(), currentTrackPath.c_str());
         if (!audioFile) {
             Serial.printf("AudioController: Failed to reopen audio file: %s\n", currentTrackPath.c_str());
             cleanupAudioComponents();
@@ -469,8 +471,8 @@ int AudioController::getVolumeCeiling() const {
 }
 
 // Playlist management methods
-void AudioController::setPlaylist(const std::vector<String>& trackPaths, const String& figureUid) {
-    playlist = trackPaths;
+void AudioController::setPlaylist(std::vector<TrackId>&& tracks, const String& figureUid) {
+    playlist = std::move(tracks);
     playlistFigureUid = figureUid;
     currentPlaylistIndex = -1; // Start at -1, first play() will set to 0
     playlistFinished = false;
@@ -479,11 +481,45 @@ void AudioController::setPlaylist(const std::vector<String>& trackPaths, const S
                  playlist.size(), figureUid.c_str());
     
     // Print playlist for debugging
+    char trackPath[TrackId::PATH_MAX_LEN];
     for (int i = 0; i < playlist.size(); i++) {
-        Serial.printf("  Track %d: %s\n", i + 1, playlist[i].c_str());
+        BlobStore::getInstance().resolve(playlist[i], trackPath, sizeof(trackPath));
+        Serial.printf("  Track %d: %s\n", i + 1, trackPath);
     }
 }
 
+bool AudioController::updatePlaylist(std::vector<TrackId>&& tracks, const String& figureUid) {
+    if (figureUid != playlistFigureUid) {
+        setPlaylist(std::move(tracks), figureUid);
+        return true;
+    }
+    if (tracks == playlist) {
+        return false;
+    }
+    
+    // Keep the current track playing and continue from its new position
+    int newIndex = -1;
+    if (currentPlaylistIndex >= 0 && currentPlaylistIndex < (int)playlist.size()) {
+        const TrackId& current = playlist[currentPlaylistIndex];
+        for (int i = 0; i < (int)tracks.size(); i++) {
+            if (tracks[i] == current) {
+                newIndex = i;
+                break;
+            }
+        }
+        if (newIndex == -1) {
+            // Current track was dropped, the next one is whatever now sits at its old slot
+            newIndex = min(currentPlaylistIndex, (int)tracks.size()) - 1;
+        }
+    }
+    
+    Serial.printf("AudioController: Playlist updated from %d to %d tracks, current index %d -> %d\n",
+                 playlist.size(), tracks.size(), currentPlaylistIndex, newIndex);
+    playlist = std::move(tracks);
+    currentPlaylistIndex = newIndex;
+    return true;
+}
+
 void AudioController::clearPlaylist() {
     playlist.clear();
     currentPlaylistIndex = -1;
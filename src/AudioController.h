@@ -5,11 +5,12 @@
 #include <driver/i2s.h>
 #include <Wire.h>
 #include <vector>
-#include "AudioFileSourceSD.h"
+#include "AudioFileSourceFS.h"
 #include "AudioFileSourceBuffer.h"
 #include "AudioGeneratorWAV.h"
 #include "AudioOutputI2S.h"
 #include "FileManager.h"
+#include "TrackId.h"
 
 // Forward declaration to avoid circular includes
 class NfcController;
@@ -61,7 +62,8 @@ public:
     // Playlist control methods
     bool nextTrack();
     bool prevTrack();
-    void setPlaylist(const std::vector<String>& trackPaths, const String& figureUid);
+    void setPlaylist(std::vector<TrackId>&& tracks, const String& figureUid);
+    bool updatePlaylist(std::vector<TrackId>&& tracks, const String& figureUid); // Patch in place, false if unchanged
     void clearPlaylist();
     
     // Playlist information
@@ -105,7 +107,7 @@ private:
     ~AudioController();
 
     // Audio components
-    AudioFileSourceSD* audioFile;
+    AudioFileSourceFS* audioFile; // Reads through whichever bus FileManager mounted
     AudioFileSourceBuffer* audioBuffer;
     AudioGeneratorWAV* audioWAV;
     AudioOutputI2S* audioOutput;
@@ -128,7 +130,7 @@ private:
     unsigned long pauseStartTime;    // millis() when track was paused
     
     // Playlist variables
-    std::vector<String> playlist;
+    std::vector<TrackId> playlist;
     int currentPlaylistIndex;
     String playlistFigureUid; // UID of the figure associated with this playlist
     bool playlistFinished; // Track if playlist has finished playing
@@ -0,0 +1,324 @@
+#include "BlobStore.h"
+#include "FigureManifest.h"
+#include "FileManager.h"
+#include <algorithm>
+
+// Initialize static members
+BlobStore* BlobStore::instance = nullptr;
+const char* BlobStore::BLOB_DIR = "/blobs";
+
+BlobStore::BlobStore() :
+    storedBytes(0),
+    cachedFigure(0) {
+}
+
+BlobStore& BlobStore::getInstance() {
+    if (instance == nullptr) {
+        instance = new BlobStore();
+    }
+    return *instance;
+}
+
+void BlobStore::begin() {
+    FileManager& fileManager = FileManager::getInstance();
+    if (!fileManager.isSDCardAvailable()) {
+        return;
+    }
+    unsigned long start = millis();
+    if (!fileManager.fileExists(BLOB_DIR)) {
+        fileManager.createDirectory(BLOB_DIR);
+    }
+
+    // References, from every figure's manifest
+    fs::FS& fs = fileManager.getFS();
+    std::vector<uint32_t> figureIds;
+    File root = fs.open("/figures");
+    if (root && root.isDirectory()) {
+        File entry = root.openNextFile();
+        while (entry) {
+            if (entry.isDirectory()) {
+                uint32_t figureId = strtoul(entry.name(), nullptr, 10);
+                if (figureId != 0) {
+                    figureIds.push_back(figureId);
+                }
+            }
+            entry.close();
+            entry = root.openNextFile();
+        }
+        root.close();
+    }
+    FigureManifest manifest;
+    for (uint32_t figureId : figureIds) {
+        if (!manifest.load(figureId)) {
+            continue;
+        }
+        for (const auto& entry : manifest.entries) {
+            if (entry.blobKey != 0) {
+                addReference(figureId, entry.blobKey);
+            }
+        }
+    }
+
+    // Sizes, and blobs a power cut left between their download and the manifest
+    std::vector<String> orphans;
+    File dir = fs.open(BLOB_DIR);
+    if (dir && dir.isDirectory()) {
+        File entry = dir.openNextFile();
+        while (entry) {
+            String path = String(BLOB_DIR) + "/" + entry.name();
+            uint64_t key;
+            if (!entry.isDirectory() && keyFromPath(path.c_str(), key)) { // Partial .tmp files are not blobs
+                Blob* blob = findBlob(key);
+                if (blob != nullptr) {
+                    blob->size = entry.size();
+                    storedBytes += blob->size;
+                } else {
+                    orphans.push_back(path);
+                }
+            }
+            entry.close();
+            entry = dir.openNextFile();
+        }
+        dir.close();
+    }
+    for (const String& path : orphans) {
+        fileManager.deleteFileAndRemoveFromRequired(path);
+    }
+
+    Serial.printf("BlobStore: %u blobs using %s, %u unreferenced removed, loaded in %lu ms\n",
+                  blobs.size(), fileManager.formatBytes(storedBytes).c_str(), orphans.size(), millis() - start);
+}
+
+uint64_t BlobStore::keyFor(const String& contentHash) {
+    if (contentHash.isEmpty()) {
+        return 0;
+    }
+    // FNV-1a, 64 bits so unrelated tracks never share a key in practice; hex digests
+    // are compared case-insensitively
+    uint64_t key = 14695981039346656037ULL;
+    for (size_t i = 0; i < contentHash.length(); i++) {
+        key ^= (uint8_t)tolower((unsigned char)contentHash[i]);
+        key *= 1099511628211ULL;
+    }
+    return key != 0 ? key : 1; // 0 is reserved for "no blob"
+}
+
+size_t BlobStore::formatPath(uint64_t key, char* buffer, size_t size) {
+    int written = snprintf(buffer, size, "%s/%08x%08x.wav", BLOB_DIR,
+                           (unsigned)(key >> 32), (unsigned)(key & 0xFFFFFFFF));
+    return written > 0 ? (size_t)written : 0;
+}
+
+bool BlobStore::keyFromPath(const char* path, uint64_t& key) {
+    // "/blobs/" + 16 hex digits + ".wav"
+    size_t dirLength = strlen(BLOB_DIR);
+    if (strncmp(path, BLOB_DIR, dirLength) != 0 || path[dirLength] != '/') {
+        return false;
+    }
+    const char* digits = path + dirLength + 1;
+    key = 0;
+    for (int i = 0; i < 16; i++) {
+        if (!isxdigit((unsigned char)digits[i])) {
+            return false;
+        }
+        char c = tolower((unsigned char)digits[i]);
+        key = (key << 4) | (uint64_t)(isdigit((unsigned char)c) ? c - '0' : c - 'a' + 10);
+    }
+    return strcmp(digits + 16, ".wav") == 0 && key != 0;
+}
+
+size_t BlobStore::localPath(const TrackId& ref, uint64_t key, char* buffer, size_t size) {
+    return key != 0 ? formatPath(key, buffer, size) : ref.formatPath(buffer, size);
+}
+
+size_t BlobStore::resolve(const TrackId& ref, char* buffer, size_t size) {
+    return localPath(ref, lookupKey(ref), buffer, size);
+}
+
+uint64_t BlobStore::lookupKey(const TrackId& ref) {
+    cacheFigure(ref.figure);
+    TrackBlob probe = {ref, 0};
+    auto it = std::lower_bound(cachedTracks.begin(), cachedTracks.end(), probe,
+                               [](const TrackBlob& a, const TrackBlob& b) { return a.ref < b.ref; });
+    return (it != cachedTracks.end() && it->ref == ref) ? it->key : 0;
+}
+
+bool BlobStore::isUsedBy(uint32_t figureId, uint64_t key) {
+    if (figureId == 0 || key == 0) {
+        return false;
+    }
+    cacheFigure(figureId);
+    for (const auto& track : cachedTracks) {
+        if (track.key == key) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BlobStore::cacheFigure(uint32_t figureId) {
+    if (figureId == cachedFigure) {
+        return;
+    }
+    cachedTracks.clear();
+    cachedFigure = figureId;
+    FigureManifest manifest;
+    if (manifest.load(figureId)) {
+        for (const auto& entry : manifest.entries) {
+            if (entry.blobKey != 0) {
+                TrackBlob track = {entry.ref, entry.blobKey};
+                cachedTracks.push_back(track); // Manifest order is track order
+            }
+        }
+    }
+}
+
+void BlobStore::updateFigure(uint32_t figureId, const FigureManifest& before, const FigureManifest& after) {
+    FileManager& fileManager = FileManager::getInstance();
+    char path[TrackId::PATH_MAX_LEN];
+    for (const auto& entry : after.entries) {
+        if (entry.blobKey == 0) {
+            continue;
+        }
+        addReference(figureId, entry.blobKey);
+        Blob* blob = findBlob(entry.blobKey);
+        if (blob->size == 0) {
+            // New to the store but already on the card, e.g. adopted from a track path
+            formatPath(entry.blobKey, path, sizeof(path));
+            if (fileManager.fileExists(path)) {
+                blob->size = fileManager.getFileSize(path);
+                storedBytes += blob->size;
+            }
+        }
+    }
+    std::vector<String> released;
+    for (const auto& entry : before.entries) {
+        if (entry.blobKey != 0) {
+            releaseReference(figureId, entry.blobKey, released);
+        }
+    }
+    // Last reference gone: the audio, its required entry and any queued download go too
+    for (const auto& blobPath : released) {
+        fileManager.deleteFileAndRemoveFromRequired(blobPath);
+    }
+    if (figureId == cachedFigure) {
+        cachedFigure = 0;
+        cachedTracks.clear();
+    }
+}
+
+void BlobStore::releaseFigure(uint32_t figureId, std::vector<String>& released) {
+    FigureManifest manifest;
+    if (manifest.load(figureId)) {
+        for (const auto& entry : manifest.entries) {
+            if (entry.blobKey != 0) {
+                releaseReference(figureId, entry.blobKey, released);
+            }
+        }
+    }
+    if (figureId == cachedFigure) {
+        cachedFigure = 0;
+        cachedTracks.clear();
+    }
+}
+
+void BlobStore::onBlobAdded(uint64_t key, size_t bytes) {
+    Blob* blob = findBlob(key);
+    if (blob == nullptr) {
+        return; // Released while downloading; begin() removes it next boot
+    }
+    storedBytes -= blob->size;
+    blob->size = bytes;
+    storedBytes += bytes;
+}
+
+bool BlobStore::hasReferences(uint32_t figureId) const {
+    for (const auto& figure : figureRefs) {
+        if (figure.figureId == figureId) {
+            return figure.count > 0;
+        }
+    }
+    return false;
+}
+
+String BlobStore::getStatusString() {
+    uint32_t references = 0;
+    uint32_t shared = 0;
+    uint32_t missing = 0;
+    uint64_t savedBytes = 0;
+    for (const auto& blob : blobs) {
+        references += blob.refs;
+        if (blob.refs > 1) {
+            shared++;
+            savedBytes += (uint64_t)blob.size * (blob.refs - 1);
+        }
+        if (blob.size == 0) {
+            missing++;
+        }
+    }
+
+    FileManager& fileManager = FileManager::getInstance();
+    String info = "Blob Store:\n";
+    info += "Blobs: " + String(blobs.size()) + " using " + fileManager.formatBytes(storedBytes) + ", " +
+            String(missing) + " not downloaded yet\n";
+    info += "References: " + String(references) + " from " + String(figureRefs.size()) + " figures\n";
+    info += "Shared: " + String(shared) + " blobs, " + fileManager.formatBytes(savedBytes) + " not stored twice\n";
+    return info;
+}
+
+BlobStore::Blob* BlobStore::findBlob(uint64_t key) {
+    Blob probe = {key, 0, 0};
+    auto it = std::lower_bound(blobs.begin(), blobs.end(), probe,
+                               [](const Blob& a, const Blob& b) { return a.key < b.key; });
+    return (it != blobs.end() && it->key == key) ? &*it : nullptr;
+}
+
+void BlobStore::addReference(uint32_t figureId, uint64_t key) {
+    Blob probe = {key, 0, 0};
+    auto it = std::lower_bound(blobs.begin(), blobs.end(), probe,
+                               [](const Blob& a, const Blob& b) { return a.key < b.key; });
+    if (it == blobs.end() || it->key != key) {
+        it = blobs.insert(it, probe);
+    }
+    if (it->refs < UINT16_MAX) {
+        it->refs++;
+    }
+    countFigure(figureId, 1);
+}
+
+void BlobStore::releaseReference(uint32_t figureId, uint64_t key, std::vector<String>& released) {
+    Blob* blob = findBlob(key);
+    if (blob == nullptr || blob->refs == 0) {
+        return;
+    }
+    countFigure(figureId, -1);
+    if (--blob->refs > 0) {
+        return;
+    }
+
+    // Last reference gone; a blob not on the card yet may still be required or queued
+    char path[TrackId::PATH_MAX_LEN];
+    formatPath(key, path, sizeof(path));
+    if (blob->size == 0 || FileManager::getInstance().fileExists(path)) {
+        released.push_back(path);
+    }
+    storedBytes -= blob->size;
+    blobs.erase(blobs.begin() + (blob - blobs.data()));
+}
+
+void BlobStore::countFigure(uint32_t figureId, int delta) {
+    for (auto it = figureRefs.begin(); it != figureRefs.end(); ++it) {
+        if (it->figureId == figureId) {
+            if (delta < 0 && it->count <= (uint16_t)-delta) {
+                figureRefs.erase(it);
+            } else {
+                it->count += delta;
+            }
+            return;
+        }
+    }
+    if (delta > 0) {
+        FigureRefs figure = {figureId, (uint16_t)delta};
+        figureRefs.push_back(figure);
+    }
+}
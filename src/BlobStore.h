@@ -0,0 +1,87 @@
+#ifndef BLOB_STORE_H
+#define BLOB_STORE_H
+
+#include <Arduino.h>
+#include <vector>
+#include "TrackId.h"
+
+class FigureManifest;
+
+// Content-addressed store for track audio. A track the server sends a content hash
+// for is kept at /blobs/<key>.wav instead of its own /figures path, keyed by a 64-bit
+// FNV-1a of the hash, so an intro or jingle shared between episodes or figures is
+// downloaded and stored once.
+//
+// The references are the figures' manifests: each entry carries the blob key of its
+// track. begin() counts them across all figures, syncs move a figure's references
+// from its old manifest to its new one, and a blob is deleted when the last
+// reference goes. Tracks without a hash keep the per-figure layout.
+class BlobStore {
+public:
+    static BlobStore& getInstance();
+
+    // Call after FileManager::begin() and before StorageManager::begin(); reads every
+    // manifest and removes blobs nothing refers to
+    void begin();
+
+    static uint64_t keyFor(const String& contentHash); // 0 for an empty hash
+    static size_t formatPath(uint64_t key, char* buffer, size_t size);
+    static bool keyFromPath(const char* path, uint64_t& key);
+
+    // Where a track's audio lives: the blob when it has a key, its track path otherwise
+    static size_t localPath(const TrackId& ref, uint64_t key, char* buffer, size_t size);
+    // Same, looking the key up in the figure's manifest (the last figure asked about is cached)
+    size_t resolve(const TrackId& ref, char* buffer, size_t size);
+    uint64_t lookupKey(const TrackId& ref); // 0 when the manifest has no blob for the track
+    bool isUsedBy(uint32_t figureId, uint64_t key); // Per the figure's manifest
+
+    // A figure's manifest changed from before to after: references are added first, so a
+    // blob that is in both survives
+    void updateFigure(uint32_t figureId, const FigureManifest& before, const FigureManifest& after);
+    // Before the figure's directory (and manifest) is deleted. Blobs it was the last user
+    // of leave the store; their paths are appended to released for the caller to delete
+    // together with the figure's own files
+    void releaseFigure(uint32_t figureId, std::vector<String>& released);
+    void onBlobAdded(uint64_t key, size_t bytes); // A download finished into the store
+
+    bool hasReferences(uint32_t figureId) const;
+    uint64_t getStoredBytes() const { return storedBytes; }
+    String getStatusString();
+
+private:
+    static BlobStore* instance;
+    static const char* BLOB_DIR;
+
+    struct Blob {
+        uint64_t key;
+        uint32_t size;  // 0 = not on the card (yet)
+        uint16_t refs;
+    };
+    struct FigureRefs {
+        uint32_t figureId;
+        uint16_t count;
+    };
+    struct TrackBlob {
+        TrackId ref;
+        uint64_t key;
+    };
+
+    std::vector<Blob> blobs; // Sorted by key
+    std::vector<FigureRefs> figureRefs;
+    uint64_t storedBytes;
+
+    uint32_t cachedFigure; // 0 = none
+    std::vector<TrackBlob> cachedTracks; // Blob-backed tracks of cachedFigure, sorted by ref
+
+    BlobStore();
+    BlobStore(const BlobStore&) = delete;
+    BlobStore& operator=(const BlobStore&) = delete;
+
+    void cacheFigure(uint32_t figureId);
+    Blob* findBlob(uint64_t key);
+    void addReference(uint32_t figureId, uint64_t key);
+    void releaseReference(uint32_t figureId, uint64_t key, std::vector<String>& released);
+    void countFigure(uint32_t figureId, int delta);
+};
+
+#endif // BLOB_STORE_H
@@ -0,0 +1,447 @@
+#include "ConnectionManager.h"
+
+// Initialize static members
+ConnectionManager* ConnectionManager::instance = nullptr;
+
+ConnectionManager::ConnectionManager() {
+    for (int i = 0; i < POOL_SIZE; i++) {
+        slots[i].client = nullptr;
+        slots[i].port = 0;
+        slots[i].secure = false;
+        slots[i].inUse = false;
+        slots[i].httpBound = false;
+        slots[i].lastUsed = 0;
+        slots[i].requestStart = 0;
+        slots[i].requests = 0;
+        slots[i].reuses = 0;
+    }
+    resetStats();
+    poolMutex = xSemaphoreCreateMutex();
+}
+
+ConnectionManager& ConnectionManager::getInstance() {
+    if (instance == nullptr) {
+        instance = new ConnectionManager();
+    }
+    return *instance;
+}
+
+bool ConnectionManager::parseUrl(const String& url, bool& secure, String& host, uint16_t& port, String& path) {
+    int hostStart;
+    if (url.startsWith("https://")) {
+        secure = true;
+        port = 443;
+        hostStart = 8;
+    } else if (url.startsWith("http://")) {
+        secure = false;
+        port = 80;
+        hostStart = 7;
+    } else {
+        return false;
+    }
+
+    int pathStart = url.indexOf('/', hostStart);
+    if (pathStart == -1) {
+        host = url.substring(hostStart);
+        path = "/";
+    } else {
+        host = url.substring(hostStart, pathStart);
+        path = url.substring(pathStart);
+    }
+
+    // Check for port in hostname
+    int portIndex = host.indexOf(':');
+    if (portIndex != -1) {
+        port = host.substring(portIndex + 1).toInt();
+        host = host.substring(0, portIndex);
+    }
+
+    return !host.isEmpty() && port != 0;
+}
+
+void ConnectionManager::lock() {
+    xSemaphoreTake(poolMutex, portMAX_DELAY);
+}
+
+void ConnectionManager::unlock() {
+    xSemaphoreGive(poolMutex);
+}
+
+bool ConnectionManager::hasHeapForTLS() const {
+    return ESP.getFreeHeap() >= MIN_TLS_FREE_HEAP && ESP.getMaxAllocHeap() >= MIN_TLS_MAX_ALLOC;
+}
+
+bool ConnectionManager::slotConnected(Slot& slot) {
+    return slot.client != nullptr && slot.client->connected();
+}
+
+int ConnectionManager::openSecureSlots() {
+    int count = 0;
+    for (int i = 0; i < POOL_SIZE; i++) {
+        if (slots[i].secure && (slots[i].inUse || slotConnected(slots[i]))) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void ConnectionManager::closeSlot(Slot& slot) {
+    if (slot.client) {
+        slot.client->stop();
+    }
+    // Not connected any more, so end() only clears HTTPClient's client pointer. A later
+    // begin() on a still-set pointer would stop the connection we are about to open.
+    slot.http.end();
+    slot.httpBound = false;
+    slot.host = "";
+    slot.port = 0;
+}
+
+ConnectionManager::Slot* ConnectionManager::acquireSlot(bool secure, const String& host, uint16_t port, String& errorMsg,
+                                                        bool allowReuse, bool& reused) {
+    unsigned long setupStart = millis();
+    unsigned long now = setupStart;
+    reused = false;
+    lock();
+    stats.requests++;
+
+    // 1. An idle connection to the same origin that is still open
+    for (int i = 0; allowReuse && i < POOL_SIZE; i++) {
+        Slot& slot = slots[i];
+        if (slot.inUse || slot.secure != secure || slot.port != port || slot.host != host) {
+            continue;
+        }
+        if (now - slot.lastUsed > IDLE_TIMEOUT_MS || !slotConnected(slot)) {
+            // The server has most likely dropped it already
+            closeSlot(slot);
+            continue;
+        }
+        slot.inUse = true;
+        slot.requests++;
+        slot.reuses++;
+        stats.reused++;
+        reused = true;
+        slot.requestStart = millis();
+        uint32_t setupMs = slot.requestStart - setupStart;
+        stats.setupMsTotal += setupMs;
+        if (setupMs > stats.setupMsMax) stats.setupMsMax = setupMs;
+        unlock();
+        return &slot;
+    }
+
+    // 2. A free slot: prefer one that is closed, otherwise evict the least recently used
+    Slot* target = nullptr;
+    for (int i = 0; i < POOL_SIZE; i++) {
+        if (!slots[i].inUse && !slotConnected(slots[i])) {
+            target = &slots[i];
+            break;
+        }
+    }
+    if (target == nullptr) {
+        for (int i = 0; i < POOL_SIZE; i++) {
+            if (!slots[i].inUse && (target == nullptr || slots[i].lastUsed < target->lastUsed)) {
+                target = &slots[i];
+            }
+        }
+    }
+    if (target == nullptr) {
+        unlock();
+        errorMsg = "No free connection slot";
+        Serial.println("ConnectionManager: All connection slots busy");
+        return nullptr;
+    }
+
+    // Keep the number of live TLS sessions bounded; make room by closing an idle one
+    if (secure && !(target->secure && slotConnected(*target)) && openSecureSlots() >= MAX_SECURE_SLOTS) {
+        Slot* oldest = nullptr;
+        for (int i = 0; i < POOL_SIZE; i++) {
+            if (!slots[i].inUse && slots[i].secure && slotConnected(slots[i]) &&
+                (oldest == nullptr || slots[i].lastUsed < oldest->lastUsed)) {
+                oldest = &slots[i];
+            }
+        }
+        if (oldest == nullptr) {
+            unlock();
+            errorMsg = "Too many TLS connections in use";
+            return nullptr;
+        }
+        closeSlot(*oldest);
+        stats.evictions++;
+    }
+
+    if (slotConnected(*target)) {
+        stats.evictions++;
+    }
+    closeSlot(*target);
+
+    // Switch the slot's client type if needed
+    if (target->client != nullptr && target->secure != secure) {
+        delete target->client;
+        target->client = nullptr;
+    }
+    if (target->client == nullptr) {
+        if (secure) {
+            // Server certificates are not pinned, same as the Reverb WebSocket
+            WiFiClientSecure* secureClient = new WiFiClientSecure();
+            secureClient->setInsecure();
+            secureClient->setHandshakeTimeout(TLS_HANDSHAKE_TIMEOUT_S);
+            target->client = secureClient;
+        } else {
+            target->client = new WiFiClient();
+        }
+        target->secure = secure;
+    }
+
+    if (secure && !hasHeapForTLS()) {
+        // Idle TLS sessions are the biggest thing we can give back
+        for (int i = 0; i < POOL_SIZE; i++) {
+            if (&slots[i] != target && !slots[i].inUse && slots[i].secure && slotConnected(slots[i])) {
+                closeSlot(slots[i]);
+                stats.evictions++;
+            }
+        }
+        if (!hasHeapForTLS()) {
+            stats.heapRejections++;
+            unlock();
+            errorMsg = "Not enough heap for TLS (free " + String(ESP.getFreeHeap()) + ", largest block " + String(ESP.getMaxAllocHeap()) + ")";
+            Serial.printf("ConnectionManager: %s\n", errorMsg.c_str());
+            return nullptr;
+        }
+    }
+
+    // Reserve the slot and connect unlocked, so a handshake on one task does not hold
+    // up pool bookkeeping on the other
+    target->inUse = true;
+    unlock();
+
+    if (!target->client->connect(host.c_str(), port)) {
+        lock();
+        stats.connectFailures++;
+        target->inUse = false;
+        unlock();
+        errorMsg = "Failed to connect to server: " + host;
+        Serial.printf("ConnectionManager: Connect to %s:%u failed\n", host.c_str(), port);
+        return nullptr;
+    }
+
+    lock();
+    if (secure) {
+        stats.tlsHandshakes++;
+    } else {
+        stats.plainConnects++;
+    }
+    target->host = host;
+    target->port = port;
+    target->requests++;
+    target->requestStart = millis();
+
+    uint32_t setupMs = target->requestStart - setupStart;
+    stats.setupMsTotal += setupMs;
+    stats.newConnectionSetupMsTotal += setupMs;
+    if (setupMs > stats.setupMsMax) stats.setupMsMax = setupMs;
+    unlock();
+
+    Serial.printf("ConnectionManager: Connected to %s:%u (%s) in %u ms, free heap: %u\n",
+                  host.c_str(), port, secure ? "TLS" : "plain", setupMs, ESP.getFreeHeap());
+    return target;
+}
+
+void ConnectionManager::releaseSlot(Slot& slot) {
+    unsigned long now = millis();
+    uint32_t transferMs = now - slot.requestStart;
+    stats.transferMsTotal += transferMs;
+    if (transferMs > stats.transferMsMax) stats.transferMsMax = transferMs;
+    stats.completed++;
+
+    slot.inUse = false;
+    slot.lastUsed = now;
+    if (!slotConnected(slot)) {
+        slot.httpBound = false;
+    }
+}
+
+ConnectionManager::Slot* ConnectionManager::findSlot(const HTTPClient* http) {
+    for (int i = 0; i < POOL_SIZE; i++) {
+        if (&slots[i].http == http) {
+            return &slots[i];
+        }
+    }
+    return nullptr;
+}
+
+ConnectionManager::Slot* ConnectionManager::findSlot(const WiFiClient* client) {
+    for (int i = 0; i < POOL_SIZE; i++) {
+        if (slots[i].client == client) {
+            return &slots[i];
+        }
+    }
+    return nullptr;
+}
+
+HTTPClient* ConnectionManager::beginRequest(const String& url, String& errorMsg) {
+    bool secure;
+    String host, path;
+    uint16_t port;
+    if (!parseUrl(url, secure, host, port, path)) {
+        errorMsg = "Invalid URL format (must start with http:// or https://)";
+        return nullptr;
+    }
+
+    bool reused;
+    Slot* slot = acquireSlot(secure, host, port, errorMsg, true, reused);
+    if (slot == nullptr) {
+        return nullptr;
+    }
+
+    if (slot->httpBound) {
+        // Same origin: swap the URL and keep the socket. Per-request options such as
+        // HTTP/1.0 mode survive setURL(), so reset them to the pool defaults.
+        if (slot->http.setURL(url)) {
+            slot->http.useHTTP10(false);
+            slot->http.setReuse(true);
+            return &slot->http;
+        }
+        slot->http.end();
+        slot->httpBound = false;
+    }
+
+    if (!slot->http.begin(*slot->client, url)) {
+        errorMsg = "Failed to establish connection to " + url;
+        closeSlot(*slot);
+        lock();
+        releaseSlot(*slot);
+        unlock();
+        return nullptr;
+    }
+    slot->http.useHTTP10(false);
+    slot->http.setReuse(true);
+    slot->httpBound = true;
+    return &slot->http;
+}
+
+void ConnectionManager::endRequest(HTTPClient* http, bool keepOpen) {
+    Slot* slot = findSlot(http);
+    if (slot == nullptr) {
+        return;
+    }
+
+    if (keepOpen) {
+        // end() keeps the socket when the server allowed keep-alive
+        http->end();
+    } else {
+        // Response not fully read (cancelled), the socket cannot carry another request
+        closeSlot(*slot);
+    }
+    lock();
+    releaseSlot(*slot);
+    unlock();
+}
+
+WiFiClient* ConnectionManager::openStream(const String& host, uint16_t port, bool secure, String& errorMsg,
+                                          bool* reused, bool fresh) {
+    bool fromPool;
+    Slot* slot = acquireSlot(secure, host, port, errorMsg, !fresh, fromPool);
+    if (reused != nullptr) {
+        *reused = fromPool;
+    }
+    if (slot == nullptr) {
+        return nullptr;
+    }
+
+    // The raw caller owns the socket now; the HTTPClient must begin() afresh next time
+    slot->httpBound = false;
+    return slot->client;
+}
+
+void ConnectionManager::closeStream(WiFiClient* client, bool keepOpen) {
+    Slot* slot = findSlot(client);
+    if (slot == nullptr) {
+        return;
+    }
+
+    if (!keepOpen) {
+        closeSlot(*slot);
+    }
+    lock();
+    releaseSlot(*slot);
+    unlock();
+}
+
+void ConnectionManager::update() {
+    static unsigned long lastCheck = 0;
+    unsigned long now = millis();
+    if (now - lastCheck < 1000) {
+        return;
+    }
+    lastCheck = now;
+
+    // Never wait on the loop task; if another task is in the pool, check next time
+    if (xSemaphoreTake(poolMutex, 0) != pdTRUE) {
+        return;
+    }
+
+    bool wifiUp = WiFi.isConnected();
+    for (int i = 0; i < POOL_SIZE; i++) {
+        Slot& slot = slots[i];
+        if (slot.inUse || slot.host.isEmpty()) {
+            continue;
+        }
+        if (!wifiUp || now - slot.lastUsed > IDLE_TIMEOUT_MS || !slotConnected(slot)) {
+            closeSlot(slot);
+            stats.idleClosed++;
+        }
+    }
+    unlock();
+}
+
+void ConnectionManager::closeAll() {
+    lock();
+    for (int i = 0; i < POOL_SIZE; i++) {
+        // Connections owned by a request in flight are left to their owner
+        if (!slots[i].inUse) {
+            closeSlot(slots[i]);
+        }
+    }
+    unlock();
+}
+
+void ConnectionManager::resetStats() {
+    memset(&stats, 0, sizeof(stats));
+}
+
+String ConnectionManager::getStatsString() {
+    unsigned long now = millis();
+    String info = "Connection Manager:\n";
+    info += "Requests: " + String(stats.requests) + " (reused " + String(stats.reused) + ")\n";
+    if (stats.requests > 0) {
+        info += "Reuse rate: " + String((float)stats.reused / stats.requests * 100, 1) + "%\n";
+    }
+    info += "TLS handshakes: " + String(stats.tlsHandshakes) + ", plain connects: " + String(stats.plainConnects) + "\n";
+    info += "Connect failures: " + String(stats.connectFailures) + ", rejected (low heap): " + String(stats.heapRejections) + "\n";
+    info += "Closed idle: " + String(stats.idleClosed) + ", evicted: " + String(stats.evictions) + "\n";
+
+    uint32_t newConnections = stats.tlsHandshakes + stats.plainConnects;
+    if (stats.completed > 0) {
+        info += "Setup avg: " + String(stats.setupMsTotal / stats.completed) + " ms, max: " + String(stats.setupMsMax) + " ms\n";
+        info += "Transfer avg: " + String(stats.transferMsTotal / stats.completed) + " ms, max: " + String(stats.transferMsMax) + " ms\n";
+    }
+    if (newConnections > 0) {
+        info += "New connection setup avg: " + String(stats.newConnectionSetupMsTotal / newConnections) + " ms\n";
+    }
+
+    for (int i = 0; i < POOL_SIZE; i++) {
+        Slot& slot = slots[i];
+        info += "Slot " + String(i) + ": ";
+        if (slot.host.isEmpty()) {
+            info += "closed";
+        } else {
+            info += String(slot.secure ? "https://" : "http://") + slot.host + ":" + String(slot.port);
+            info += slot.inUse ? " busy" : (" idle " + String((now - slot.lastUsed) / 1000) + "s");
+            info += ", requests " + String(slot.requests) + ", reuses " + String(slot.reuses);
+        }
+        info += "\n";
+    }
+
+    info += "Free heap: " + String(ESP.getFreeHeap()) + ", largest block: " + String(ESP.getMaxAllocHeap()) + "\n";
+    return info;
+}
@@ -0,0 +1,123 @@
+#ifndef CONNECTION_MANAGER_H
+#define CONNECTION_MANAGER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiClient.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// Owns the device's outgoing HTTP(S) connections so API calls, downloads and the
+// Reverb REST calls share a small pool of keep-alive sockets instead of each
+// keeping their own.
+//
+// The Arduino core does not expose mbedTLS session tickets or record buffer sizes,
+// so the handshake is amortised the only way it can be here: by keeping the
+// connection open and reusing it while requests go to the same origin.
+//
+// Safe to use from the loop task and RequestManager's worker task at once: the slot
+// table is guarded by a mutex, and a slot handed out belongs to its caller until it
+// is given back, so the request itself runs unlocked.
+class ConnectionManager {
+public:
+    static ConnectionManager& getInstance();
+
+    // Ready an HTTPClient for url. Reuses an idle pooled connection to the same
+    // scheme/host/port, otherwise connects a free slot. Returns nullptr with
+    // errorMsg set on failure. Finish with endRequest(), never call begin()/end()
+    // on the returned client directly.
+    HTTPClient* beginRequest(const String& url, String& errorMsg);
+    void endRequest(HTTPClient* http, bool keepOpen = true); // keepOpen false drops a half-read response
+
+    // Raw connected client for callers that speak HTTP themselves (file downloads).
+    // Call closeStream() when done; keepOpen returns the socket to the pool. reused
+    // reports a pooled socket, which the server may have closed since; fresh skips
+    // the pool and connects anew.
+    WiFiClient* openStream(const String& host, uint16_t port, bool secure, String& errorMsg,
+                           bool* reused = nullptr, bool fresh = false);
+    void closeStream(WiFiClient* client, bool keepOpen);
+
+    // Close idle connections past their timeout, call from loop()
+    void update();
+
+    // Drop every idle connection (WiFi loss, before large allocations)
+    void closeAll();
+
+    // Split http(s)://host[:port]/path, returns false for any other scheme
+    static bool parseUrl(const String& url, bool& secure, String& host, uint16_t& port, String& path);
+
+    // True when there is enough contiguous heap for a TLS handshake
+    bool hasHeapForTLS() const;
+
+    String getStatsString();
+    void resetStats();
+
+private:
+    static ConnectionManager* instance;
+
+    // mbedTLS needs two 16KB record buffers plus handshake state while connecting
+    static const uint32_t MIN_TLS_FREE_HEAP = 45000;
+    static const uint32_t MIN_TLS_MAX_ALLOC = 20000;
+    static const unsigned long TLS_HANDSHAKE_TIMEOUT_S = 15;
+
+    // Pool sizing: every open TLS session holds ~35KB, so at most two of the slots
+    // may be secure at once
+    static const int POOL_SIZE = 3;
+    static const int MAX_SECURE_SLOTS = 2;
+    static const unsigned long IDLE_TIMEOUT_MS = 30000; // Below typical server keep-alive timeouts
+
+    struct Slot {
+        WiFiClient* client; // WiFiClientSecure when secure, created on first use
+        HTTPClient http;
+        String host;
+        uint16_t port;
+        bool secure;
+        bool inUse;
+        bool httpBound;          // http was begun on client for host:port and can use setURL()
+        unsigned long lastUsed;  // millis() when the slot was last released
+        unsigned long requestStart; // millis() when the current request finished setup
+        uint32_t requests;
+        uint32_t reuses;
+    };
+
+    Slot slots[POOL_SIZE];
+    SemaphoreHandle_t poolMutex;
+
+    struct Stats {
+        uint32_t requests;
+        uint32_t reused;
+        uint32_t tlsHandshakes;
+        uint32_t plainConnects;
+        uint32_t heapRejections;
+        uint32_t connectFailures;
+        uint32_t idleClosed;
+        uint32_t evictions;
+        // Setup = acquiring a connected socket (DNS + TCP + TLS when not reused),
+        // transfer = from then until the caller releases it
+        uint32_t setupMsTotal;
+        uint32_t setupMsMax;
+        uint32_t newConnectionSetupMsTotal;
+        uint32_t transferMsTotal;
+        uint32_t transferMsMax;
+        uint32_t completed;
+    } stats;
+
+    ConnectionManager();
+    ConnectionManager(const ConnectionManager&) = delete;
+    ConnectionManager& operator=(const ConnectionManager&) = delete;
+
+    void lock();
+    void unlock();
+    Slot* acquireSlot(bool secure, const String& host, uint16_t port, String& errorMsg,
+                      bool allowReuse, bool& reused);
+    void releaseSlot(Slot& slot);
+    void closeSlot(Slot& slot);
+    Slot* findSlot(const HTTPClient* http);
+    Slot* findSlot(const WiFiClient* client);
+    bool slotConnected(Slot& slot);
+    int openSecureSlots();
+};
+
+#endif // CONNECTION_MANAGER_H
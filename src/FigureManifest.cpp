@@ -0,0 +1,161 @@
+#include "FigureManifest.h"
+#include "FileManager.h"
+#include <algorithm>
+
+void FigureManifest::add(const TrackId& ref, uint32_t size, uint32_t contentTag, uint64_t blobKey) {
+    Entry entry;
+    memset(&entry, 0, sizeof(entry)); // Padding included, entries are checksummed and compared as bytes
+    entry.ref = ref;
+    entry.size = size;
+    entry.contentTag = contentTag;
+    entry.blobKey = blobKey;
+    entries.push_back(entry);
+}
+
+void FigureManifest::sort() {
+    std::sort(entries.begin(), entries.end(), entryLess);
+    // The server should never list a track twice; if it does, the first one wins
+    auto last = std::unique(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.ref == b.ref;
+    });
+    entries.erase(last, entries.end());
+}
+
+const FigureManifest::Entry* FigureManifest::find(const TrackId& ref) const {
+    Entry key;
+    key.ref = ref;
+    auto it = std::lower_bound(entries.begin(), entries.end(), key, entryLess);
+    return (it != entries.end() && it->ref == ref) ? &*it : nullptr;
+}
+
+bool FigureManifest::remove(const TrackId& ref) {
+    Entry key;
+    key.ref = ref;
+    auto it = std::lower_bound(entries.begin(), entries.end(), key, entryLess);
+    if (it == entries.end() || it->ref != ref) {
+        return false;
+    }
+    entries.erase(it);
+    return true;
+}
+
+String FigureManifest::pathFor(uint32_t figureId) {
+    return "/figures/" + String(figureId) + "/manifest.bin";
+}
+
+uint32_t FigureManifest::checksumOf(const std::vector<Entry>& entries) {
+    // FNV-1a, only has to catch a torn or truncated write
+    uint32_t hash = 2166136261UL;
+    const uint8_t* bytes = (const uint8_t*)entries.data();
+    size_t length = entries.size() * sizeof(Entry);
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+uint32_t FigureManifest::contentTag(const String& hash, const String& version) {
+    if (hash.isEmpty() && version.isEmpty()) {
+        return 0;
+    }
+    uint32_t tag = 2166136261UL;
+    for (size_t i = 0; i < hash.length(); i++) {
+        tag ^= (uint8_t)hash[i];
+        tag *= 16777619UL;
+    }
+    tag ^= '|';
+    tag *= 16777619UL;
+    for (size_t i = 0; i < version.length(); i++) {
+        tag ^= (uint8_t)version[i];
+        tag *= 16777619UL;
+    }
+    return tag != 0 ? tag : 1; // 0 is reserved for "unknown"
+}
+
+bool FigureManifest::load(uint32_t figureId) {
+    entries.clear();
+
+    File file = FileManager::getInstance().openFile(pathFor(figureId));
+    if (!file) {
+        return false;
+    }
+
+    Header header;
+    bool ok = file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+              header.magic == MAGIC && header.count <= MAX_ENTRIES &&
+              file.size() == sizeof(header) + header.count * sizeof(Entry);
+    if (ok) {
+        entries.resize(header.count);
+        size_t bytes = header.count * sizeof(Entry);
+        ok = file.read((uint8_t*)entries.data(), bytes) == bytes && checksumOf(entries) == header.checksum;
+    }
+    file.close();
+
+    if (!ok) {
+        Serial.printf("FigureManifest: Manifest for figure %u is unreadable, doing a full sync\n", figureId);
+        entries.clear();
+        return false;
+    }
+    return true;
+}
+
+bool FigureManifest::save(uint32_t figureId) const {
+    FileManager& fileManager = FileManager::getInstance();
+    String figureDir = "/figures/" + String(figureId);
+    if (!fileManager.fileExists(figureDir) && !fileManager.createDirectory(figureDir)) {
+        return false;
+    }
+
+    // Written beside the old copy and renamed over it, so a power cut leaves one or the other
+    String path = pathFor(figureId);
+    String tempPath = path + ".tmp";
+    File file = fileManager.openFile(tempPath, FILE_WRITE);
+    if (!file) {
+        Serial.printf("FigureManifest: Failed to create %s\n", tempPath.c_str());
+        return false;
+    }
+
+    Header header;
+    header.magic = MAGIC;
+    header.count = entries.size();
+    header.checksum = checksumOf(entries);
+    size_t bytes = entries.size() * sizeof(Entry);
+    bool ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+              file.write((const uint8_t*)entries.data(), bytes) == bytes;
+    file.close();
+
+    if (!ok) {
+        Serial.printf("FigureManifest: Failed to write %s\n", tempPath.c_str());
+        fileManager.deleteFile(tempPath);
+        return false;
+    }
+    return fileManager.replaceFile(tempPath, path);
+}
+
+void FigureManifest::diff(const FigureManifest& local, const FigureManifest& remote, Changes& changes) {
+    changes.added.clear();
+    changes.changed.clear();
+    changes.removed.clear();
+    changes.unchanged = 0;
+
+    // Both sides are sorted by track id, so one walk pairs them up
+    size_t i = 0;
+    size_t j = 0;
+    while (i < local.entries.size() || j < remote.entries.size()) {
+        if (j >= remote.entries.size() ||
+            (i < local.entries.size() && local.entries[i].ref < remote.entries[j].ref)) {
+            changes.removed.push_back(local.entries[i++]);
+        } else if (i >= local.entries.size() || remote.entries[j].ref < local.entries[i].ref) {
+            changes.added.push_back(remote.entries[j++]);
+        } else {
+            if (local.entries[i].sameContent(remote.entries[j])) {
+                changes.unchanged++;
+            } else {
+                changes.changed.push_back(remote.entries[j]);
+            }
+            i++;
+            j++;
+        }
+    }
+}
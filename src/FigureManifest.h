@@ -0,0 +1,72 @@
+#ifndef FIGURE_MANIFEST_H
+#define FIGURE_MANIFEST_H
+
+#include <Arduino.h>
+#include <vector>
+#include "TrackId.h"
+
+// What the card holds for one figure, as of the last sync with the server: one
+// fixed-size record per track (id, size, a tag derived from the server's hash and
+// version fields and the BlobStore key the audio is kept under), sorted by track id. Kept at /figures/<figure>/manifest.bin so it
+// goes away together with the figure's audio when the figure is deleted or evicted.
+//
+// A sync diffs the server's listing against it in one merge pass, so only added,
+// changed and removed tracks cost any SD or NVS work.
+class FigureManifest {
+public:
+    struct Entry {
+        TrackId ref;
+        uint32_t size;       // 0 = server did not send one
+        uint32_t contentTag; // 0 = server sent neither hash nor version
+        uint64_t blobKey;    // BlobStore::keyFor() the server's hash, 0 = kept at the track path
+
+        // Either side not knowing a field is not a change, so older server responses
+        // and manifests written before the field existed do not trigger re-downloads.
+        // A different blob key is, the audio would be looked for in another place.
+        bool sameContent(const Entry& other) const {
+            return (size == 0 || other.size == 0 || size == other.size) &&
+                   (contentTag == 0 || other.contentTag == 0 || contentTag == other.contentTag) &&
+                   blobKey == other.blobKey;
+        }
+    };
+
+    struct Changes {
+        std::vector<Entry> added;
+        std::vector<Entry> changed; // New values
+        std::vector<Entry> removed;
+        size_t unchanged;
+
+        bool empty() const { return added.empty() && changed.empty() && removed.empty(); }
+    };
+
+    std::vector<Entry> entries;
+
+    void add(const TrackId& ref, uint32_t size, uint32_t contentTag, uint64_t blobKey = 0);
+    void sort(); // Call after the last add()
+    const Entry* find(const TrackId& ref) const;
+    bool remove(const TrackId& ref);
+
+    // load() returns false when there is no manifest or it is unreadable; either way
+    // the caller treats every track as new
+    bool load(uint32_t figureId);
+    bool save(uint32_t figureId) const;
+
+    static void diff(const FigureManifest& local, const FigureManifest& remote, Changes& changes);
+    static uint32_t contentTag(const String& hash, const String& version);
+    static String pathFor(uint32_t figureId);
+
+private:
+    static const uint32_t MAGIC = 0x32464D54; // "TMF2", TMF1 had no blob keys
+    static const size_t MAX_ENTRIES = 2048;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t count;
+        uint32_t checksum; // FNV-1a over the entries
+    };
+
+    static uint32_t checksumOf(const std::vector<Entry>& entries);
+    static bool entryLess(const Entry& a, const Entry& b) { return a.ref < b.ref; }
+};
+
+#endif // FIGURE_MANIFEST_H
@@ -0,0 +1,555 @@
+#include "FigureStreamParser.h"
+
+FigureStreamParser::FigureStreamParser(Stream& stream, Client* connection, Listener& listener, unsigned long timeoutMs) :
+    stream(stream),
+    connection(connection),
+    listener(listener),
+    timeoutMs(timeoutMs),
+    cancelFlag(nullptr),
+    cancelled(false),
+    bufferLength(0),
+    bufferPos(0),
+    totalRead(0),
+    failed(false),
+    figureFound(false),
+    figureId(0) {
+}
+
+bool FigureStreamParser::parse() {
+    skipWhitespace();
+    if (peekChar() != '{') {
+        return fail("Response is not a JSON object");
+    }
+    return parseRoot() && !failed;
+}
+
+// Input handling
+bool FigureStreamParser::fill() {
+    unsigned long start = millis();
+    while (true) {
+        if (cancelFlag != nullptr && *cancelFlag) {
+            cancelled = true;
+            return false;
+        }
+
+        int available = stream.available();
+        if (available > 0) {
+            size_t toRead = min((size_t)available, (size_t)READ_BUFFER_SIZE);
+            bufferLength = stream.readBytes(buffer, toRead);
+            bufferPos = 0;
+            totalRead += bufferLength;
+            if (bufferLength > 0) {
+                return true;
+            }
+        }
+
+        // Files have no more data once available() hits zero; sockets may still be receiving
+        if (connection == nullptr || !connection->connected()) {
+            return false;
+        }
+        if (millis() - start > timeoutMs) {
+            return false;
+        }
+        delay(1);
+    }
+}
+
+int FigureStreamParser::peekChar() {
+    if (bufferPos >= bufferLength && !fill()) {
+        return -1;
+    }
+    return buffer[bufferPos];
+}
+
+int FigureStreamParser::nextChar() {
+    if (bufferPos >= bufferLength && !fill()) {
+        return -1;
+    }
+    return buffer[bufferPos++];
+}
+
+void FigureStreamParser::skipWhitespace() {
+    while (true) {
+        int c = peekChar();
+        if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+            return;
+        }
+        bufferPos++;
+    }
+}
+
+bool FigureStreamParser::expect(char c) {
+    skipWhitespace();
+    int got = nextChar();
+    if (got != c) {
+        if (got < 0) {
+            return fail("Unexpected end of response");
+        }
+        return fail(String("Expected '") + c + "' at byte " + String(totalRead - bufferLength + bufferPos));
+    }
+    return true;
+}
+
+bool FigureStreamParser::fail(const String& message) {
+    if (!failed) {
+        failed = true;
+        error = cancelled ? String("Cancelled") : message;
+    }
+    return false;
+}
+
+// Structure helpers
+bool FigureStreamParser::nextMember(char* key, size_t keySize, bool& first, bool& done) {
+    skipWhitespace();
+    int c = peekChar();
+    if (c == '}') {
+        bufferPos++;
+        done = true;
+        return true;
+    }
+    if (!first && !expect(',')) {
+        return false;
+    }
+    first = false;
+
+    // Keys are read into a fixed buffer; the few we match on are short
+    String keyString;
+    bool truncated = false;
+    if (!readString(&keyString, keySize - 1, &truncated)) {
+        return false;
+    }
+    strncpy(key, keyString.c_str(), keySize - 1);
+    key[keySize - 1] = '\0';
+
+    if (!expect(':')) {
+        return false;
+    }
+    skipWhitespace();
+    done = false;
+    return true;
+}
+
+bool FigureStreamParser::nextElement(bool& first, bool& done) {
+    skipWhitespace();
+    int c = peekChar();
+    if (c == ']') {
+        bufferPos++;
+        done = true;
+        return true;
+    }
+    if (!first && !expect(',')) {
+        return false;
+    }
+    first = false;
+    skipWhitespace();
+    done = false;
+    return true;
+}
+
+// Values
+bool FigureStreamParser::readString(String* out, size_t maxLength, bool* truncated) {
+    if (!expect('"')) {
+        return false;
+    }
+
+    // Collect into a small stack chunk so the String grows a few times, not per character
+    char chunk[64];
+    size_t chunkLength = 0;
+    size_t length = 0;
+    if (truncated) {
+        *truncated = false;
+    }
+
+    while (true) {
+        int c = nextChar();
+        if (c < 0) {
+            return fail("Unterminated string");
+        }
+        if (c == '"') {
+            break;
+        }
+
+        char decoded[4];
+        size_t decodedLength = 1;
+        if (c == '\\') {
+            int e = nextChar();
+            switch (e) {
+                case '"': decoded[0] = '"'; break;
+                case '\\': decoded[0] = '\\'; break;
+                case '/': decoded[0] = '/'; break;
+                case 'b': decoded[0] = '\b'; break;
+                case 'f': decoded[0] = '\f'; break;
+                case 'n': decoded[0] = '\n'; break;
+                case 'r': decoded[0] = '\r'; break;
+                case 't': decoded[0] = '\t'; break;
+                case 'u': {
+                    uint32_t code = 0;
+                    for (int i = 0; i < 4; i++) {
+                        int h = nextChar();
+                        if (h >= '0' && h <= '9') code = (code << 4) | (h - '0');
+                        else if (h >= 'a' && h <= 'f') code = (code << 4) | (h - 'a' + 10);
+                        else if (h >= 'A' && h <= 'F') code = (code << 4) | (h - 'A' + 10);
+                        else return fail("Invalid \\u escape");
+                    }
+                    // Encode as UTF-8 (surrogate halves come out as separate 3-byte sequences)
+                    if (code < 0x80) {
+                        decoded[0] = (char)code;
+                    } else if (code < 0x800) {
+                        decoded[0] = (char)(0xC0 | (code >> 6));
+                        decoded[1] = (char)(0x80 | (code & 0x3F));
+                        decodedLength = 2;
+                    } else {
+                        decoded[0] = (char)(0xE0 | (code >> 12));
+                        decoded[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+                        decoded[2] = (char)(0x80 | (code & 0x3F));
+                        decodedLength = 3;
+                    }
+                    break;
+                }
+                default:
+                    return fail("Invalid escape in string");
+            }
+        } else {
+            decoded[0] = (char)c;
+        }
+
+        if (out == nullptr) {
+            continue; // Skipping, nothing to keep
+        }
+        if (length + decodedLength > maxLength) {
+            if (truncated) {
+                *truncated = true;
+            }
+            continue; // Keep consuming up to the closing quote
+        }
+        if (chunkLength + decodedLength >= sizeof(chunk)) {
+            chunk[chunkLength] = '\0';
+            out->concat(chunk);
+            chunkLength = 0;
+        }
+        memcpy(chunk + chunkLength, decoded, decodedLength);
+        chunkLength += decodedLength;
+        length += decodedLength;
+    }
+
+    if (out != nullptr && chunkLength > 0) {
+        chunk[chunkLength] = '\0';
+        out->concat(chunk);
+    }
+    return true;
+}
+
+bool FigureStreamParser::readScalarToken(char* out, size_t size) {
+    skipWhitespace();
+    size_t length = 0;
+    while (true) {
+        int c = peekChar();
+        if (c < 0 || c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            break;
+        }
+        bufferPos++;
+        if (length + 1 < size) {
+            out[length++] = (char)c;
+        }
+    }
+    out[length] = '\0';
+    if (length == 0) {
+        return fail("Expected a value");
+    }
+    return true;
+}
+
+bool FigureStreamParser::readUnsigned(uint32_t& out) {
+    skipWhitespace();
+    if (peekChar() == '"') {
+        // Ids occasionally arrive quoted
+        String text;
+        if (!readString(&text, 16, nullptr)) {
+            return false;
+        }
+        out = strtoul(text.c_str(), nullptr, 10);
+        return true;
+    }
+
+    char token[24];
+    if (!readScalarToken(token, sizeof(token))) {
+        return false;
+    }
+    out = (token[0] >= '0' && token[0] <= '9') ? strtoul(token, nullptr, 10) : 0; // null, false, negatives
+    return true;
+}
+
+bool FigureStreamParser::readInt(int& out) {
+    skipWhitespace();
+    if (peekChar() == '"') {
+        String text;
+        if (!readString(&text, 16, nullptr)) {
+            return false;
+        }
+        out = text.toInt();
+        return true;
+    }
+
+    char token[24];
+    if (!readScalarToken(token, sizeof(token))) {
+        return false;
+    }
+    out = (int)strtod(token, nullptr); // Durations may be fractional
+    return true;
+}
+
+bool FigureStreamParser::readTag(String& out) {
+    skipWhitespace();
+    if (peekChar() == '"') {
+        return readString(&out, MAX_TAG_LENGTH, nullptr);
+    }
+
+    char token[24];
+    if (!readScalarToken(token, sizeof(token))) {
+        return false;
+    }
+    out = strcmp(token, "null") == 0 ? "" : token;
+    return true;
+}
+
+bool FigureStreamParser::skipValue() {
+    skipWhitespace();
+    int c = peekChar();
+    if (c == '"') {
+        return readString(nullptr, 0, nullptr);
+    }
+    if (c != '{' && c != '[') {
+        char token[24];
+        return readScalarToken(token, sizeof(token));
+    }
+
+    // Containers are skipped with a depth counter rather than recursion, so unknown
+    // nesting costs no stack
+    uint32_t depth = 0;
+    do {
+        c = peekChar();
+        if (c < 0) {
+            return fail("Unexpected end of response");
+        }
+        if (c == '"') {
+            if (!readString(nullptr, 0, nullptr)) {
+                return false;
+            }
+            continue;
+        }
+        bufferPos++;
+        if (c == '{' || c == '[') {
+            depth++;
+        } else if (c == '}' || c == ']') {
+            depth--;
+        }
+    } while (depth > 0);
+    return true;
+}
+
+// Schema
+bool FigureStreamParser::parseRoot() {
+    if (!expect('{')) {
+        return false;
+    }
+
+    char key[MAX_KEY_LENGTH];
+    bool first = true;
+    bool done = false;
+    while (!failed) {
+        if (!nextMember(key, sizeof(key), first, done)) {
+            return false;
+        }
+        if (done) {
+            return true;
+        }
+
+        bool isFigureKey = strcmp(key, "figure") == 0 || strcmp(key, "data") == 0 || strcmp(key, "unit") == 0;
+        if (isFigureKey && !figureFound && peekChar() == '{') {
+            if (!parseFigure()) {
+                return false;
+            }
+        } else if (strcmp(key, "message") == 0 && peekChar() == '"') {
+            if (!readString(&serverMessage, MAX_MESSAGE_LENGTH, nullptr)) {
+                return false;
+            }
+        } else if (!skipValue()) {
+            return false;
+        }
+    }
+    return false;
+}
+
+bool FigureStreamParser::parseFigure() {
+    if (!expect('{')) {
+        return false;
+    }
+
+    String name;
+    String description;
+    char key[MAX_KEY_LENGTH];
+    bool first = true;
+    bool done = false;
+    while (!failed) {
+        if (!nextMember(key, sizeof(key), first, done)) {
+            return false;
+        }
+        if (done) {
+            break;
+        }
+
+        bool ok;
+        if (strcmp(key, "id") == 0) {
+            ok = readUnsigned(figureId);
+        } else if (strcmp(key, "name") == 0 && peekChar() == '"') {
+            ok = readString(&name, MAX_TEXT_LENGTH, nullptr);
+        } else if (strcmp(key, "description") == 0 && peekChar() == '"') {
+            ok = readString(&description, MAX_TEXT_LENGTH, nullptr);
+        } else if (strcmp(key, "episodes") == 0 && peekChar() == '[') {
+            if (figureId == 0) {
+                return fail("Figure id must precede its episodes");
+            }
+            bufferPos++; // '['
+            bool firstEpisode = true;
+            bool episodesDone = false;
+            ok = true;
+            while (ok && !failed) {
+                ok = nextElement(firstEpisode, episodesDone);
+                if (!ok || episodesDone) {
+                    break;
+                }
+                ok = (peekChar() == '{') ? parseEpisode() : skipValue();
+            }
+        } else {
+            ok = skipValue();
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+
+    if (failed) {
+        return false;
+    }
+    figureFound = true;
+    listener.onFigureEnd(figureId, name, description);
+    return true;
+}
+
+bool FigureStreamParser::parseEpisode() {
+    if (!expect('{')) {
+        return false;
+    }
+
+    uint32_t episodeId = 0;
+    bool started = false;
+    String name;
+    String description;
+    char key[MAX_KEY_LENGTH];
+    bool first = true;
+    bool done = false;
+    while (!failed) {
+        if (!nextMember(key, sizeof(key), first, done)) {
+            return false;
+        }
+        if (done) {
+            break;
+        }
+
+        bool ok;
+        if (strcmp(key, "id") == 0) {
+            ok = readUnsigned(episodeId);
+        } else if (strcmp(key, "name") == 0 && peekChar() == '"') {
+            ok = readString(&name, MAX_TEXT_LENGTH, nullptr);
+        } else if (strcmp(key, "description") == 0 && peekChar() == '"') {
+            ok = readString(&description, MAX_TEXT_LENGTH, nullptr);
+        } else if (strcmp(key, "tracks") == 0 && peekChar() == '[') {
+            if (episodeId == 0) {
+                return fail("Episode id must precede its tracks");
+            }
+            if (!started) {
+                listener.onEpisodeStart(figureId, episodeId);
+                started = true;
+            }
+            bufferPos++; // '['
+            bool firstTrack = true;
+            bool tracksDone = false;
+            ok = true;
+            while (ok && !failed) {
+                ok = nextElement(firstTrack, tracksDone);
+                if (!ok || tracksDone) {
+                    break;
+                }
+                ok = (peekChar() == '{') ? parseTrack(episodeId) : skipValue();
+            }
+        } else {
+            ok = skipValue();
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+
+    if (failed) {
+        return false;
+    }
+    if (!started) {
+        listener.onEpisodeStart(figureId, episodeId);
+    }
+    listener.onEpisodeEnd(episodeId, name, description);
+    return true;
+}
+
+bool FigureStreamParser::parseTrack(uint32_t episodeId) {
+    if (!expect('{')) {
+        return false;
+    }
+
+    TrackFields track;
+    track.id = 0;
+    track.duration = 0;
+    track.audioUrlTruncated = false;
+    track.size = 0;
+
+    char key[MAX_KEY_LENGTH];
+    bool first = true;
+    bool done = false;
+    while (!failed) {
+        if (!nextMember(key, sizeof(key), first, done)) {
+            return false;
+        }
+        if (done) {
+            break;
+        }
+
+        bool ok;
+        if (strcmp(key, "id") == 0) {
+            ok = readUnsigned(track.id);
+        } else if (strcmp(key, "name") == 0 && peekChar() == '"') {
+            ok = readString(&track.name, MAX_TEXT_LENGTH, nullptr);
+        } else if (strcmp(key, "description") == 0 && peekChar() == '"') {
+            ok = readString(&track.description, MAX_TEXT_LENGTH, nullptr);
+        } else if (strcmp(key, "audio_url") == 0 && peekChar() == '"') {
+            ok = readString(&track.audioUrl, MAX_URL_LENGTH, &track.audioUrlTruncated);
+        } else if (strcmp(key, "duration") == 0) {
+            ok = readInt(track.duration);
+        } else if (strcmp(key, "size") == 0 || strcmp(key, "file_size") == 0) {
+            ok = readUnsigned(track.size);
+        } else if (strcmp(key, "hash") == 0 || strcmp(key, "checksum") == 0) {
+            ok = readTag(track.contentHash);
+        } else if (strcmp(key, "version") == 0 || strcmp(key, "updated_at") == 0) {
+            ok = readTag(track.version);
+        } else {
+            ok = skipValue();
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+
+    if (failed) {
+        return false;
+    }
+    listener.onTrack(figureId, episodeId, track);
+    return true;
+}
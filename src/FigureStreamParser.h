@@ -0,0 +1,113 @@
+#ifndef FIGURE_STREAM_PARSER_H
+#define FIGURE_STREAM_PARSER_H
+
+#include <Arduino.h>
+#include <Client.h>
+
+// Incremental parser for the /units/{uid} response. Reads the JSON straight from
+// the stream and reports each track as soon as its object closes, so memory use
+// stays the same whether a figure has one episode or fifty. Only the fields the
+// figure model needs are kept; everything else is skipped without being stored.
+//
+// Expected shape (the figure object may sit under "figure", "data" or "unit"):
+//   {"figure":{"id":1,"name":"..","description":"..","episodes":[
+//       {"id":2,"name":"..","description":"..","tracks":[
+//           {"id":3,"name":"..","description":"..","audio_url":"..","duration":120,
+//            "size":123456,"hash":"..","version":4}]}]}}
+// Figure and episode ids must appear before their "episodes"/"tracks" arrays,
+// which is how the server serialises them. size, hash and version are optional and
+// only used to tell whether a track's audio changed since the last sync.
+class FigureStreamParser {
+public:
+    struct TrackFields {
+        uint32_t id;
+        String name;
+        String description;
+        String audioUrl;
+        int duration;
+        bool audioUrlTruncated; // URL longer than MAX_URL_LENGTH, do not download
+        uint32_t size;          // Audio file size in bytes, 0 = not sent
+        String contentHash;     // "hash"/"checksum", empty = not sent
+        String version;         // "version"/"updated_at", number or string, empty = not sent
+    };
+
+    class Listener {
+    public:
+        virtual ~Listener() {}
+        // Episode header, sent when its "tracks" array starts (or at its end if it has none)
+        virtual void onEpisodeStart(uint32_t figureId, uint32_t episodeId) = 0;
+        virtual void onTrack(uint32_t figureId, uint32_t episodeId, TrackFields& track) = 0;
+        // Name/description may follow the tracks in the JSON, so they arrive at the end
+        virtual void onEpisodeEnd(uint32_t episodeId, const String& name, const String& description) = 0;
+        virtual void onFigureEnd(uint32_t figureId, const String& name, const String& description) = 0;
+    };
+
+    // connection is optional and only used to tell a closed socket from a slow one;
+    // pass nullptr for file streams, where no data means end of file
+    FigureStreamParser(Stream& stream, Client* connection, Listener& listener, unsigned long timeoutMs = 10000);
+
+    // Polled between reads; when it turns true parse() stops and returns false
+    void setCancelFlag(const volatile bool* flag) { cancelFlag = flag; }
+
+    bool parse();
+
+    bool foundFigure() const { return figureFound; }
+    bool wasCancelled() const { return cancelled; }
+    const String& getError() const { return error; }
+    const String& getServerMessage() const { return serverMessage; } // Top level "message", if any
+    size_t getBytesRead() const { return totalRead; }
+
+private:
+    static const size_t READ_BUFFER_SIZE = 256;
+    static const size_t MAX_KEY_LENGTH = 24;       // Longer keys are truncated, none we use are
+    static const size_t MAX_TEXT_LENGTH = 512;     // Names and descriptions are truncated past this
+    static const size_t MAX_URL_LENGTH = 1024;
+    static const size_t MAX_MESSAGE_LENGTH = 128;
+    static const size_t MAX_TAG_LENGTH = 96;       // Hashes and version stamps
+
+    Stream& stream;
+    Client* connection;
+    Listener& listener;
+    unsigned long timeoutMs;
+    const volatile bool* cancelFlag;
+    bool cancelled;
+
+    uint8_t buffer[READ_BUFFER_SIZE];
+    size_t bufferLength;
+    size_t bufferPos;
+    size_t totalRead;
+
+    bool failed;
+    bool figureFound;
+    uint32_t figureId;
+    String error;
+    String serverMessage;
+
+    // Input
+    bool fill();
+    int peekChar();
+    int nextChar();
+    void skipWhitespace();
+    bool expect(char c);
+    bool fail(const String& message);
+
+    // Structure helpers; first must start true and is cleared by the call
+    bool nextMember(char* key, size_t keySize, bool& first, bool& done);
+    bool nextElement(bool& first, bool& done);
+
+    // Values
+    bool readString(String* out, size_t maxLength, bool* truncated);
+    bool readUnsigned(uint32_t& out);
+    bool readInt(int& out);
+    bool readTag(String& out); // String or bare scalar, kept as text
+    bool readScalarToken(char* out, size_t size);
+    bool skipValue();
+
+    // Schema
+    bool parseRoot();
+    bool parseFigure();
+    bool parseEpisode();
+    bool parseTrack(uint32_t episodeId);
+};
+
+#endif // FIGURE_STREAM_PARSER_H
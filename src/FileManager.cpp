@@ -1,17 +1,44 @@
 #include "FileManager.h"
 #include "BatteryManagement.h"
+#include "BlobStore.h"
+#include "ConfigManager.h"
+#include "ConnectionManager.h"
+#include "StorageManager.h"
+#include <algorithm>
+#include <dirent.h>
+#include <esp_heap_caps.h>
+#include <ff.h>
+#include <lwip/sockets.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // Initialize static members
 FileManager* FileManager::instance = nullptr;
+const char* FileManager::SD_MOUNT_POINT = "/sd";
+const char* FileManager::SD_FATFS_DRIVE = "0:"; // The card is the only FAT volume mounted
 const char* FileManager::NVS_NAMESPACE = "filemanager";
 const char* FileManager::NVS_DOWNLOAD_QUEUE_KEY = "dl_queue";
 const char* FileManager::NVS_FILE_LIST_KEY = "file_list";
 const char* FileManager::NVS_DOWNLOAD_STATS_KEY = "dl_stats";
+const char* FileManager::NVS_COMMIT_LOG_KEY = "commit_log";
 
 FileManager::FileManager() : 
+    commitLogCount(0),
     sdCardInitialized(false),
     downloadInProgress(false),
-    downloadProgressCallback(nullptr),
+    sdFs(&SD),
+    sdBusMode(SD_BUS_NONE),
+    spaceUsed(0),
+    spaceTotal(0),
+    spaceKnown(false),
+    spaceReconcileDue(false),
+    lastSpaceReconcile(0),
+    lastSpaceDrift(0),
+    lastDownloadFailure(DOWNLOAD_FAILED_LOCAL),
+    lastTransferFailed(false),
+    lastProbeOk(true),
+    lastProbeAt(0),
+    progressSeq(0),
     downloadCompleteCallback(nullptr),
     fileSystemEventCallback(nullptr) {
     // Initialize download stats
@@ -19,6 +46,23 @@ FileManager::FileManager() :
     downloadStats.successfulDownloads = 0;
     downloadStats.failedDownloads = 0;
     downloadStats.totalBytesDownloaded = 0;
+    
+    // Initialize SD entry cache stats
+    sdCacheStats.hits = 0;
+    sdCacheStats.misses = 0;
+    sdCacheStats.flushes = 0;
+    
+    memset(&downloadRate, 0, sizeof(downloadRate));
+    session.client = nullptr;
+    session.buffer = nullptr;
+    session.wireBuffer = nullptr;
+    session.staged = 0;
+    session.awaitingHeaders = false;
+    session.reusedSocket = false;
+    memset(&progress, 0, sizeof(progress));
+    downloadRate.chunkSize = DOWNLOAD_BUFFER_SIZE;
+    
+    lastSdBench.valid = false;
 }
 
 FileManager& FileManager::getInstance() {
@@ -48,12 +92,22 @@ bool FileManager::begin() {
         return false;
     }
     
+    // Settle whatever a power loss interrupted before downloads or readers start
+    recoverCommits();
+    
+    // Take the one full FAT walk for the space accounting now rather than mid-report
+    unsigned long spaceStart = millis();
+    reconcileSpace();
+    Serial.printf("FileManager: %s used, counted in %lu ms\n", formatBytes(spaceUsed).c_str(),
+                  millis() - spaceStart);
+    
     Serial.println("FileManager: Initialization complete");
     return true;
 }
 
 void FileManager::end() {
     // Save current state
+    abortDownload();
     saveDownloadQueue();
     saveRequiredFiles();
     saveDownloadStats();
@@ -64,8 +118,7 @@ void FileManager::end() {
     }
     
     // Unmount SD card
-    SD.end();
-    sdCardInitialized = false;
+    unmountSDCard();
     
     Serial.println("FileManager: Shutdown complete");
 }
@@ -73,6 +126,10 @@ void FileManager::end() {
 bool FileManager::initializeSDCard() {
     Serial.println("FileManager: Initializing SD card...");
     
+    // Anything cached from a previous mount may be stale
+    clearEntryCache();
+    spaceKnown = false;
+    
     // Check power supply first
     BatteryManager& battery = BatteryManager::getInstance();
     float voltage = battery.getBatteryVoltage();
@@ -85,6 +142,64 @@ bool FileManager::initializeSDCard() {
         Serial.println("FileManager: Note - Voltage reading may be inaccurate when USB powered");
     }
     
+    // Prefer the native SDMMC host when the board is wired for it, SPI otherwise
+    bool mounted = false;
+#ifdef SD_SDMMC_WIRED
+#ifdef SD_SDMMC_4BIT
+    mounted = mountSDMMC(false);
+#endif
+    if (!mounted) {
+        mounted = mountSDMMC(true);
+    }
+    if (!mounted) {
+        Serial.println("FileManager: SDMMC mount failed, falling back to SPI");
+    }
+#endif
+    if (!mounted && !mountSPI()) {
+        return false;
+    }
+    
+    // Check SD card type
+    uint8_t cardType = sdCardType();
+    if (cardType == CARD_NONE) {
+        Serial.println("FileManager: No SD card attached");
+        return false;
+    }
+    
+    Serial.print("FileManager: SD card type: ");
+    switch (cardType) {
+        case CARD_MMC:
+            Serial.println("MMC");
+            break;
+        case CARD_SD:
+            Serial.println("SDSC");
+            break;
+        case CARD_SDHC:
+            Serial.println("SDHC");
+            break;
+        default:
+            Serial.println("Unknown");
+            break;
+    }
+    
+    // Print SD card size
+    uint64_t cardSize = sdCardSize() / (1024 * 1024);
+    Serial.printf("FileManager: SD card size: %lluMB (%s)\n", cardSize, getBusModeName(sdBusMode));
+    
+    sdCardInitialized = true;
+    
+    // Create necessary directories
+    createDirectory("/audio");
+    createDirectory("/temp");
+    createDirectory("/logs");
+    createDirectory("/images");
+    createDirectory("/figures");
+    createDirectory("/catalog");
+    
+    return true;
+}
+
+bool FileManager::mountSPI() {
     // Configure CS pin as output and set high initially
     pinMode(SD_CS_PIN, OUTPUT);
     digitalWrite(SD_CS_PIN, HIGH);
@@ -118,11 +233,11 @@ bool FileManager::initializeSDCard() {
         for (int i = 0; i < numSpeeds && !sdInitialized; i++) {
             Serial.printf("FileManager: Trying %s... ", speedNames[i]);
             
-            if (SD.begin(SD_CS_PIN, SPI, initSpeeds[i])) {
+            if (SD.begin(SD_CS_PIN, SPI, initSpeeds[i], SD_MOUNT_POINT)) {
                 sdInitialized = true;
                 Serial.printf("SUCCESS\n");
-                Serial.printf("FileManager: SD card initialized at %s (≈%.1f KB/s)\n", 
-                             speedNames[i], (initSpeeds[i] * 0.1) / 1024.0);
+                Serial.printf("FileManager: SD card initialized at %s (run sdbench for measured throughput)\n", 
+                             speedNames[i]);
                 break;
             } else {
                 Serial.printf("failed, ");
@@ -146,45 +261,133 @@ bool FileManager::initializeSDCard() {
         return false;
     }
     
-    // Check SD card type
-    uint8_t cardType = SD.cardType();
-    if (cardType == CARD_NONE) {
-        Serial.println("FileManager: No SD card attached");
+    sdFs = &SD;
+    sdBusMode = SD_BUS_SPI;
+    return true;
+}
+
+bool FileManager::mountSDMMC(bool oneBitMode) {
+    // The SDMMC host on the ESP32 uses fixed IO_MUX pins: CLK=14, CMD=15, D0=2,
+    // D1=4, D2=12, D3=13. 4-bit mode also needs GPIO4 (reed switch on this board)
+    // and GPIO12, a strapping pin that requires the flash voltage eFuse to be burned.
+    Serial.printf("FileManager: Trying SDMMC %s mode... ", oneBitMode ? "1-bit" : "4-bit");
+    
+    if (!SD_MMC.begin(SD_MOUNT_POINT, oneBitMode, false, SDMMC_FREQ_HIGHSPEED)) {
+        Serial.printf("failed\n");
+        SD_MMC.end();
+        return false;
+    }
+    if (SD_MMC.cardType() == CARD_NONE) {
+        Serial.printf("no card\n");
+        SD_MMC.end();
         return false;
     }
     
-    Serial.print("FileManager: SD card type: ");
-    switch (cardType) {
-        case CARD_MMC:
-            Serial.println("MMC");
+    Serial.printf("SUCCESS\n");
+    sdFs = &SD_MMC;
+    sdBusMode = oneBitMode ? SD_BUS_SDMMC_1BIT : SD_BUS_SDMMC_4BIT;
+    return true;
+}
+
+void FileManager::unmountSDCard() {
+    if (sdBusMode == SD_BUS_SPI) {
+        SD.end();
+    } else if (sdBusMode == SD_BUS_SDMMC_1BIT || sdBusMode == SD_BUS_SDMMC_4BIT) {
+        SD_MMC.end();
+    }
+    sdBusMode = SD_BUS_NONE;
+    sdFs = &SD;
+    sdCardInitialized = false;
+    clearEntryCache();
+}
+
+bool FileManager::remountSDCard(SdBusMode mode) {
+    if (downloadInProgress) {
+        Serial.println("FileManager: Cannot remount SD card while a download is in progress");
+        return false;
+    }
+    
+    unmountSDCard();
+    
+    bool mounted = false;
+    switch (mode) {
+        case SD_BUS_SPI:
+            mounted = mountSPI();
             break;
-        case CARD_SD:
-            Serial.println("SDSC");
+        case SD_BUS_SDMMC_1BIT:
+            mounted = mountSDMMC(true);
             break;
-        case CARD_SDHC:
-            Serial.println("SDHC");
+        case SD_BUS_SDMMC_4BIT:
+            mounted = mountSDMMC(false);
             break;
         default:
-            Serial.println("Unknown");
             break;
     }
     
-    // Print SD card size
-    uint64_t cardSize = SD.cardSize() / (1024 * 1024);
-    Serial.printf("FileManager: SD card size: %lluMB\n", cardSize);
+    if (!mounted) {
+        Serial.printf("FileManager: Remount in %s mode failed, restoring default bus\n", getBusModeName(mode));
+        return initializeSDCard();
+    }
     
     sdCardInitialized = true;
-    
-    // Create necessary directories
-    createDirectory("/audio");
-    createDirectory("/temp");
-    createDirectory("/logs");
-    createDirectory("/images");
-    createDirectory("/figures");
-    
+    Serial.printf("FileManager: SD card remounted in %s mode\n", getBusModeName(sdBusMode));
     return true;
 }
 
+const char* FileManager::getBusModeName(SdBusMode mode) {
+    switch (mode) {
+        case SD_BUS_SPI:
+            return "SPI";
+        case SD_BUS_SDMMC_1BIT:
+            return "SDMMC 1-bit";
+        case SD_BUS_SDMMC_4BIT:
+            return "SDMMC 4-bit";
+        default:
+            return "none";
+    }
+}
+
+uint8_t FileManager::sdCardType() {
+    return sdBusMode == SD_BUS_SPI ? SD.cardType() : SD_MMC.cardType();
+}
+
+uint64_t FileManager::sdCardSize() {
+    return sdBusMode == SD_BUS_SPI ? SD.cardSize() : SD_MMC.cardSize();
+}
+
+uint64_t FileManager::sdUsedBytes() {
+    return sdBusMode == SD_BUS_SPI ? SD.usedBytes() : SD_MMC.usedBytes();
+}
+
+uint64_t FileManager::reconcileSpace() {
+    uint64_t used = sdUsedBytes();
+    if (spaceKnown) {
+        lastSpaceDrift = (int64_t)used - (int64_t)spaceUsed;
+        if (lastSpaceDrift > SPACE_DRIFT_REPORT || lastSpaceDrift < -SPACE_DRIFT_REPORT) {
+            Serial.printf("FileManager: Space accounting was %lld bytes off, corrected\n", lastSpaceDrift);
+        }
+    }
+    spaceTotal = sdCardSize();
+    spaceUsed = used;
+    spaceKnown = true;
+    spaceReconcileDue = false;
+    lastSpaceReconcile = millis();
+    return used;
+}
+
+void FileManager::accountSpace(size_t oldSize, size_t newSize) {
+    // Whole clusters, which is what a file takes on FAT
+    uint64_t oldBytes = ((uint64_t)oldSize + SPACE_ALLOCATION_UNIT - 1) / SPACE_ALLOCATION_UNIT * SPACE_ALLOCATION_UNIT;
+    uint64_t newBytes = ((uint64_t)newSize + SPACE_ALLOCATION_UNIT - 1) / SPACE_ALLOCATION_UNIT * SPACE_ALLOCATION_UNIT;
+    if (newBytes >= oldBytes) {
+        spaceUsed += newBytes - oldBytes;
+    } else if (spaceUsed > oldBytes - newBytes) {
+        spaceUsed -= oldBytes - newBytes;
+    } else {
+        spaceUsed = 0;
+    }
+}
+
 bool FileManager::initializeNVS() {
     esp_err_t err = nvs_flash_init();
     if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -209,8 +412,108 @@ bool FileManager::checkConnectivity() {
         return false;
     }
     
-    // Check internet connectivity by pinging Google's DNS
-    return pingGoogle();
+    // The download itself is the best connectivity check, so as long as the last transfer
+    // did not fail on the network just try it. After a network failure, probe the internet
+    // at most once a minute and reuse the answer in between.
+    if (!lastTransferFailed) {
+        return true;
+    }
+    unsigned long now = millis();
+    if (lastProbeAt != 0 && now - lastProbeAt < CONNECTIVITY_PROBE_INTERVAL_MS) {
+        return lastProbeOk;
+    }
+    lastProbeAt = now;
+    lastProbeOk = pingGoogle();
+    return lastProbeOk;
+}
+
+unsigned long FileManager::retryDelayMs(int attempt) {
+    // attempt is 1 after the first failure
+    unsigned long delayMs = RETRY_BASE_DELAY_MS;
+    for (int i = 1; i < attempt && delayMs < RETRY_MAX_DELAY_MS; i++) {
+        delayMs *= 2;
+    }
+    if (delayMs > RETRY_MAX_DELAY_MS) {
+        delayMs = RETRY_MAX_DELAY_MS;
+    }
+    // Equal jitter: half fixed so retries still back off, half random to spread them out
+    return delayMs / 2 + random(delayMs / 2 + 1);
+}
+
+FileManager::HostCircuit* FileManager::findCircuit(const String& host) {
+    for (auto& circuit : hostCircuits) {
+        if (circuit.host == host) {
+            return &circuit;
+        }
+    }
+    return nullptr;
+}
+
+bool FileManager::circuitAllows(const String& host) {
+    HostCircuit* circuit = findCircuit(host);
+    if (circuit == nullptr || !circuit->open) {
+        return true;
+    }
+    // Half-open once the wait is over: the next download is the trial
+    return millis() - circuit->openedAt >= circuit->openMs;
+}
+
+void FileManager::recordHostResult(const String& host, bool success) {
+    HostCircuit* circuit = findCircuit(host);
+    if (success) {
+        if (circuit != nullptr) {
+            if (circuit->open) {
+                Serial.printf("FileManager: Circuit for %s closed, host recovered\n", host.c_str());
+            }
+            circuit->consecutiveFailures = 0;
+            circuit->trips = 0;
+            circuit->open = false;
+        }
+        return;
+    }
+    
+    if (circuit == nullptr) {
+        if (hostCircuits.size() >= MAX_HOST_CIRCUITS) {
+            // Forget a closed circuit to make room; open ones must keep protecting their host
+            for (auto it = hostCircuits.begin(); it != hostCircuits.end(); ++it) {
+                if (!it->open) {
+                    hostCircuits.erase(it);
+                    break;
+                }
+            }
+            if (hostCircuits.size() >= MAX_HOST_CIRCUITS) {
+                return;
+            }
+        }
+        HostCircuit fresh;
+        fresh.host = host;
+        fresh.consecutiveFailures = 0;
+        fresh.trips = 0;
+        fresh.open = false;
+        fresh.openedAt = 0;
+        fresh.openMs = 0;
+        hostCircuits.push_back(fresh);
+        circuit = &hostCircuits.back();
+    }
+    
+    if (circuit->consecutiveFailures < 255) {
+        circuit->consecutiveFailures++;
+    }
+    // A failed trial reopens straight away; otherwise open after enough failures in a row
+    if (circuit->open || circuit->consecutiveFailures >= CIRCUIT_FAILURE_THRESHOLD) {
+        unsigned long openMs = CIRCUIT_OPEN_MS;
+        for (int i = 0; i < circuit->trips && openMs < CIRCUIT_MAX_OPEN_MS; i++) {
+            openMs *= 2;
+        }
+        circuit->openMs = openMs < CIRCUIT_MAX_OPEN_MS ? openMs : CIRCUIT_MAX_OPEN_MS;
+        circuit->openedAt = millis();
+        circuit->open = true;
+        if (circuit->trips < 255) {
+            circuit->trips++;
+        }
+        Serial.printf("FileManager: Circuit for %s open for %lu s after %d failures\n",
+                      host.c_str(), circuit->openMs / 1000, circuit->consecutiveFailures);
+    }
 }
 
 bool FileManager::pingGoogle() {
@@ -266,16 +569,19 @@ void FileManager::update() {
         return;
     }
     
-    // Process download queue if conditions are met
-    if (!downloadInProgress && downloadQueue.size() > 0) {
+    // Process download queue if conditions are met; a transfer already running is
+    // stepped to the end either way
+    if (downloadInProgress) {
+        processDownloadQueue();
+    } else if (queuedDownloadCount() > 0) {
         if (isChargingRequired()) {
             processDownloadQueue();
         } else {
             // Add periodic debug message for blocked downloads
             static unsigned long lastChargingWarning = 0;
             if (millis() - lastChargingWarning > 30000) { // Every 30 seconds
-                Serial.printf("FileManager: %d downloads pending but device is not charging. Connect power to start downloads.\n", 
-                             downloadQueue.size());
+                Serial.printf("FileManager: %u downloads pending but device is not charging. Connect power to start downloads.\n", 
+                             queuedDownloadCount());
                 lastChargingWarning = millis();
             }
         }
@@ -287,6 +593,11 @@ void FileManager::update() {
         checkRequiredFiles();
         lastCheck = millis();
     }
+    
+    // Bring the space accounting back in line with the filesystem between downloads
+    if (!downloadInProgress && (spaceReconcileDue || millis() - lastSpaceReconcile > SPACE_RECONCILE_MS)) {
+        reconcileSpace();
+    }
 }
 
 bool FileManager::deleteFile(const String& path) {
@@ -294,7 +605,13 @@ bool FileManager::deleteFile(const String& path) {
         return false;
     }
     
-    bool success = SD.remove(path);
+    size_t size = getFileSize(path);
+    bool success = sdFs->remove(path);
+    if (success) {
+        rememberEntry(path, SD_ENTRY_MISSING);
+        accountSpace(size, 0);
+        noteTrackRemoved(path, size);
+    }
     
     if (fileSystemEventCallback) {
         fileSystemEventCallback("delete", path, success);
@@ -322,22 +639,17 @@ bool FileManager::deleteFileAndRemoveFromRequired(const String& path) {
     }
     
     // Check if path points to a directory
-    File fileOrDir = SD.open(path);
-    if (fileOrDir) {
-        if (fileOrDir.isDirectory()) {
-            fileOrDir.close();
-            Serial.printf("FileManager: Cannot delete directory with deleteFileAndRemoveFromRequired: %s\n", path.c_str());
-            Serial.println("FileManager: Use removeDirectory() for directories");
-            return false;
-        }
-        fileOrDir.close();
+    if (lookupEntry(path) == SD_ENTRY_DIRECTORY) {
+        Serial.printf("FileManager: Cannot delete directory with deleteFileAndRemoveFromRequired: %s\n", path.c_str());
+        Serial.println("FileManager: Use removeDirectory() for directories");
+        return false;
     }
     
     // Check if this file is in the required files list
     bool wasRequired = false;
     auto it = std::find_if(requiredFiles.begin(), requiredFiles.end(),
                           [&path](const FileEntry& entry) {
-                              return entry.path == path;
+                              return entry.matchesPath(path);
                           });
     
     if (it != requiredFiles.end()) {
@@ -347,16 +659,26 @@ bool FileManager::deleteFileAndRemoveFromRequired(const String& path) {
         saveRequiredFiles();
     }
     
-    // Remove from download queue if it's currently queued
+    // Remove from download queue if it's currently queued or downloading
     bool wasInQueue = false;
-    auto queueIt = downloadQueue.begin();
-    while (queueIt != downloadQueue.end()) {
-        if (queueIt->localPath == path) {
-            Serial.printf("FileManager: Removing from download queue: %s\n", path.c_str());
-            queueIt = downloadQueue.erase(queueIt);
-            wasInQueue = true;
-        } else {
-            ++queueIt;
+    if (downloadInProgress && session.task.localPath == path) {
+        abortDownload();
+        wasInQueue = true;
+    }
+    for (int priority = 0; priority < DOWNLOAD_PRIORITY_COUNT; priority++) {
+        std::deque<DownloadTask>& queue = downloadQueues[priority];
+        auto queueIt = queue.begin();
+        while (queueIt != queue.end()) {
+            if (queueIt->localPath == path) {
+                Serial.printf("FileManager: Removing from download queue: %s\n", path.c_str());
+                if (queueIt->resumeOffset > 0) {
+                    deleteFile(path + ".tmp");
+                }
+                queueIt = queue.erase(queueIt);
+                wasInQueue = true;
+            } else {
+                ++queueIt;
+            }
         }
     }
     
@@ -364,8 +686,16 @@ bool FileManager::deleteFileAndRemoveFromRequired(const String& path) {
         saveDownloadQueue();
     }
     
-    // Attempt to delete the file
-    bool success = SD.remove(path);
+    // Attempt to delete the file; one that never finished downloading only had
+    // metadata to drop
+    bool onCard = lookupEntry(path) != SD_ENTRY_MISSING;
+    size_t size = onCard ? getFileSize(path) : 0;
+    bool success = onCard ? sdFs->remove(path) : (wasRequired || wasInQueue);
+    if (success) {
+        rememberEntry(path, SD_ENTRY_MISSING);
+        accountSpace(size, 0);
+        noteTrackRemoved(path, size);
+    }
     
     if (fileSystemEventCallback) {
         fileSystemEventCallback("delete_smart", path, success);
@@ -399,19 +729,18 @@ bool FileManager::createDirectory(const String& path) {
         return false;
     }
     
-    bool success = SD.mkdir(path);
+    bool success = sdFs->mkdir(path);
     
     if (fileSystemEventCallback) {
         fileSystemEventCallback("mkdir", path, success);
     }
     
     if (success) {
+        rememberEntry(path, SD_ENTRY_DIRECTORY);
         Serial.printf("FileManager: Directory created successfully: %s\n", path.c_str());
     } else {
         // Directory might already exist, check if it exists
-        File dir = SD.open(path);
-        if (dir && dir.isDirectory()) {
-            dir.close();
+        if (lookupEntry(path) == SD_ENTRY_DIRECTORY) {
             return true; // Directory already exists
         }
         Serial.printf("FileManager: Failed to create directory: %s\n", path.c_str());
@@ -425,12 +754,57 @@ bool FileManager::fileExists(const String& path) {
         return false;
     }
     
-    File file = SD.open(path);
-    if (file) {
-        file.close();
-        return true;
+    return lookupEntry(path) != SD_ENTRY_MISSING;
+}
+
+File FileManager::openFile(const String& path, const char* mode) {
+    if (!sdCardInitialized) {
+        return File();
+    }
+    
+    bool reading = strcmp(mode, FILE_READ) == 0;
+    if (reading && lookupEntry(path) == SD_ENTRY_MISSING) {
+        return File();
+    }
+    
+    File file = sdFs->open(path, mode);
+    if (file && !reading) {
+        rememberEntry(path, SD_ENTRY_FILE);
+        spaceReconcileDue = true; // Written through the caller's handle, size unknown here
+    }
+    return file;
+}
+
+bool FileManager::replaceFile(const String& tempPath, const String& path) {
+    if (!sdCardInitialized) {
+        return false;
+    }
+    
+    // FAT rename does not overwrite, so the old copy has to go first
+    if (lookupEntry(path) != SD_ENTRY_MISSING) {
+        size_t oldSize = getFileSize(path);
+        if (sdFs->remove(path)) {
+            accountSpace(oldSize, 0);
+            noteTrackRemoved(path, oldSize); // The new copy is added by whoever wrote it
+        }
+        rememberEntry(path, SD_ENTRY_MISSING);
+    }
+    
+    if (!sdFs->rename(tempPath, path)) {
+        Serial.printf("FileManager: Failed to move %s to %s\n", tempPath.c_str(), path.c_str());
+        return false;
+    }
+    
+    rememberEntry(tempPath, SD_ENTRY_MISSING);
+    rememberEntry(path, SD_ENTRY_FILE);
+    return true;
+}
+
+void FileManager::noteTrackRemoved(const String& path, size_t size) {
+    TrackId track;
+    if (size > 0 && TrackId::fromPath(path, track)) {
+        StorageManager::getInstance().onFileRemoved(track.figure, size);
     }
-    return false;
 }
 
 std::vector<String> FileManager::listFiles(const String& directory) {
@@ -440,15 +814,24 @@ std::vector<String> FileManager::listFiles(const String& directory) {
         return files;
     }
     
-    File dir = SD.open(directory);
+    File dir = sdFs->open(directory);
     if (!dir || !dir.isDirectory()) {
         Serial.printf("FileManager: Failed to open directory: %s\n", directory.c_str());
         return files;
     }
     
+    rememberEntry(directory, SD_ENTRY_DIRECTORY);
+    
+    // The listing is free metadata, use it to warm the entry cache
+    String childPrefix = directory;
+    if (!childPrefix.endsWith("/")) {
+        childPrefix += "/";
+    }
+    
     File file = dir.openNextFile();
     while (file) {
         String fileName = file.name();
+        rememberEntry(childPrefix + fileName, file.isDirectory() ? SD_ENTRY_DIRECTORY : SD_ENTRY_FILE);
         if (file.isDirectory()) {
             fileName += "/";
         }
@@ -460,37 +843,154 @@ std::vector<String> FileManager::listFiles(const String& directory) {
     return files;
 }
 
-bool FileManager::scheduleDownload(const String& url, const String& localPath, const String& checksum) {
-    // Check if already in queue
-    for (const auto& task : downloadQueue) {
-        if (task.url == url && task.localPath == localPath) {
-            Serial.println("FileManager: Download already scheduled");
+// SD entry cache implementation
+uint32_t FileManager::hashPath(const char* path, size_t length) {
+    // FNV-1a, good enough spread for short slash-separated paths
+    uint32_t hash = 2166136261UL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)path[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+uint32_t FileManager::checkPath(const char* path, size_t length) {
+    // djb2 (xor variant) from the far end, unrelated to hashPath() so their collisions are too
+    uint32_t hash = 5381;
+    for (size_t i = length; i > 0; i--) {
+        hash = (hash * 33) ^ (uint8_t)path[i - 1];
+    }
+    return hash;
+}
+
+bool FileManager::sdEntryLess(const SdEntryCacheItem& a, const SdEntryCacheItem& b) {
+    if (a.hash != b.hash) {
+        return a.hash < b.hash;
+    }
+    return a.length != b.length ? a.length < b.length : a.check < b.check;
+}
+
+FileManager::SdEntryState FileManager::lookupEntry(const String& path) {
+    SdEntryCacheItem key;
+    key.hash = hashPath(path.c_str(), path.length());
+    key.check = checkPath(path.c_str(), path.length());
+    key.length = (uint16_t)path.length();
+    key.state = SD_ENTRY_MISSING;
+    
+    std::vector<SdEntryCacheItem>::iterator it = std::lower_bound(
+        sdEntryCache.begin(), sdEntryCache.end(), key,
+        sdEntryLess);
+    if (it != sdEntryCache.end() && it->hash == key.hash && it->length == key.length && it->check == key.check) {
+        sdCacheStats.hits++;
+        return (SdEntryState)it->state;
+    }
+    
+    sdCacheStats.misses++;
+    SdEntryState state = SD_ENTRY_MISSING;
+    File entry = sdFs->open(path);
+    if (entry) {
+        state = entry.isDirectory() ? SD_ENTRY_DIRECTORY : SD_ENTRY_FILE;
+        entry.close();
+    }
+    rememberEntry(path, state);
+    return state;
+}
+
+void FileManager::rememberEntry(const String& path, SdEntryState state) {
+    SdEntryCacheItem item;
+    item.hash = hashPath(path.c_str(), path.length());
+    item.check = checkPath(path.c_str(), path.length());
+    item.length = (uint16_t)path.length();
+    item.state = state;
+    
+    std::vector<SdEntryCacheItem>::iterator it = std::lower_bound(
+        sdEntryCache.begin(), sdEntryCache.end(), item,
+        sdEntryLess);
+    if (it != sdEntryCache.end() && it->hash == item.hash && it->length == item.length && it->check == item.check) {
+        it->state = state;
+        return;
+    }
+    
+    if (sdEntryCache.size() >= SD_ENTRY_CACHE_MAX) {
+        // Start over rather than track recency; the working set refills in a few lookups
+        clearEntryCache();
+        sdCacheStats.flushes++;
+        sdEntryCache.push_back(item);
+        return;
+    }
+    sdEntryCache.insert(it, item);
+}
+
+void FileManager::clearEntryCache() {
+    sdEntryCache.clear();
+}
+
+bool FileManager::scheduleDownload(const String& url, const String& localPath, const String& checksum,
+                                   DownloadPriority priority) {
+    // A blob is named by its content, so another track's URL for it fetches the same bytes
+    uint64_t blobKey;
+    bool sameContent = BlobStore::keyFromPath(localPath.c_str(), blobKey);
+    if (downloadInProgress && session.task.localPath == localPath) {
+        if (session.task.url == url || sameContent) {
+            Serial.println("FileManager: Download already in progress");
+            promoteDownload(localPath, priority);
             return true;
         }
+        // The content moved to a new URL, what has been fetched so far is stale
+        abortDownload();
+    }
+    
+    // Check if already in queue
+    for (int p = 0; p < DOWNLOAD_PRIORITY_COUNT; p++) {
+        std::deque<DownloadTask>& queue = downloadQueues[p];
+        for (auto it = queue.begin(); it != queue.end(); ++it) {
+            if (it->localPath != localPath) {
+                continue;
+            }
+            if (it->url == url || sameContent) {
+                Serial.println("FileManager: Download already scheduled");
+                promoteDownload(localPath, priority);
+                return true;
+            }
+            if (it->resumeOffset > 0) {
+                deleteFile(localPath + ".tmp");
+            }
+            queue.erase(it);
+            break;
+        }
     }
     
-    addToDownloadQueue(url, localPath, checksum);
+    addToDownloadQueue(url, localPath, checksum, priority);
     saveDownloadQueue();
     
     Serial.printf("FileManager: Download scheduled: %s -> %s\n", url.c_str(), localPath.c_str());
     return true;
 }
 
-void FileManager::addToDownloadQueue(const String& url, const String& localPath, const String& checksum) {
+String FileManager::hostOf(const String& url) {
+    String host, path;
+    uint16_t port;
+    bool secure;
+    return ConnectionManager::parseUrl(url, secure, host, port, path) ? host : String();
+}
+
+void FileManager::addToDownloadQueue(const String& url, const String& localPath, const String& checksum, DownloadPriority priority) {
     DownloadTask task;
     task.url = url;
+    task.host = hostOf(url);
     task.localPath = localPath;
     task.checksum = checksum;
     task.retryCount = 0;
-    task.retryBatch = 0;
     task.completed = false;
     task.lastAttempt = 0;
-    task.lastBatchAttempt = 0;
+    task.nextAttemptAt = 0;
+    task.priority = priority;
+    task.resumeOffset = 0;
     
-    downloadQueue.push_back(task);
+    downloadQueues[priority].push_back(task);
 }
 
-bool FileManager::downloadFileFromURL(const String& url, const String& localPath, String& errorMsg) {
+bool FileManager::startDownload(DownloadTask& task, String& errorMsg) {
     if (downloadInProgress) {
         errorMsg = "Another download is in progress";
         return false;
@@ -501,277 +1001,689 @@ bool FileManager::downloadFileFromURL(const String& url, const String& localPath
         return false;
     }
     
-    downloadInProgress = true;
-    
-    // Convert HTTPS to HTTP to reduce memory usage
-    String httpUrl = url;
-    if (httpUrl.startsWith("https://")) {
-        httpUrl.replace("https://", "http://");
-        Serial.printf("FileManager: Converted HTTPS to HTTP for memory efficiency\n");
-    }
+    lastDownloadFailure = DOWNLOAD_FAILED_LOCAL;
+    const String& url = task.url;
+    const String& localPath = task.localPath;
     
-    Serial.printf("FileManager: Starting download: %s -> %s\n", httpUrl.c_str(), localPath.c_str());
+    Serial.printf("FileManager: Starting download: %s -> %s\n", url.c_str(), localPath.c_str());
     
-    // Parse URL to extract hostname and path
+    // Parse URL to extract hostname and path, HTTPS stays on TLS
     String hostname, path;
-    int port = 80;
-    
-    if (httpUrl.startsWith("http://")) {
-        int hostStart = 7; // Length of "http://"
-        int pathStart = httpUrl.indexOf('/', hostStart);
-        
-        if (pathStart == -1) {
-            hostname = httpUrl.substring(hostStart);
-            path = "/";
-        } else {
-            hostname = httpUrl.substring(hostStart, pathStart);
-            path = httpUrl.substring(pathStart);
-        }
-        
-        // Check for port in hostname
-        int portIndex = hostname.indexOf(':');
-        if (portIndex != -1) {
-            port = hostname.substring(portIndex + 1).toInt();
-            hostname = hostname.substring(0, portIndex);
-        }
-    } else {
-        errorMsg = "Invalid URL format (must start with http://)";
-        downloadInProgress = false;
+    uint16_t port;
+    bool secure;
+    if (!ConnectionManager::parseUrl(url, secure, hostname, port, path)) {
+        errorMsg = "Invalid URL format (must start with http:// or https://)";
         return false;
     }
     
-    Serial.printf("FileManager: Connecting to %s:%d, path: %s\n", hostname.c_str(), port, path.c_str());
+    Serial.printf("FileManager: Connecting to %s:%u (%s), path: %s\n", hostname.c_str(), port, secure ? "TLS" : "plain", path.c_str());
     
     // Create directory structure with verification
     if (!createDirectoryStructure(localPath)) {
         errorMsg = "Failed to create directory structure";
-        downloadInProgress = false;
         return false;
     }
     
     // Verify directory exists before proceeding
     String dir = getDirectoryFromPath(localPath);
-    File dirFile = SD.open(dir);
-    if (!dirFile || !dirFile.isDirectory()) {
+    if (lookupEntry(dir) != SD_ENTRY_DIRECTORY) {
         errorMsg = "Directory creation failed or not accessible: " + dir;
-        if (dirFile) dirFile.close();
-        downloadInProgress = false;
         return false;
     }
-    dirFile.close();
     
     // Create temporary file
     String tempPath = localPath + ".tmp";
     
-    // Remove any existing temp file
-    if (SD.exists(tempPath)) {
-        SD.remove(tempPath);
+    // A suspended attempt left its bytes in the temp file; pick up from there if it is
+    // still at least that long (pre-allocation makes it longer), otherwise start over
+    size_t resumeFrom = 0;
+    size_t existingSize = 0;
+    if (task.resumeOffset > 0) {
+        File partial = sdFs->open(tempPath);
+        if (partial) {
+            existingSize = partial.size();
+            partial.close();
+        }
+        if (existingSize >= task.resumeOffset) {
+            resumeFrom = task.resumeOffset;
+        }
+    }
+    if (resumeFrom == 0 && sdFs->exists(tempPath)) {
+        sdFs->remove(tempPath);
+        task.resumeOffset = 0;
+        spaceReconcileDue = true;
     }
     
-    // Create WiFi client and connect
-    WiFiClient client;
+    // Get a connected client from the shared connection manager
+    ConnectionManager& connections = ConnectionManager::getInstance();
+    bool reused;
+    WiFiClient* stream = connections.openStream(hostname, port, secure, errorMsg, &reused);
+    if (!stream) {
+        lastDownloadFailure = DOWNLOAD_FAILED_NETWORK;
+        return false;
+    }
+    WiFiClient& client = *stream;
+    tuneDownloadSocket(client);
     // WiFiClient setTimeout takes uint16_t in milliseconds, max ~65 seconds
     // We'll handle timeout manually using millis() for longer timeouts
     client.setTimeout(30000); // 30 seconds for connection operations
     
-    if (!client.connect(hostname.c_str(), port)) {
-        errorMsg = "Failed to connect to server: " + hostname;
-        downloadInProgress = false;
-        return false;
-    }
+    // Compression only for fresh downloads: a resumed range has to be of the identity
+    // bytes already on the card. Without Accept-Encoding a server may pick any coding.
+    bool acceptCompressed = resumeFrom == 0 &&
+                            ConfigManager::getInstance().getInt("download_compression", 0) &&
+                            heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) >= TINFL_LZ_DICT_SIZE &&
+                            heap_caps_get_free_size(MALLOC_CAP_8BIT) >= StreamInflater::MEMORY_NEEDED + INFLATE_HEAP_RESERVE;
     
-    // Send HTTP GET request
+    // Send HTTP GET request; the parser knows where the body ends, so the connection
+    // can go back to the pool afterwards
     String request = "GET " + path + " HTTP/1.1\r\n";
-    request += "Host: " + hostname + "\r\n";
-    request += "Connection: close\r\n";
+    request += "Host: " + hostname;
+    if (port != (secure ? 443 : 80)) {
+        request += ":" + String(port); // The authority names the port unless it is the scheme's default
+    }
+    request += "\r\n";
+    if (resumeFrom > 0) {
+        request += "Range: bytes=" + String(resumeFrom) + "-\r\n";
+    }
+    request += acceptCompressed ? "Accept-Encoding: gzip, deflate\r\n" : "Accept-Encoding: identity\r\n";
     request += "User-Agent: ESP32-FileManager/1.0\r\n";
     request += "\r\n";
     
     client.print(request);
-    Serial.printf("FileManager: HTTP request sent\n");
-    
-    // Read response headers
-    unsigned long startTime = millis();
-    bool headersDone = false;
-    String responseHeaders = "";
-    int contentLength = -1;
-    int httpCode = 0;
-    
-    while (client.connected() && (millis() - startTime < DOWNLOAD_TIMEOUT_MS) && !headersDone) {
-        if (client.available()) {
-            String line = client.readStringUntil('\n');
-            line.trim();
-            
-            if (line.length() == 0) {
-                headersDone = true;
-                break;
-            }
-            
-            // Parse HTTP status code
-            if (line.startsWith("HTTP/")) {
-                int spaceIndex = line.indexOf(' ');
-                if (spaceIndex != -1) {
-                    httpCode = line.substring(spaceIndex + 1, spaceIndex + 4).toInt();
+    Serial.printf("FileManager: HTTP request sent%s\n", resumeFrom > 0 ? " (resuming)" : "");
+    
+    // The response is read a slice at a time from stepDownload() like the body, so a
+    // slow server does not hold the loop; beginBody() takes over once the headers are in
+    session.task = task;
+    session.client = &client;
+    session.reusedSocket = reused;
+    session.request = request;
+    session.file = File();
+    session.tempPath = tempPath;
+    session.bufferSize = 0;
+    session.staged = 0;
+    session.contentLength = -1;
+    session.transferLength = -1;
+    session.totalDownloaded = resumeFrom;
+    session.writeFailed = false;
+    session.resumedFrom = resumeFrom;
+    session.allocatedSize = resumeFrom > 0 ? existingSize : 0;
+    session.targetFigure = 0;
+    session.ttfbMs = -1;
+    session.awaitingHeaders = true;
+    session.http.reset();
+    session.startTime = millis();
+    session.lastDataTime = session.startTime;
+    session.windowStart = session.startTime;
+    session.windowBytes = 0;
+    session.windowBps = 0;
+    session.lastProgress = 0;
+    downloadInProgress = true;
+    publishProgress();
+    return true;
+}
+
+FileManager::DownloadStep FileManager::stepHeaders(String& errorMsg) {
+    DownloadSession& s = session;
+    WiFiClient& client = *s.client;
+    HttpResponseParser& http = s.http;
+    uint8_t headerBuffer[HEADER_READ_SIZE];
+    unsigned long sliceStart = millis();
+    
+    while (millis() - sliceStart < DOWNLOAD_SLICE_MS) {
+        size_t availableData = client.available();
+        bool staleSocket = s.reusedSocket && s.ttfbMs < 0; // A failure now is the pool's, not the network's
+        if (availableData == 0) {
+            if (!client.connected()) {
+                if (staleSocket) {
+                    return reopenDownloadStream(errorMsg) ? DOWNLOAD_STEP_RUNNING : DOWNLOAD_STEP_FAILED;
                 }
+                errorMsg = "Connection closed before the response headers";
+                lastDownloadFailure = DOWNLOAD_FAILED_NETWORK;
+                return DOWNLOAD_STEP_FAILED;
             }
-            
-            // Parse Content-Length
-            if (line.startsWith("Content-Length:") || line.startsWith("content-length:")) {
-                int colonIndex = line.indexOf(':');
-                if (colonIndex != -1) {
-                    contentLength = line.substring(colonIndex + 1).toInt();
+            if ((millis() - s.lastDataTime) > DOWNLOAD_NO_DATA_TIMEOUT_MS) {
+                if (staleSocket) {
+                    return reopenDownloadStream(errorMsg) ? DOWNLOAD_STEP_RUNNING : DOWNLOAD_STEP_FAILED;
                 }
+                Serial.printf("FileManager: No response for %lu seconds, timing out\n", DOWNLOAD_NO_DATA_TIMEOUT_MS / 1000);
+                errorMsg = "No response received for " + String(DOWNLOAD_NO_DATA_TIMEOUT_MS / 1000) + " seconds";
+                lastDownloadFailure = DOWNLOAD_FAILED_NETWORK;
+                return DOWNLOAD_STEP_FAILED;
             }
-            
-            Serial.printf("Header: %s\n", line.c_str());
+            downloadRate.idleWaits++;
+            return DOWNLOAD_STEP_RUNNING;
         }
-        delay(1);
-    }
-    
-    if (!headersDone) {
-        errorMsg = "Failed to read HTTP headers";
-        client.stop();
-        downloadInProgress = false;
-        return false;
-    }
-    
-    if (httpCode != 200) {
-        errorMsg = "HTTP error: " + String(httpCode);
-        client.stop();
-        downloadInProgress = false;
+        
+        int readBytes = client.read(headerBuffer, min(availableData, sizeof(headerBuffer)));
+        if (readBytes <= 0 && staleSocket) {
+            return reopenDownloadStream(errorMsg) ? DOWNLOAD_STEP_RUNNING : DOWNLOAD_STEP_FAILED;
+        }
+        s.lastDataTime = millis();
+        if (s.ttfbMs < 0) {
+            s.ttfbMs = s.lastDataTime - s.startTime; // Roughly one RTT plus server time
+        }
+        if (readBytes <= 0) {
+            errorMsg = "Failed to read HTTP headers";
+            lastDownloadFailure = DOWNLOAD_FAILED_NETWORK;
+            return DOWNLOAD_STEP_FAILED;
+        }
+        size_t used = http.parseHeaders(headerBuffer, readBytes);
+        if (http.failed()) {
+            errorMsg = "Malformed HTTP response: " + String(http.getError());
+            lastDownloadFailure = DOWNLOAD_FAILED_SERVER;
+            return DOWNLOAD_STEP_FAILED;
+        }
+        if (http.headersComplete()) {
+            // A read may run into the body, those bytes are handed on once the file is open
+            s.awaitingHeaders = false;
+            s.request = String();
+            if (!beginBody(headerBuffer + used, readBytes - used, errorMsg)) {
+                return DOWNLOAD_STEP_FAILED;
+            }
+            return DOWNLOAD_STEP_RUNNING;
+        }
+    }
+    return DOWNLOAD_STEP_RUNNING;
+}
+
+bool FileManager::reopenDownloadStream(String& errorMsg) {
+    // The server may close a keep-alive socket while it idles in the pool, which shows
+    // only once the request gets no answer; the request goes once more on a new
+    // connection, and only a failure there counts against the host
+    DownloadSession& s = session;
+    ConnectionManager& connections = ConnectionManager::getInstance();
+    connections.closeStream(s.client, false);
+    s.client = nullptr;
+    s.reusedSocket = false;
+    Serial.println("FileManager: Pooled connection went stale, resending on a new one");
+    
+    String host, path;
+    uint16_t port;
+    bool secure;
+    ConnectionManager::parseUrl(s.task.url, secure, host, port, path);
+    WiFiClient* stream = connections.openStream(host, port, secure, errorMsg, nullptr, true);
+    if (!stream) {
+        lastDownloadFailure = DOWNLOAD_FAILED_NETWORK;
         return false;
     }
-    
-    Serial.printf("FileManager: HTTP 200 OK, Content-Length: %d\n", contentLength);
-    
-    // Check available space
-    size_t freeSpace = getSDCardFreeSpace();
-    if (contentLength > 0 && (size_t)contentLength > freeSpace) {
+    tuneDownloadSocket(*stream);
+    stream->setTimeout(30000);
+    stream->print(s.request);
+    s.client = stream;
+    s.startTime = millis();
+    s.lastDataTime = s.startTime;
+    return true;
+}
+
+bool FileManager::beginBody(const uint8_t* earlyBody, size_t earlyBodyBytes, String& errorMsg) {
+    // Failures leave the stream, the file and the buffers to closeSession(); a partial
+    // from an earlier attempt stays unless the response makes it useless
+    DownloadSession& s = session;
+    DownloadTask& task = s.task;
+    const String& localPath = task.localPath;
+    const String& tempPath = s.tempPath;
+    HttpResponseParser& http = s.http;
+    size_t resumeFrom = s.resumedFrom;
+    size_t existingSize = s.allocatedSize;
+    
+    int httpCode = http.getStatusCode();
+    long bodyLength = http.getContentLength();
+    HttpResponseParser::ContentEncoding encoding = http.getContentEncoding();
+    int contentLength = -1;
+    Serial.printf("FileManager: HTTP %d, body %ld bytes%s, %s\n", httpCode, bodyLength,
+                  http.isChunked() ? " (chunked)" : "", HttpResponseParser::encodingName(encoding));
+    
+    // A server that ignores the range sends the whole file again
+    if (resumeFrom > 0 && httpCode == 200) {
+        Serial.println("FileManager: Server ignored the range request, starting over");
+        sdFs->remove(tempPath);
+        accountSpace(existingSize, 0);
+        resumeFrom = 0;
+        s.resumedFrom = 0;
+        s.totalDownloaded = 0;
+        s.allocatedSize = 0;
+    }
+    
+    if (httpCode == 206 && resumeFrom > 0 && http.getRangeStart() == (long)resumeFrom &&
+        encoding == HttpResponseParser::ENCODING_IDENTITY) {
+        Serial.printf("FileManager: HTTP 206, resuming at %u bytes\n", resumeFrom);
+        if (bodyLength >= 0) {
+            contentLength = bodyLength + resumeFrom;
+        } else if (http.getRangeTotal() > 0) {
+            contentLength = http.getRangeTotal();
+        }
+    } else if (httpCode != 200) {
+        errorMsg = "HTTP error: " + String(httpCode);
+        if (httpCode >= 500 || httpCode == 429) {
+            lastDownloadFailure = DOWNLOAD_FAILED_SERVER;
+        } else {
+            lastDownloadFailure = DOWNLOAD_FAILED_REJECTED;
+        }
+        // 206 for the wrong range or 416: the partial file is no use any more
+        if (resumeFrom > 0 && (httpCode == 206 || httpCode == 416)) {
+            sdFs->remove(tempPath);
+            accountSpace(existingSize, 0);
+            s.resumedFrom = 0;
+            s.totalDownloaded = 0;
+            s.allocatedSize = 0;
+        }
+        return false;
+    } else if (encoding == HttpResponseParser::ENCODING_UNSUPPORTED) {
+        errorMsg = "Unsupported Content-Encoding";
+        lastDownloadFailure = DOWNLOAD_FAILED_REJECTED;
+        return false;
+    } else if (encoding == HttpResponseParser::ENCODING_IDENTITY) {
+        contentLength = bodyLength; // Compressed bodies say nothing about the size on the card
+    }
+    
+    // Check available space, evicting least recently docked figures if allowed
+    StorageManager& storage = StorageManager::getInstance();
+    TrackId targetTrack;
+    uint32_t targetFigure = TrackId::fromPath(localPath, targetTrack) ? targetTrack.figure : 0;
+    // A blob belongs to no figure and its bytes are counted by BlobStore, but when the
+    // docked figure needs it, it may evict like that figure's own tracks
+    uint32_t evictFor = targetFigure;
+    uint64_t blobKey;
+    if (targetFigure == 0 && task.priority <= DOWNLOAD_PRIORITY_DOCKED &&
+        BlobStore::keyFromPath(localPath.c_str(), blobKey) &&
+        BlobStore::getInstance().isUsedBy(storage.getDockedFigure(), blobKey)) {
+        evictFor = storage.getDockedFigure();
+    }
+    // A compressed body's length is only a lower bound on what it will take
+    long spaceNeeded = contentLength > 0 ? contentLength - (long)resumeFrom : bodyLength;
+    if (spaceNeeded > 0 && !storage.ensureSpace(spaceNeeded, evictFor)) {
         errorMsg = "Insufficient SD card space";
-        client.stop();
-        downloadInProgress = false;
         return false;
     }
     
-    File file = SD.open(tempPath, FILE_WRITE);
+    // A resumed file is written in place, so a pre-allocated run stays contiguous
+    File file = resumeFrom > 0 ? sdFs->open(tempPath, "r+") : sdFs->open(tempPath, FILE_WRITE);
+    if (file && resumeFrom > 0 && !file.seek(resumeFrom, SeekSet)) {
+        file.close();
+        file = File();
+    }
     if (!file) {
         errorMsg = "Failed to create temporary file: " + tempPath;
-        client.stop();
-        downloadInProgress = false;
+        sdFs->remove(tempPath);
+        spaceReconcileDue = true;
+        s.resumedFrom = 0;
+        s.totalDownloaded = 0;
+        s.allocatedSize = 0;
         return false;
     }
+    s.file = file;
+    rememberEntry(tempPath, SD_ENTRY_FILE);
+    logCommitIntent(localPath, COMMIT_WRITING, 0);
     
-    uint8_t* buffer = (uint8_t*)malloc(DOWNLOAD_BUFFER_SIZE);
+    // Reserve the whole cluster chain up front so the file lands in one contiguous run
+    // instead of growing cluster by cluster between network reads
+    if (contentLength > 0 && resumeFrom == 0) {
+        if (preallocateFile(s.file, contentLength)) {
+            s.allocatedSize = contentLength;
+            accountSpace(0, s.allocatedSize);
+        } else {
+            Serial.println("FileManager: Pre-allocation failed, falling back to incremental writes");
+        }
+    }
+    
+    // 4-byte aligned so the SD driver can DMA straight from it. Room for the largest
+    // chunk if the heap allows, the chunk actually used follows the measured rate.
+    size_t bufferSize = MAX_DOWNLOAD_CHUNK_SIZE;
+    uint8_t* buffer = nullptr;
+    while (!buffer && bufferSize >= DOWNLOAD_BUFFER_SIZE) {
+        buffer = (uint8_t*)heap_caps_malloc(bufferSize, MALLOC_CAP_8BIT | MALLOC_CAP_32BIT);
+        if (!buffer) {
+            bufferSize /= 2;
+        }
+    }
     if (!buffer) {
         errorMsg = "Failed to allocate download buffer";
-        file.close();
-        client.stop();
-        downloadInProgress = false;
         return false;
     }
+    s.buffer = buffer;
+    s.bufferSize = bufferSize;
     
-    int totalDownloaded = 0;
-    unsigned long lastProgress = 0;
-    bool downloadSuccess = true;
+    // Compressed bodies are read into a wire buffer and inflated into the chunk buffer
+    if (encoding != HttpResponseParser::ENCODING_IDENTITY) {
+        StreamInflater::Format format = encoding == HttpResponseParser::ENCODING_GZIP ?
+                                        StreamInflater::FORMAT_GZIP : StreamInflater::FORMAT_DEFLATE;
+        s.wireBuffer = (uint8_t*)malloc(DOWNLOAD_BUFFER_SIZE);
+        if (!s.wireBuffer || !s.inflater.begin(format)) {
+            errorMsg = "Not enough memory to decompress the download";
+            return false;
+        }
+    }
     
-    // Download the file content
-    startTime = millis(); // Reset timer for download phase
-    unsigned long lastDataTime = millis(); // Track when we last received data
-    const unsigned long NO_DATA_TIMEOUT = 10000; // 10 seconds without data = timeout
+    task.resumeOffset = 0;
+    s.chunkSize = chunkSizeForRate(downloadRate.avgKBps, bufferSize);
+    s.nextChunkSize = s.chunkSize;
+    s.contentLength = contentLength;
+    s.transferLength = bodyLength >= 0 ? bodyLength + resumeFrom : -1;
+    s.targetFigure = targetFigure;
+    s.startTime = millis();
+    s.lastDataTime = s.startTime;
+    s.windowStart = s.startTime;
+    s.lastProgress = (s.transferLength > 0) ? (resumeFrom * 100) / s.transferLength : 0;
+    
+    // Body bytes that arrived together with the headers
+    if (earlyBodyBytes > 0) {
+        uint8_t* target = s.wireBuffer ? s.wireBuffer : s.buffer;
+        memcpy(target, earlyBody, earlyBodyBytes);
+        s.windowBytes += earlyBodyBytes;
+        if (!takeBody(target, earlyBodyBytes, errorMsg)) {
+            return false;
+        }
+    }
+    publishProgress();
+    return true;
+}
+
+FileManager::DownloadStep FileManager::stepDownload(String& errorMsg) {
+    DownloadSession& s = session;
+    if (s.awaitingHeaders) {
+        return stepHeaders(errorMsg);
+    }
+    WiFiClient& client = *s.client;
+    unsigned long sliceStart = millis();
     
-    while (downloadSuccess && (millis() - startTime < DOWNLOAD_TIMEOUT_MS)) {
+    while (millis() - sliceStart < DOWNLOAD_SLICE_MS) {
+        if (s.http.done()) {
+            return DOWNLOAD_STEP_DONE;
+        }
+        
         size_t availableData = client.available();
         
-        if (availableData > 0) {
-            lastDataTime = millis(); // Reset no-data timer
-            size_t bytesToRead = min(availableData, (size_t)DOWNLOAD_BUFFER_SIZE);
-            int readBytes = client.readBytes(buffer, bytesToRead);
-            
-            if (readBytes > 0) {
-                size_t written = file.write(buffer, readBytes);
-                if (written != readBytes) {
-                    errorMsg = "Failed to write to file";
-                    downloadSuccess = false;
-                    break;
-                }
-                totalDownloaded += readBytes;
-                
-                if (contentLength > 0) {
-                    int progress = (totalDownloaded * 100) / contentLength;
-                    
-                    // Report progress every 5%
-                    if (progress >= lastProgress + 5) {
-                        lastProgress = progress;
-                        Serial.printf("FileManager: Download progress: %d%% (%d/%d bytes)\n", 
-                                    progress, totalDownloaded, contentLength);
-                        
-                        if (downloadProgressCallback) {
-                            downloadProgressCallback(httpUrl, localPath, progress, totalDownloaded, contentLength);
-                        }
-                    }
-                }
-                
-                // Check if we have all expected data
-                if (contentLength > 0 && totalDownloaded >= contentLength) {
-                    Serial.println("FileManager: Expected data received, checking for remaining bytes...");
-                    
-                    // Wait a bit more to ensure no more data is coming
-                    unsigned long drainStart = millis();
-                    while ((millis() - drainStart) < 2000 && client.connected()) { // Wait up to 2 seconds
-                        if (client.available() > 0) {
-                            Serial.printf("FileManager: Found %d more bytes after expected completion\n", client.available());
-                            break; // More data available, continue main loop
-                        }
-                        delay(50);
-                    }
-                    
-                    // If no more data after waiting, we're truly done
-                    if (client.available() == 0) {
-                        break;
-                    }
-                }
-            }
-        } else {
-            // No data available right now
+        if (availableData == 0) {
             if (!client.connected()) {
-                // Connection closed
-                if (contentLength > 0 && totalDownloaded < contentLength) {
+                // Only a body without length or chunking ends at the close
+                if (!s.http.endsAtClose()) {
                     Serial.printf("FileManager: Connection closed with %d/%d bytes received\n", 
-                                 totalDownloaded, contentLength);
+                                 (int)(s.resumedFrom + s.http.getBodyBytes()), s.transferLength);
                     errorMsg = "Connection lost before download completed";
-                    downloadSuccess = false;
-                } else {
-                    // Connection closed normally
-                    Serial.println("FileManager: Connection closed normally");
-                    break;
+                    lastDownloadFailure = DOWNLOAD_FAILED_NETWORK;
+                    return DOWNLOAD_STEP_FAILED;
                 }
-            } else if ((millis() - lastDataTime) > NO_DATA_TIMEOUT) {
+                // Connection closed normally
+                Serial.println("FileManager: Connection closed normally");
+                return DOWNLOAD_STEP_DONE;
+            }
+            if ((millis() - s.lastDataTime) > DOWNLOAD_NO_DATA_TIMEOUT_MS) {
                 // No data for too long, but connection still alive
-                Serial.printf("FileManager: No data received for %lu seconds, timing out\n", NO_DATA_TIMEOUT / 1000);
-                errorMsg = "Download stalled - no data received for " + String(NO_DATA_TIMEOUT / 1000) + " seconds";
-                downloadSuccess = false;
+                Serial.printf("FileManager: No data received for %lu seconds, timing out\n", DOWNLOAD_NO_DATA_TIMEOUT_MS / 1000);
+                errorMsg = "Download stalled - no data received for " + String(DOWNLOAD_NO_DATA_TIMEOUT_MS / 1000) + " seconds";
+                lastDownloadFailure = DOWNLOAD_FAILED_NETWORK;
+                return DOWNLOAD_STEP_FAILED;
             }
+            // Nothing buffered: hand the loop back rather than wait here, the rest of
+            // the loop is the poll interval
+            downloadRate.idleWaits++;
+            break;
         }
         
-        delay(10); // Slightly longer delay to reduce CPU usage
+        s.lastDataTime = millis(); // Reset no-data timer
+        
+        // Plain bodies are read straight into the chunk being staged and de-chunked
+        // there; compressed ones go through the wire buffer and the inflater
+        uint8_t* target;
+        size_t room;
+        if (s.wireBuffer) {
+            target = s.wireBuffer;
+            room = DOWNLOAD_BUFFER_SIZE;
+        } else {
+            target = s.buffer + s.staged;
+            room = s.chunkSize - s.staged;
+        }
+        int readBytes = client.readBytes(target, min(availableData, room));
+        if (readBytes <= 0) {
+            break;
+        }
+        s.windowBytes += readBytes;
+        if (!takeBody(target, readBytes, errorMsg)) {
+            return DOWNLOAD_STEP_FAILED;
+        }
+        
+        // Re-measure the rate over a short window; the new chunk size takes
+        // effect at the next write so staged data never straddles two sizes
+        unsigned long windowMs = s.lastDataTime - s.windowStart;
+        if (windowMs >= RATE_WINDOW_MS) {
+            s.nextChunkSize = chunkSizeForRate(s.windowBytes * 1000.0f / 1024.0f / windowMs, s.bufferSize);
+            s.windowBps = (uint64_t)s.windowBytes * 1000 / windowMs;
+            s.windowStart = s.lastDataTime;
+            s.windowBytes = 0;
+        }
+    }
+    
+    // Progress once per slice, not per read; consumers poll the snapshot
+    publishProgress();
+    if (s.transferLength > 0) {
+        int percent = ((int64_t)progress.bytes * 100) / s.transferLength;
+        if (percent >= s.lastProgress + 5) {
+            s.lastProgress = percent;
+            Serial.printf("FileManager: Download progress: %d%% (%u/%d bytes)\n", 
+                          percent, progress.bytes, s.transferLength);
+        }
     }
     
     // Check for overall timeout
-    if ((millis() - startTime) >= DOWNLOAD_TIMEOUT_MS) {
+    if ((millis() - s.startTime) >= DOWNLOAD_TIMEOUT_MS) {
         Serial.println("FileManager: Download timed out");
         errorMsg = "Download timed out after " + String(DOWNLOAD_TIMEOUT_MS / 1000) + " seconds";
-        downloadSuccess = false;
+        lastDownloadFailure = DOWNLOAD_FAILED_NETWORK;
+        return DOWNLOAD_STEP_FAILED;
+    }
+    return DOWNLOAD_STEP_RUNNING;
+}
+
+bool FileManager::takeBody(uint8_t* data, size_t length, String& errorMsg) {
+    DownloadSession& s = session;
+    size_t bodyBytes = s.http.decodeBody(data, length);
+    if (s.http.failed()) {
+        errorMsg = "Malformed HTTP body: " + String(s.http.getError());
+        lastDownloadFailure = DOWNLOAD_FAILED_SERVER;
+        return false;
     }
     
-    free(buffer);
-    file.close();
-    client.stop();
+    if (s.inflater.isActive()) {
+        if (!s.inflater.write(data, bodyBytes, inflateSink)) {
+            if (s.writeFailed) {
+                errorMsg = "Failed to write to file";
+            } else {
+                errorMsg = "Corrupt compressed download: " + String(s.inflater.getError());
+                lastDownloadFailure = DOWNLOAD_FAILED_SERVER;
+            }
+            return false;
+        }
+        return true;
+    }
     
-    if (!downloadSuccess) {
-        SD.remove(tempPath);
-        downloadInProgress = false;
+    // Already in place at the end of the staged chunk
+    s.staged += bodyBytes;
+    s.totalDownloaded += bodyBytes;
+    if (s.staged == s.chunkSize && !writeStagedChunk()) {
+        errorMsg = "Failed to write to file";
         return false;
     }
+    return true;
+}
+
+bool FileManager::stageBody(const uint8_t* data, size_t length) {
+    DownloadSession& s = session;
+    while (length > 0) {
+        size_t count = min(length, s.chunkSize - s.staged);
+        memcpy(s.buffer + s.staged, data, count);
+        s.staged += count;
+        s.totalDownloaded += count;
+        data += count;
+        length -= count;
+        if (s.staged == s.chunkSize && !writeStagedChunk()) {
+            s.writeFailed = true;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FileManager::inflateSink(const uint8_t* data, size_t length) {
+    return getInstance().stageBody(data, length);
+}
+
+bool FileManager::writeStagedChunk() {
+    // Only whole chunks are written mid-transfer, so every write starts and ends on a
+    // sector boundary and FatFs never has to read-modify-write a partial sector
+    DownloadSession& s = session;
+    if (s.file.write(s.buffer, s.staged) != s.staged) {
+        return false;
+    }
+    s.staged = 0;
+    s.chunkSize = s.nextChunkSize;
+    return true;
+}
+
+void FileManager::publishProgress() {
+    const DownloadSession& s = session;
+    uint32_t bytes = s.resumedFrom + s.http.getBodyBytes();
+    uint32_t bytesPerSecond = s.windowBps;
+    if (bytesPerSecond == 0) {
+        unsigned long elapsed = millis() - s.startTime;
+        bytesPerSecond = elapsed > 0 ? (uint64_t)s.http.getBodyBytes() * 1000 / elapsed : 0;
+    }
+    uint32_t total = s.transferLength > 0 ? s.transferLength : 0;
+    uint32_t etaMs = 0;
+    if (total > bytes && bytesPerSecond > 0) {
+        etaMs = (uint64_t)(total - bytes) * 1000 / bytesPerSecond;
+    }
+    
+    uint32_t seq = progressSeq.load(std::memory_order_relaxed);
+    progressSeq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    progress.taskId = downloadIdFor(s.task.localPath);
+    progress.bytes = bytes;
+    progress.total = total;
+    progress.bytesPerSecond = bytesPerSecond;
+    progress.etaMs = etaMs;
+    progress.queued = queuedDownloadCount();
+    progress.priority = s.task.priority;
+    progressSeq.store(seq + 2, std::memory_order_release);
+}
+
+void FileManager::clearProgress() {
+    uint32_t seq = progressSeq.load(std::memory_order_relaxed);
+    progressSeq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memset(&progress, 0, sizeof(progress));
+    progressSeq.store(seq + 2, std::memory_order_release);
+}
+
+bool FileManager::getDownloadProgress(DownloadProgress& out) const {
+    for (int attempt = 0; attempt < 4; attempt++) {
+        uint32_t before = progressSeq.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue; // Mid-update on the other core
+        }
+        memcpy(&out, (const void*)&progress, sizeof(out));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (progressSeq.load(std::memory_order_relaxed) == before) {
+            return out.taskId != 0;
+        }
+    }
+    return false;
+}
+
+void FileManager::releaseSessionBuffers() {
+    heap_caps_free(session.buffer);
+    session.buffer = nullptr;
+    free(session.wireBuffer);
+    session.wireBuffer = nullptr;
+    session.inflater.end();
+}
+
+void FileManager::closeSession(bool keepPartial) {
+    DownloadSession& s = session;
+    
+    // Write the final partial chunk; a partial file is only worth keeping whole
+    if (s.staged > 0) {
+        if (!keepPartial || s.file.write(s.buffer, s.staged) != s.staged) {
+            s.totalDownloaded -= s.staged;
+            keepPartial = false;
+        }
+        s.staged = 0;
+    }
+    
+    releaseSessionBuffers();
+    clearProgress();
+    s.file.close();
+    if (s.client) {
+        ConnectionManager::getInstance().closeStream(s.client, false);
+        s.client = nullptr;
+    }
+    s.request = String();
+    
+    if (keepPartial && s.totalDownloaded > 0) {
+        // The pre-allocated length stays, the next attempt writes into it
+        s.task.resumeOffset = s.totalDownloaded;
+        accountSpace(s.allocatedSize, std::max(s.allocatedSize, (size_t)s.totalDownloaded));
+    } else {
+        s.task.resumeOffset = 0;
+        sdFs->remove(s.tempPath);
+        rememberEntry(s.tempPath, SD_ENTRY_MISSING);
+        accountSpace(s.allocatedSize, 0);
+        clearCommitIntent(s.task.localPath);
+    }
+    downloadInProgress = false;
+}
+
+bool FileManager::finishDownload(String& errorMsg) {
+    DownloadSession& s = session;
+    const String& url = s.task.url;
+    const String& localPath = s.task.localPath;
+    const String& tempPath = s.tempPath;
+    int contentLength = s.contentLength;
+    int totalDownloaded = s.totalDownloaded;
+    
+    // A compressed stream has to reach its end marker and checksum, not just the socket's end
+    if (s.inflater.isActive() && !s.inflater.finished()) {
+        errorMsg = "Compressed download ended early";
+        lastDownloadFailure = DOWNLOAD_FAILED_NETWORK;
+        closeSession(false);
+        return false;
+    }
+    
+    // Write the final partial block
+    if (s.staged > 0) {
+        if (s.file.write(s.buffer, s.staged) != s.staged) {
+            errorMsg = "Failed to write to file";
+            lastDownloadFailure = DOWNLOAD_FAILED_LOCAL;
+            closeSession(false);
+            return false;
+        }
+        s.staged = 0;
+    }
+    s.task.resumeOffset = 0;
+    bool compressed = s.inflater.isActive();
+    releaseSessionBuffers();
+    clearProgress();
+    s.file.close();
+    // The whole message was read, so the socket can serve the next download
+    ConnectionManager::getInstance().closeStream(s.client, s.http.done() && s.http.isKeepAlive());
+    s.client = nullptr;
+    downloadInProgress = false;
+    
+    // A pre-allocated file is already contentLength bytes long; cut off the unwritten tail
+    bool preallocated = s.allocatedSize > 0;
+    if (s.allocatedSize > (size_t)totalDownloaded) {
+        String vfsPath = String(SD_MOUNT_POINT) + tempPath;
+        if (truncate(vfsPath.c_str(), totalDownloaded) != 0) {
+            errorMsg = "Failed to truncate pre-allocated file";
+            sdFs->remove(tempPath);
+            rememberEntry(tempPath, SD_ENTRY_MISSING);
+            accountSpace(s.allocatedSize, 0);
+            clearCommitIntent(localPath);
+            return false;
+        }
+    }
+    accountSpace(s.allocatedSize, totalDownloaded);
     
     // Verify download size with small tolerance for edge cases
     if (contentLength > 0) {
@@ -781,8 +1693,11 @@ bool FileManager::downloadFileFromURL(const String& url, const String& localPath
                 Serial.printf("FileManager: Download completed with %d bytes missing (within tolerance)\n", missingBytes);
             } else {
                 errorMsg = "Download incomplete: " + String(totalDownloaded) + "/" + String(contentLength) + " bytes (" + String(missingBytes) + " bytes missing)";
-                SD.remove(tempPath);
-                downloadInProgress = false;
+                lastDownloadFailure = DOWNLOAD_FAILED_NETWORK;
+                sdFs->remove(tempPath);
+                rememberEntry(tempPath, SD_ENTRY_MISSING);
+                accountSpace(totalDownloaded, 0);
+                clearCommitIntent(localPath);
                 return false;
             }
         } else if (missingBytes < 0) {
@@ -790,207 +1705,773 @@ bool FileManager::downloadFileFromURL(const String& url, const String& localPath
         }
     }
     
-    // Move temporary file to final location
-    if (SD.exists(localPath)) {
-        SD.remove(localPath);
-    }
-    
-    if (!SD.rename(tempPath, localPath)) {
+    // Move temporary file to final location. From here until the intent is cleared a
+    // power loss is finished by recoverCommits() at the next boot.
+    logCommitIntent(localPath, COMMIT_PUBLISHING, totalDownloaded);
+    if (!replaceFile(tempPath, localPath)) {
         errorMsg = "Failed to move temporary file to final location";
-        SD.remove(tempPath);
-        downloadInProgress = false;
+        sdFs->remove(tempPath);
+        rememberEntry(tempPath, SD_ENTRY_MISSING);
+        accountSpace(totalDownloaded, 0);
+        clearCommitIntent(localPath);
         return false;
     }
     
     // Verify final file exists and has reasonable size
-    File finalFile = SD.open(localPath);
+    File finalFile = sdFs->open(localPath);
     if (!finalFile) {
         errorMsg = "Final file verification failed";
-        downloadInProgress = false;
+        clearCommitIntent(localPath);
         return false;
     }
     size_t finalSize = finalFile.size();
     finalFile.close();
+    clearCommitIntent(localPath);
     
     if (contentLength > 0) {
         int sizeDiff = abs((int)finalSize - (int)contentLength);
         if (sizeDiff > 64) { // Allow up to 64 bytes difference
             errorMsg = "Final file size mismatch: expected " + String(contentLength) + ", got " + String(finalSize);
-            SD.remove(localPath);
-            downloadInProgress = false;
+            sdFs->remove(localPath);
+            rememberEntry(localPath, SD_ENTRY_MISSING);
+            accountSpace(finalSize, 0);
             return false;
         } else if (sizeDiff > 0) {
             Serial.printf("FileManager: File size difference: %d bytes (within tolerance)\n", sizeDiff);
         }
     }
     
-    downloadInProgress = false;
+    StorageManager::getInstance().onFileAdded(s.targetFigure, finalSize);
+    uint64_t blobKey;
+    if (BlobStore::keyFromPath(localPath.c_str(), blobKey)) {
+        BlobStore::getInstance().onBlobAdded(blobKey, finalSize);
+    }
+    unsigned long durationMs = millis() - s.startTime;
+    recordDownloadRate(s.http.getBodyBytes(), durationMs, s.ttfbMs > 0 ? s.ttfbMs : 0);
+    downloadRate.chunkSize = s.chunkSize;
     
     // Update statistics
     downloadStats.totalDownloads++;
     downloadStats.successfulDownloads++;
-    downloadStats.totalBytesDownloaded += totalDownloaded;
+    downloadStats.totalBytesDownloaded += totalDownloaded - s.resumedFrom;
     saveDownloadStats();
     
-    Serial.printf("FileManager: Download completed successfully: %s (%d bytes)\n", 
-                  localPath.c_str(), totalDownloaded);
+    Serial.printf("FileManager: Download completed successfully: %s (%d bytes in %lu ms, %.1f KB/s, TTFB %d ms, %u byte chunks%s%s%s)\n", 
+                  localPath.c_str(), totalDownloaded, durationMs, downloadRate.lastKBps, (int)s.ttfbMs,
+                  s.chunkSize, preallocated ? ", pre-allocated" : "", s.resumedFrom > 0 ? ", resumed" : "",
+                  compressed ? ", compressed" : "");
     
     if (downloadCompleteCallback) {
-        downloadCompleteCallback(httpUrl, localPath, true, "");
+        downloadCompleteCallback(url, localPath, true, "");
+    }
+    
+    return true;
+}
+
+void FileManager::suspendDownload() {
+    Serial.printf("FileManager: Suspending %s at %d bytes for a more urgent download\n",
+                  session.task.localPath.c_str(), session.totalDownloaded);
+    closeSession(true);
+    // Preemption is not a failed attempt; the task goes back to the head of its class
+    DownloadTask& task = session.task;
+    if (task.retryCount > 0) {
+        task.retryCount--;
+    }
+    task.nextAttemptAt = 0;
+    downloadQueues[task.priority].push_front(task);
+}
+
+void FileManager::abortDownload() {
+    if (!downloadInProgress) {
+        return;
+    }
+    Serial.printf("FileManager: Cancelling active download: %s\n", session.task.localPath.c_str());
+    closeSession(false);
+}
+
+size_t FileManager::chunkSizeForRate(float kBps, size_t bufferSize) {
+    // Power of two from 4KB up, so chunks stay whole sectors and clusters
+    size_t target = (size_t)(kBps * 1024.0f * CHUNK_TARGET_MS / 1000.0f);
+    size_t chunk = DOWNLOAD_BUFFER_SIZE;
+    while (chunk < target && chunk * 2 <= bufferSize) {
+        chunk *= 2;
+    }
+    return chunk;
+}
+
+void FileManager::tuneDownloadSocket(WiFiClient& client) {
+    int fd = client.fd();
+    if (fd < 0) {
+        return; // TLS streams keep their socket inside the SSL context
+    }
+#if LWIP_SO_RCVBUF
+    // Let lwIP queue more than one window's worth while the SD card is being written
+    int size = SOCKET_RCVBUF_SIZE;
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) != 0) {
+        Serial.printf("FileManager: Failed to set socket receive buffer (errno %d)\n", errno);
+    }
+#endif
+}
+
+void FileManager::recordDownloadRate(size_t bytes, unsigned long durationMs, uint32_t ttfbMs) {
+    const float alpha = 0.3f;
+    
+    downloadRate.lastBytes = bytes;
+    downloadRate.lastDurationMs = durationMs;
+    downloadRate.lastTtfbMs = ttfbMs;
+    downloadRate.lastKBps = durationMs > 0 ? bytes * 1000.0f / 1024.0f / durationMs : 0;
+    
+    if (ttfbMs > 0) {
+        downloadRate.avgTtfbMs = downloadRate.avgTtfbMs > 0 ?
+            alpha * ttfbMs + (1 - alpha) * downloadRate.avgTtfbMs : ttfbMs;
+    }
+    if (bytes < MIN_RATE_SAMPLE_BYTES || durationMs == 0) {
+        return;
+    }
+    downloadRate.avgKBps = downloadRate.samples > 0 ?
+        alpha * downloadRate.lastKBps + (1 - alpha) * downloadRate.avgKBps : downloadRate.lastKBps;
+    downloadRate.samples++;
+}
+
+bool FileManager::preallocateFile(File& file, size_t size) {
+    // Seeking past EOF on a file opened for writing makes FatFs extend the cluster
+    // chain in one go, taking the next free clusters in order
+    if (!file.seek(size, SeekSet)) {
+        return false;
+    }
+    if (file.position() != size) {
+        return false;
+    }
+    return file.seek(0, SeekSet);
+}
+
+String FileManager::benchmarkReadThroughput(const String& path) {
+    if (!sdCardInitialized) {
+        return "SD card not initialized";
+    }
+    
+    File file = sdFs->open(path, FILE_READ);
+    if (!file || file.isDirectory()) {
+        if (file) file.close();
+        return "Cannot open file: " + path;
+    }
+    size_t fileSize = file.size();
+    file.close();
+    
+    uint8_t* buffer = (uint8_t*)heap_caps_malloc(DOWNLOAD_BUFFER_SIZE, MALLOC_CAP_8BIT | MALLOC_CAP_32BIT);
+    if (!buffer) {
+        return "Failed to allocate benchmark buffer";
+    }
+    
+    // 512B matches the small reads the audio decoder issues, 4KB is a full download block
+    const size_t chunkSizes[] = {512, DOWNLOAD_BUFFER_SIZE};
+    String result = "Read throughput for " + path + " (" + formatBytes(fileSize) + "):\n";
+    
+    for (size_t i = 0; i < sizeof(chunkSizes) / sizeof(chunkSizes[0]); i++) {
+        file = sdFs->open(path, FILE_READ);
+        if (!file) {
+            result += "  Reopen failed\n";
+            break;
+        }
+        
+        size_t totalRead = 0;
+        unsigned long start = micros();
+        while (true) {
+            size_t readBytes = file.read(buffer, chunkSizes[i]);
+            if (readBytes == 0) {
+                break;
+            }
+            totalRead += readBytes;
+        }
+        unsigned long elapsed = micros() - start;
+        file.close();
+        
+        float kbPerSec = elapsed > 0 ? (totalRead / 1024.0f) / (elapsed / 1000000.0f) : 0;
+        result += "  " + String(chunkSizes[i]) + "B reads: " + String(kbPerSec, 1) + " KB/s (" + String(elapsed / 1000) + " ms)\n";
+    }
+    
+    heap_caps_free(buffer);
+    return result;
+}
+
+// Fill p50/p95/p99/max from a set of latency samples (sorts them in place)
+static void latencyPercentiles(std::vector<uint32_t>& samples, uint32_t out[4]) {
+    if (samples.empty()) {
+        out[0] = out[1] = out[2] = out[3] = 0;
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t last = samples.size() - 1;
+    out[0] = samples[last * 50 / 100];
+    out[1] = samples[last * 95 / 100];
+    out[2] = samples[last * 99 / 100];
+    out[3] = samples[last];
+}
+
+String FileManager::benchmarkBus() {
+    if (!sdCardInitialized) {
+        return "SD card not initialized";
+    }
+    if (downloadInProgress) {
+        return "Cannot benchmark while a download is in progress";
+    }
+    
+    const char* benchPath = "/temp/sdbench.tmp";
+    const uint32_t blockSizes[SdBenchResult::BLOCK_SIZE_COUNT] = {512, 4096, 16384};
+    const size_t maxBlock = 16384;
+    const size_t latencyBlock = 4096;
+    
+    if (getSDCardFreeSpace() < SD_BENCH_FILE_SIZE * 2) {
+        return "Not enough free space for benchmark";
+    }
+    
+    uint8_t* buffer = (uint8_t*)heap_caps_malloc(maxBlock, MALLOC_CAP_8BIT | MALLOC_CAP_32BIT);
+    if (!buffer) {
+        return "Failed to allocate benchmark buffer";
+    }
+    for (size_t i = 0; i < maxBlock; i++) {
+        buffer[i] = (uint8_t)(i * 31);
+    }
+    
+    SdBenchResult result;
+    result.valid = false;
+    result.busMode = sdBusMode;
+    
+    std::vector<uint32_t> writeLatencies;
+    std::vector<uint32_t> readLatencies;
+    writeLatencies.reserve(SD_BENCH_FILE_SIZE / latencyBlock);
+    readLatencies.reserve(SD_BENCH_RANDOM_READS);
+    
+    Serial.printf("FileManager: Running SD benchmark on %s (%s)...\n", benchPath, getBusModeName(sdBusMode));
+    
+    bool ok = true;
+    for (int b = 0; b < SdBenchResult::BLOCK_SIZE_COUNT && ok; b++) {
+        size_t blockSize = blockSizes[b];
+        result.blockSizes[b] = blockSize;
+        bool recordLatency = (blockSize == latencyBlock);
+        
+        // Sequential write, fresh file each pass so allocation cost is included
+        sdFs->remove(benchPath);
+        File file = sdFs->open(benchPath, FILE_WRITE);
+        if (!file) {
+            ok = false;
+            break;
+        }
+        size_t written = 0;
+        unsigned long start = micros();
+        while (written < SD_BENCH_FILE_SIZE) {
+            unsigned long opStart = micros();
+            if (file.write(buffer, blockSize) != blockSize) {
+                ok = false;
+                break;
+            }
+            if (recordLatency) {
+                writeLatencies.push_back(micros() - opStart);
+            }
+            written += blockSize;
+        }
+        file.close();
+        unsigned long elapsed = micros() - start;
+        result.seqWriteKBps[b] = elapsed > 0 ? (written / 1024.0f) / (elapsed / 1000000.0f) : 0;
+        
+        // Sequential read of what was just written
+        file = sdFs->open(benchPath, FILE_READ);
+        if (!file) {
+            ok = false;
+            break;
+        }
+        size_t readTotal = 0;
+        start = micros();
+        size_t readBytes;
+        while ((readBytes = file.read(buffer, blockSize)) > 0) {
+            readTotal += readBytes;
+        }
+        elapsed = micros() - start;
+        file.close();
+        result.seqReadKBps[b] = elapsed > 0 ? (readTotal / 1024.0f) / (elapsed / 1000000.0f) : 0;
+        
+        Serial.printf("FileManager: sdbench %uB done\n", (unsigned)blockSize);
+        yield();
+    }
+    
+    // Random 4KB reads over the last file
+    File file = ok ? sdFs->open(benchPath, FILE_READ) : File();
+    if (file) {
+        size_t blocks = file.size() / latencyBlock;
+        unsigned long start = micros();
+        for (int i = 0; i < SD_BENCH_RANDOM_READS && blocks > 0; i++) {
+            unsigned long opStart = micros();
+            file.seek((esp_random() % blocks) * latencyBlock, SeekSet);
+            file.read(buffer, latencyBlock);
+            readLatencies.push_back(micros() - opStart);
+        }
+        unsigned long elapsed = micros() - start;
+        file.close();
+        result.randReadIops = elapsed > 0 ? readLatencies.size() * 1000000.0f / elapsed : 0;
+    } else {
+        ok = false;
+    }
+    
+    sdFs->remove(benchPath);
+    heap_caps_free(buffer);
+    
+    if (!ok) {
+        return "SD benchmark failed (file I/O error)";
+    }
+    
+    latencyPercentiles(writeLatencies, result.writeLatencyUs);
+    latencyPercentiles(readLatencies, result.randReadLatencyUs);
+    result.timestamp = millis();
+    result.valid = true;
+    lastSdBench = result;
+    
+    String report = "SD Benchmark (" + String(getBusModeName(result.busMode)) + ", " + formatBytes(SD_BENCH_FILE_SIZE) + " per pass):\n";
+    report += "  Block     Write KB/s   Read KB/s\n";
+    for (int b = 0; b < SdBenchResult::BLOCK_SIZE_COUNT; b++) {
+        char line[64];
+        snprintf(line, sizeof(line), "  %-8u  %10.1f  %10.1f\n",
+                 (unsigned)result.blockSizes[b], result.seqWriteKBps[b], result.seqReadKBps[b]);
+        report += line;
+    }
+    report += "  Random 4KB read: " + String(result.randReadIops, 0) + " IOPS\n";
+    report += "  4KB write latency us: p50=" + String(result.writeLatencyUs[0]) + " p95=" + String(result.writeLatencyUs[1]) +
+              " p99=" + String(result.writeLatencyUs[2]) + " max=" + String(result.writeLatencyUs[3]) + "\n";
+    report += "  4KB rand read latency us: p50=" + String(result.randReadLatencyUs[0]) + " p95=" + String(result.randReadLatencyUs[1]) +
+              " p99=" + String(result.randReadLatencyUs[2]) + " max=" + String(result.randReadLatencyUs[3]) + "\n";
+    return report;
+}
+
+String FileManager::runDownloadBenchmark(const String& url, int runs) {
+    if (!sdCardInitialized) {
+        return "SD card not initialized";
+    }
+    if (downloadInProgress) {
+        return "Cannot benchmark while a download is in progress";
+    }
+    if (!WiFi.isConnected()) {
+        return "WiFi not connected";
+    }
+    if (runs < 1) {
+        runs = 1;
+    } else if (runs > DOWNLOAD_BENCH_MAX_RUNS) {
+        runs = DOWNLOAD_BENCH_MAX_RUNS;
+    }
+    
+    // Runs the real download path (start, slices, resume, finish) but leaves the
+    // statistics, the rate estimate and the completion callback untouched
+    const char* benchPath = "/temp/dlbench.bin";
+    DownloadStats savedStats = downloadStats;
+    DownloadRate savedRate = downloadRate;
+    DownloadCompleteCallback savedComplete = downloadCompleteCallback;
+    downloadCompleteCallback = nullptr;
+    
+    size_t heapBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    size_t heapLowest = heapBefore;
+    size_t largestBlockLowest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    std::vector<float> rates;
+    int succeeded = 0;
+    int totalAttempts = 0;
+    String report = "Download Benchmark: " + url + "\n";
+    report += "  Run  Result  Attempts  Bytes       ms       KB/s   TTFB ms\n";
+    
+    Serial.printf("FileManager: Running download benchmark, %d runs of %s\n", runs, url.c_str());
+    
+    // The download path accounted for what it wrote, so the bench file leaves the
+    // same way; deleteFile() would report every missing one
+    String benchTemp = String(benchPath) + ".tmp";
+    auto removeBenchFiles = [this, benchPath, &benchTemp]() {
+        size_t size = getFileSize(benchPath);
+        if (sdFs->remove(benchPath)) {
+            accountSpace(size, 0);
+        }
+        size = getFileSize(benchTemp);
+        if (sdFs->remove(benchTemp)) {
+            accountSpace(size, 0);
+        }
+        rememberEntry(benchPath, SD_ENTRY_MISSING);
+        rememberEntry(benchTemp, SD_ENTRY_MISSING);
+    };
+    
+    for (int run = 1; run <= runs; run++) {
+        removeBenchFiles();
+        
+        DownloadTask task;
+        task.url = url;
+        task.host = hostOf(url);
+        task.localPath = benchPath;
+        task.retryCount = 0;
+        task.completed = false;
+        task.lastAttempt = 0;
+        task.nextAttemptAt = 0;
+        task.priority = DOWNLOAD_PRIORITY_REPAIR;
+        task.resumeOffset = 0;
+        
+        bool ok = false;
+        String errorMsg;
+        int32_t ttfbMs = -1;
+        size_t wireBytes = 0;
+        unsigned long start = millis();
+        
+        // Failed attempts are retried straight away, resuming like the queue would
+        // after its backoff, so injected disconnects show up as extra attempts
+        int attempt = 0;
+        while (attempt < DOWNLOAD_BENCH_MAX_ATTEMPTS && !ok) {
+            attempt++;
+            errorMsg = "";
+            if (!startDownload(task, errorMsg)) {
+                continue;
+            }
+            DownloadStep step;
+            do {
+                step = stepDownload(errorMsg);
+                size_t freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+                size_t largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+                heapLowest = min(heapLowest, freeHeap);
+                largestBlockLowest = min(largestBlockLowest, largestBlock);
+                if (step == DOWNLOAD_STEP_RUNNING) {
+                    delay(1);
+                }
+            } while (step == DOWNLOAD_STEP_RUNNING);
+            
+            if (ttfbMs < 0) {
+                ttfbMs = session.ttfbMs;
+            }
+            wireBytes += session.http.getBodyBytes();
+            if (step == DOWNLOAD_STEP_DONE) {
+                ok = finishDownload(errorMsg);
+            } else {
+                closeSession(lastDownloadFailure == DOWNLOAD_FAILED_NETWORK);
+            }
+            task.resumeOffset = session.task.resumeOffset;
+        }
+        
+        unsigned long elapsed = millis() - start;
+        size_t fileSize = ok ? session.totalDownloaded : 0;
+        float kBps = elapsed > 0 ? (wireBytes / 1024.0f) / (elapsed / 1000.0f) : 0;
+        totalAttempts += attempt;
+        if (ok) {
+            succeeded++;
+            rates.push_back(kBps);
+        }
+        
+        char line[96];
+        snprintf(line, sizeof(line), "  %-3d  %-6s  %-8d  %-10u  %-7lu  %6.1f  %d\n",
+                 run, ok ? "ok" : "FAIL", attempt, (unsigned)fileSize, elapsed, kBps, (int)ttfbMs);
+        report += line;
+        if (!ok) {
+            report += "       " + errorMsg + "\n";
+        }
+        Serial.printf("FileManager: dlbench run %d/%d %s\n", run, runs, ok ? "done" : "failed");
+        yield();
+    }
+    
+    removeBenchFiles();
+    downloadStats = savedStats;
+    downloadRate = savedRate;
+    downloadCompleteCallback = savedComplete;
+    
+    report += "  Succeeded: " + String(succeeded) + "/" + String(runs) + ", attempts: " + String(totalAttempts) + "\n";
+    if (!rates.empty()) {
+        std::sort(rates.begin(), rates.end());
+        report += "  KB/s: min " + String(rates.front(), 1) + ", median " + String(rates[rates.size() / 2], 1) +
+                  ", max " + String(rates.back(), 1) + "\n";
+    }
+    report += "  Heap: " + formatBytes(heapBefore) + " free before, lowest " + formatBytes(heapLowest) +
+              " (" + formatBytes(heapBefore - heapLowest) + " used at peak), smallest largest block " +
+              formatBytes(largestBlockLowest) + "\n";
+    return report;
+}
+
+size_t FileManager::formatSDBenchmarkJson(char* buffer, size_t size) const {
+    if (!lastSdBench.valid || size == 0) {
+        return 0;
+    }
+    
+    // Compact on purpose, this is appended to the device report
+    int written = snprintf(buffer, size,
+                           "{\"bus\":\"%s\",\"seq_write_kbps\":[%.0f,%.0f,%.0f],\"seq_read_kbps\":[%.0f,%.0f,%.0f],"
+                           "\"rand_read_iops\":%.0f,\"write_lat_us\":[%u,%u,%u,%u],\"read_lat_us\":[%u,%u,%u,%u]}",
+                           getBusModeName(lastSdBench.busMode),
+                           lastSdBench.seqWriteKBps[0], lastSdBench.seqWriteKBps[1], lastSdBench.seqWriteKBps[2],
+                           lastSdBench.seqReadKBps[0], lastSdBench.seqReadKBps[1], lastSdBench.seqReadKBps[2],
+                           lastSdBench.randReadIops,
+                           (unsigned)lastSdBench.writeLatencyUs[0], (unsigned)lastSdBench.writeLatencyUs[1],
+                           (unsigned)lastSdBench.writeLatencyUs[2], (unsigned)lastSdBench.writeLatencyUs[3],
+                           (unsigned)lastSdBench.randReadLatencyUs[0], (unsigned)lastSdBench.randReadLatencyUs[1],
+                           (unsigned)lastSdBench.randReadLatencyUs[2], (unsigned)lastSdBench.randReadLatencyUs[3]);
+    if (written <= 0 || (size_t)written >= size) {
+        buffer[0] = '\0';
+        return 0;
+    }
+    return written;
+}
+
+void FileManager::processDownloadQueue() {
+    // A transfer in flight gets one slice per call
+    if (downloadInProgress) {
+        String errorMsg;
+        DownloadStep step = stepDownload(errorMsg);
+        if (step == DOWNLOAD_STEP_RUNNING) {
+            if (readyTaskAbove(session.task.priority)) {
+                suspendDownload();
+            }
+            return;
+        }
+        
+        bool downloadSuccess = false;
+        if (step == DOWNLOAD_STEP_DONE) {
+            downloadSuccess = finishDownload(errorMsg);
+        } else {
+            // Bytes that made it to the card before the network dropped are kept for a ranged
+            // retry, and so is an earlier attempt's partial when this one got no body in
+            closeSession(lastDownloadFailure == DOWNLOAD_FAILED_NETWORK ||
+                         session.totalDownloaded == (int)session.resumedFrom);
+        }
+        completeAttempt(session.task, downloadSuccess, errorMsg);
+        saveDownloadQueue();
+        return;
+    }
+    
+    if (queuedDownloadCount() == 0) {
+        return;
+    }
+    
+    // Only proceed if device is charging
+    if (!isChargingRequired()) {
+        return;
+    }
+    
+    // First pass: Remove completed tasks and permanently failed tasks
+    for (int priority = 0; priority < DOWNLOAD_PRIORITY_COUNT; priority++) {
+        std::deque<DownloadTask>& queue = downloadQueues[priority];
+        auto it = queue.begin();
+        while (it != queue.end()) {
+            DownloadTask& task = *it;
+            
+            if (task.completed) {
+                it = queue.erase(it);
+                continue;
+            }
+            
+            // Check if we've used up every attempt
+            if (task.retryCount >= MAX_DOWNLOAD_ATTEMPTS) {
+                Serial.printf("FileManager: Download permanently failed after %d attempts: %s\n", 
+                             MAX_DOWNLOAD_ATTEMPTS, task.url.c_str());
+                
+                downloadStats.totalDownloads++;
+                downloadStats.failedDownloads++;
+                
+                if (task.resumeOffset > 0) {
+                    deleteFile(task.localPath + ".tmp");
+                }
+                if (downloadCompleteCallback) {
+                    downloadCompleteCallback(task.url, task.localPath, false, "Max download attempts exceeded");
+                }
+                
+                it = queue.erase(it);
+                continue;
+            }
+            
+            ++it;
+        }
+    }
+    
+    // Second pass: the first ready task of the most urgent class goes next
+    bool connectivityChecked = false;
+    for (int priority = 0; priority < DOWNLOAD_PRIORITY_COUNT; priority++) {
+        std::deque<DownloadTask>& queue = downloadQueues[priority];
+        auto it = queue.begin();
+        while (it != queue.end()) {
+            DownloadTask& task = *it;
+            
+            // Still backing off after the last failure
+            if (task.nextAttemptAt != 0 && (long)(millis() - task.nextAttemptAt) < 0) {
+                ++it;
+                continue;
+            }
+            
+            // Leave hosts with an open circuit alone without spending an attempt
+            if (!task.host.isEmpty() && !circuitAllows(task.host)) {
+                ++it;
+                continue;
+            }
+            
+            // Check connectivity once, before the first attempt of this call
+            if (!connectivityChecked) {
+                if (!checkConnectivity()) {
+                    // Nothing can be downloaded; don't count this against any task
+                    return;
+                }
+                connectivityChecked = true;
+            }
+            
+            // Check if file already exists and is valid
+            if (fileExists(task.localPath)) {
+                if (task.checksum.isEmpty() || verifyFileIntegrity(task.localPath, task.checksum)) {
+                    Serial.printf("FileManager: File already exists and is valid: %s\n", task.localPath.c_str());
+                    it = queue.erase(it);
+                    continue;
+                } else {
+                    Serial.printf("FileManager: Existing file failed integrity check, re-downloading: %s\n", task.localPath.c_str());
+                    deleteFile(task.localPath);
+                }
+            }
+            
+            // Process this task; it leaves the queue while it runs
+            DownloadTask current = task;
+            queue.erase(it);
+            current.lastAttempt = millis();
+            current.retryCount++;
+            
+            Serial.printf("FileManager: Attempting download (attempt %d/%d, priority %d): %s\n", 
+                         current.retryCount, MAX_DOWNLOAD_ATTEMPTS, priority, current.url.c_str());
+            
+            String errorMsg;
+            if (!startDownload(current, errorMsg)) {
+                completeAttempt(current, false, errorMsg);
+            }
+            saveDownloadQueue();
+            return; // Process only one download per call
+        }
+    }
+}
+
+void FileManager::completeAttempt(DownloadTask& task, bool success, const String& errorMsg) {
+    bool transferOk = success;
+    
+    if (success) {
+        // Verify integrity if checksum provided
+        if (!task.checksum.isEmpty() && !verifyFileIntegrity(task.localPath, task.checksum)) {
+            Serial.printf("FileManager: Downloaded file failed integrity check: %s\n", task.localPath.c_str());
+            deleteFile(task.localPath);
+            Serial.printf("FileManager: Download attempt %d/%d failed (integrity)\n", 
+                         task.retryCount, MAX_DOWNLOAD_ATTEMPTS);
+            success = false;
+        } else {
+            Serial.printf("FileManager: Download successful: %s\n", task.localPath.c_str());
+        }
+    } else {
+        Serial.printf("FileManager: Download attempt %d/%d failed: %s (Error: %s)\n", 
+                     task.retryCount, MAX_DOWNLOAD_ATTEMPTS, task.url.c_str(), errorMsg.c_str());
+    }
+    
+    // Only the network and the server's health feed the circuit and the connectivity
+    // state; a full card or a 404 says nothing about either
+    const String& host = task.host;
+    bool urlValid = !host.isEmpty();
+    if (transferOk) {
+        lastTransferFailed = false;
+        if (urlValid) {
+            recordHostResult(host, true);
+        }
+    } else if (lastDownloadFailure == DOWNLOAD_FAILED_NETWORK || lastDownloadFailure == DOWNLOAD_FAILED_SERVER) {
+        if (lastDownloadFailure == DOWNLOAD_FAILED_NETWORK) {
+            lastTransferFailed = true;
+        }
+        if (urlValid) {
+            recordHostResult(host, false);
+        }
     }
     
-    return true;
-}
-
-void FileManager::processDownloadQueue() {
-    if (downloadQueue.empty() || downloadInProgress) {
+    if (success) {
         return;
     }
     
-    // Only proceed if device is charging
-    if (!isChargingRequired()) {
-        return;
+    // Back off and go to the end of its class so other tasks get a turn meanwhile; once
+    // out of attempts the first pass reports it
+    unsigned long waitMs = retryDelayMs(task.retryCount);
+    task.nextAttemptAt = millis() + waitMs;
+    if (task.nextAttemptAt == 0) {
+        task.nextAttemptAt = 1;
     }
-    
-    // First pass: Remove completed tasks and permanently failed tasks
-    auto it = downloadQueue.begin();
-    while (it != downloadQueue.end()) {
-        DownloadTask& task = *it;
-        
-        if (task.completed) {
-            it = downloadQueue.erase(it);
-            continue;
-        }
-        
-        // Check if we've exceeded the maximum retry batches
-        if (task.retryBatch >= MAX_RETRY_BATCHES) {
-            Serial.printf("FileManager: Download permanently failed after %d retry batches: %s\n", 
-                         MAX_RETRY_BATCHES, task.url.c_str());
-            
-            downloadStats.totalDownloads++;
-            downloadStats.failedDownloads++;
-            
-            if (downloadCompleteCallback) {
-                downloadCompleteCallback(task.url, task.localPath, false, "Max retry batches exceeded");
-            }
-            
-            it = downloadQueue.erase(it);
-            continue;
-        }
-        
-        ++it;
+    downloadQueues[task.priority].push_back(task);
+    if (task.retryCount < MAX_DOWNLOAD_ATTEMPTS) {
+        Serial.printf("FileManager: Retrying %s in %lu s%s\n", task.localPath.c_str(), waitMs / 1000,
+                      task.resumeOffset > 0 ? ", resuming the partial file" : "");
     }
-    
-    // Second pass: Find the first task that's ready to be processed
-    bool taskProcessed = false;
-    it = downloadQueue.begin();
-    while (it != downloadQueue.end() && !taskProcessed) {
-        DownloadTask& task = *it;
-        
-        // Check if we need to wait between retry batches
-        if (task.retryCount >= MAX_RETRY_COUNT) {
-            // We've exhausted this batch of retries, need to wait before starting next batch
-            if (task.lastBatchAttempt == 0) {
-                task.lastBatchAttempt = millis();
-                Serial.printf("FileManager: Retry batch %d failed for %s, waiting %d seconds before next batch\n", 
-                             task.retryBatch + 1, task.url.c_str(), RETRY_BATCH_DELAY_MS / 1000);
+}
+
+bool FileManager::readyTaskAbove(DownloadPriority priority) {
+    for (int p = 0; p < priority; p++) {
+        for (const auto& task : downloadQueues[p]) {
+            if (task.nextAttemptAt != 0 && (long)(millis() - task.nextAttemptAt) < 0) {
+                continue;
             }
-            
-            if ((millis() - task.lastBatchAttempt) >= RETRY_BATCH_DELAY_MS) {
-                // Start new retry batch
-                task.retryBatch++;
-                task.retryCount = 0;
-                task.lastBatchAttempt = 0;
-                task.lastAttempt = 0;
-                Serial.printf("FileManager: Starting retry batch %d for %s\n", 
-                             task.retryBatch + 1, task.url.c_str());
-            } else {
-                ++it;
+            if (!task.host.isEmpty() && !circuitAllows(task.host)) {
                 continue;
             }
+            return true;
         }
-        
-        // Check if enough time has passed since last individual retry
-        if (task.lastAttempt > 0 && 
-            (millis() - task.lastAttempt) < RETRY_DELAY_MS) {
-            ++it;
-            continue;
-        }
-        
-        // Check connectivity before attempting download
-        if (!checkConnectivity()) {
-            // Don't increment retry count for connectivity issues, just wait
-            task.lastAttempt = millis();
-            ++it;
-            continue;
+    }
+    return false;
+}
+
+size_t FileManager::queuedDownloadCount() const {
+    size_t count = 0;
+    for (int priority = 0; priority < DOWNLOAD_PRIORITY_COUNT; priority++) {
+        count += downloadQueues[priority].size();
+    }
+    return count;
+}
+
+bool FileManager::promoteDownload(const String& localPath, DownloadPriority priority) {
+    if (downloadInProgress && session.task.localPath == localPath) {
+        if (priority < session.task.priority) {
+            session.task.priority = priority;
         }
-        
-        // Check if file already exists and is valid
-        if (fileExists(task.localPath)) {
-            if (task.checksum.isEmpty() || verifyFileIntegrity(task.localPath, task.checksum)) {
-                Serial.printf("FileManager: File already exists and is valid: %s\n", task.localPath.c_str());
-                task.completed = true;
-                ++it;
-                continue;
-            } else {
-                Serial.printf("FileManager: Existing file failed integrity check, re-downloading: %s\n", task.localPath.c_str());
-                deleteFile(task.localPath);
+        return true;
+    }
+    for (int p = priority + 1; p < DOWNLOAD_PRIORITY_COUNT; p++) {
+        std::deque<DownloadTask>& queue = downloadQueues[p];
+        for (auto it = queue.begin(); it != queue.end(); ++it) {
+            if (it->localPath == localPath) {
+                DownloadTask task = *it;
+                queue.erase(it);
+                task.priority = priority;
+                downloadQueues[priority].push_back(task);
+                return true;
             }
         }
-        
-        // Process this task
-        String errorMsg;
-        task.lastAttempt = millis();
-        task.retryCount++;
-        
-        Serial.printf("FileManager: Attempting download (batch %d, attempt %d/%d): %s\n", 
-                     task.retryBatch + 1, task.retryCount, MAX_RETRY_COUNT, task.url.c_str());
-        
-        bool downloadSuccess = downloadFileFromURL(task.url, task.localPath, errorMsg);
-        
-        if (downloadSuccess) {
-            // Verify integrity if checksum provided
-            if (!task.checksum.isEmpty() && !verifyFileIntegrity(task.localPath, task.checksum)) {
-                Serial.printf("FileManager: Downloaded file failed integrity check: %s\n", task.localPath.c_str());
-                deleteFile(task.localPath);
-                Serial.printf("FileManager: Download attempt %d/%d failed (integrity): %s\n", 
-                             task.retryCount, MAX_RETRY_COUNT, errorMsg.c_str());
-                downloadSuccess = false;
-            } else {
-                task.completed = true;
-                Serial.printf("FileManager: Download successful: %s\n", task.localPath.c_str());
+    }
+    // Already in this class or a more urgent one
+    for (int p = 0; p <= priority; p++) {
+        for (const auto& task : downloadQueues[p]) {
+            if (task.localPath == localPath) {
+                return true;
             }
-        } else {
-            Serial.printf("FileManager: Download attempt %d/%d failed: %s (Error: %s)\n", 
-                         task.retryCount, MAX_RETRY_COUNT, task.url.c_str(), errorMsg.c_str());
         }
-        
-        // If download failed and hasn't reached max retries, move to end of queue for fair processing
-        if (!downloadSuccess && task.retryCount < MAX_RETRY_COUNT) {
-            // Move failed task to end of queue to give other tasks a chance
-            DownloadTask failedTask = task;
-            downloadQueue.erase(it);
-            downloadQueue.push_back(failedTask);
-            Serial.printf("FileManager: Moved failed download to end of queue: %s\n", failedTask.localPath.c_str());
+    }
+    return false;
+}
+
+void FileManager::demoteDownloads(DownloadPriority floor) {
+    if (downloadInProgress && session.task.priority < floor) {
+        session.task.priority = floor;
+    }
+    // Ahead of what was already in the floor class, in their previous order
+    for (int p = floor - 1; p >= 0; p--) {
+        std::deque<DownloadTask>& queue = downloadQueues[p];
+        while (!queue.empty()) {
+            DownloadTask task = queue.back();
+            queue.pop_back();
+            task.priority = floor;
+            downloadQueues[floor].push_front(task);
         }
-        
-        taskProcessed = true; // Process only one download per call
     }
-    
-    saveDownloadQueue();
 }
 
 bool FileManager::addRequiredFile(const String& localPath, const String& url, const String& checksum) {
+    FileEntry entry;
+    entry.setPath(localPath);
+    
     // Check if already in list
     for (const auto& file : requiredFiles) {
-        if (file.path == localPath) {
+        if (file.hasSamePath(entry)) {
             Serial.printf("FileManager: File already in required list: %s\n", localPath.c_str());
             return true;
         }
     }
     
-    FileEntry entry;
-    entry.path = localPath;
     entry.url = url;
     entry.required = true;
     entry.checksum = checksum;
@@ -1003,30 +2484,32 @@ bool FileManager::addRequiredFile(const String& localPath, const String& url, co
 }
 
 void FileManager::checkRequiredFiles() {
+    char pathBuffer[TrackId::PATH_MAX_LEN];
     for (const auto& file : requiredFiles) {
-        if (!fileExists(file.path)) {
-            Serial.printf("FileManager: Required file missing, scheduling download: %s\n", file.path.c_str());
-            scheduleDownload(file.url, file.path, file.checksum);
-        } else if (!file.checksum.isEmpty() && !verifyFileIntegrity(file.path, file.checksum)) {
-            Serial.printf("FileManager: Required file failed integrity check, re-downloading: %s\n", file.path.c_str());
-            deleteFile(file.path);
-            scheduleDownload(file.url, file.path, file.checksum);
+        String path = file.formatPath(pathBuffer, sizeof(pathBuffer));
+        if (!fileExists(path)) {
+            Serial.printf("FileManager: Required file missing, scheduling download: %s\n", path.c_str());
+            scheduleDownload(file.url, path, file.checksum, DOWNLOAD_PRIORITY_REPAIR);
+        } else if (!file.checksum.isEmpty() && !verifyFileIntegrity(path, file.checksum)) {
+            Serial.printf("FileManager: Required file failed integrity check, re-downloading: %s\n", path.c_str());
+            deleteFile(path);
+            scheduleDownload(file.url, path, file.checksum, DOWNLOAD_PRIORITY_REPAIR);
         }
     }
 }
 
-std::vector<String> FileManager::getRequiredFilesByPattern(const String& pattern) {
-    std::vector<String> matchingFiles;
+std::vector<TrackId> FileManager::getRequiredTracksForFigure(uint32_t figureId) {
+    std::vector<TrackId> tracks;
     
     for (const auto& file : requiredFiles) {
-        if (file.path.indexOf(pattern) >= 0) {
-            matchingFiles.push_back(file.path);
+        if (file.track.isValid() && file.track.figure == figureId) {
+            tracks.push_back(file.track);
         }
     }
     
-    Serial.printf("FileManager: Found %d required files matching pattern: %s\n", 
-                  matchingFiles.size(), pattern.c_str());
-    return matchingFiles;
+    Serial.printf("FileManager: Found %d required tracks for figure: %u\n", 
+                  tracks.size(), (unsigned)figureId);
+    return tracks;
 }
 
 bool FileManager::createDirectoryStructure(const String& path) {
@@ -1036,14 +2519,9 @@ bool FileManager::createDirectoryStructure(const String& path) {
     }
     
     // Check if directory already exists
-    File dirFile = SD.open(dir);
-    if (dirFile && dirFile.isDirectory()) {
-        dirFile.close();
+    if (lookupEntry(dir) == SD_ENTRY_DIRECTORY) {
         return true;
     }
-    if (dirFile) {
-        dirFile.close();
-    }
     
     // Create directories recursively
     return createDirectoryRecursive(dir);
@@ -1055,14 +2533,9 @@ bool FileManager::createDirectoryRecursive(const String& path) {
     }
     
     // Check if directory already exists
-    File dirFile = SD.open(path);
-    if (dirFile && dirFile.isDirectory()) {
-        dirFile.close();
+    if (lookupEntry(path) == SD_ENTRY_DIRECTORY) {
         return true;
     }
-    if (dirFile) {
-        dirFile.close();
-    }
     
     // Find parent directory
     int lastSlash = path.lastIndexOf('/');
@@ -1076,17 +2549,22 @@ bool FileManager::createDirectoryRecursive(const String& path) {
     }
     
     // Now create this directory
-    bool success = SD.mkdir(path);
+    bool success = sdFs->mkdir(path);
     if (success) {
+        rememberEntry(path, SD_ENTRY_DIRECTORY);
         Serial.printf("FileManager: Created directory: %s\n", path.c_str());
     } else {
-        // Check if it exists now (might have been created by another process)
-        File dirFile = SD.open(path);
+        // The cached state said missing, so ask the card directly before giving up
+        File dirFile = sdFs->open(path);
         if (dirFile && dirFile.isDirectory()) {
             dirFile.close();
+            rememberEntry(path, SD_ENTRY_DIRECTORY);
             Serial.printf("FileManager: Directory already exists: %s\n", path.c_str());
             return true;
         }
+        if (dirFile) {
+            dirFile.close();
+        }
         Serial.printf("FileManager: Failed to create directory: %s\n", path.c_str());
     }
     
@@ -1114,7 +2592,7 @@ String FileManager::calculateFileChecksum(const String& filePath) {
     // Simple CRC32 checksum implementation
     // For production, consider using a more robust hash like SHA256
     
-    File file = SD.open(filePath);
+    File file = sdFs->open(filePath);
     if (!file) {
         return "";
     }
@@ -1142,25 +2620,44 @@ String FileManager::calculateFileChecksum(const String& filePath) {
     return String(crc, HEX);
 }
 
-size_t FileManager::getSDCardTotalSpace() {
+uint64_t FileManager::getSDCardTotalSpace() {
     if (!sdCardInitialized) {
         return 0;
     }
-    return SD.cardSize();
+    if (!spaceKnown) {
+        reconcileSpace();
+    }
+    return spaceTotal;
 }
 
-size_t FileManager::getSDCardUsedSpace() {
+uint64_t FileManager::getSDCardUsedSpace() {
     if (!sdCardInitialized) {
         return 0;
     }
-    return SD.usedBytes();
+    if (!spaceKnown) {
+        reconcileSpace();
+    }
+    return spaceUsed;
 }
 
-size_t FileManager::getSDCardFreeSpace() {
+uint64_t FileManager::getSDCardFreeSpace() {
     if (!sdCardInitialized) {
         return 0;
     }
-    return SD.cardSize() - SD.usedBytes();
+    if (!spaceKnown) {
+        reconcileSpace();
+    }
+    return spaceTotal > spaceUsed ? spaceTotal - spaceUsed : 0;
+}
+
+size_t FileManager::getFileSize(const String& path) {
+    // stat() reads the directory entry without opening the file
+    struct stat st;
+    String vfsPath = String(SD_MOUNT_POINT) + path;
+    if (stat(vfsPath.c_str(), &st) != 0 || S_ISDIR(st.st_mode)) {
+        return 0;
+    }
+    return st.st_size;
 }
 
 String FileManager::getSDCardInfo() {
@@ -1171,7 +2668,7 @@ String FileManager::getSDCardInfo() {
     String info = "SD Card Information:\n";
     info += "Type: ";
     
-    uint8_t cardType = SD.cardType();
+    uint8_t cardType = sdCardType();
     switch (cardType) {
         case CARD_MMC:
             info += "MMC\n";
@@ -1189,14 +2686,33 @@ String FileManager::getSDCardInfo() {
     
     info += "Total space: " + formatBytes(getSDCardTotalSpace()) + "\n";
     info += "Used space: " + formatBytes(getSDCardUsedSpace()) + "\n";
+    info += "Space accounting: reconciled " + String((millis() - lastSpaceReconcile) / 1000) + " s ago, last drift " +
+            String((long)lastSpaceDrift) + " bytes\n";
     info += "Free space: " + formatBytes(getSDCardFreeSpace()) + "\n";
     
     return info;
 }
 
-String FileManager::formatBytes(size_t bytes) {
+String FileManager::getSDCacheStatsString() {
+    String stats = "SD Entry Cache:\n";
+    stats += "Entries: " + String(sdEntryCache.size()) + " / " + String(SD_ENTRY_CACHE_MAX) + "\n";
+    stats += "Memory: " + formatBytes(sdEntryCache.capacity() * sizeof(SdEntryCacheItem)) + "\n";
+    stats += "Hits: " + String(sdCacheStats.hits) + "\n";
+    stats += "Misses (SD.open): " + String(sdCacheStats.misses) + "\n";
+    stats += "Flushes: " + String(sdCacheStats.flushes) + "\n";
+    
+    uint32_t lookups = sdCacheStats.hits + sdCacheStats.misses;
+    if (lookups > 0) {
+        float hitRate = (float)sdCacheStats.hits / lookups * 100;
+        stats += "Hit rate: " + String(hitRate, 1) + "%\n";
+    }
+    
+    return stats;
+}
+
+String FileManager::formatBytes(uint64_t bytes) {
     if (bytes < 1024) {
-        return String(bytes) + " B";
+        return String((uint32_t)bytes) + " B";
     } else if (bytes < 1024 * 1024) {
         return String(bytes / 1024.0, 2) + " KB";
     } else if (bytes < 1024 * 1024 * 1024) {
@@ -1207,20 +2723,31 @@ String FileManager::formatBytes(size_t bytes) {
 }
 
 void FileManager::printDownloadQueue() {
-    Serial.printf("Download queue (%d items):\n", downloadQueue.size());
-    
-    for (size_t i = 0; i < downloadQueue.size(); i++) {
-        const auto& task = downloadQueue[i];
-        Serial.printf("  %d. %s -> %s\n", i + 1, task.url.c_str(), task.localPath.c_str());
-        Serial.printf("      Batch: %d/%d, Attempt: %d/%d, Completed: %s\n", 
-                      task.retryBatch + 1, MAX_RETRY_BATCHES,
-                      task.retryCount, MAX_RETRY_COUNT,
-                      task.completed ? "yes" : "no");
-        
-        if (!task.completed && task.retryCount >= MAX_RETRY_COUNT && task.lastBatchAttempt > 0) {
-            unsigned long timeLeft = RETRY_BATCH_DELAY_MS - (millis() - task.lastBatchAttempt);
-            if (timeLeft > 0) {
-                Serial.printf("      Waiting %lu seconds before next batch\n", timeLeft / 1000);
+    static const char* priorityNames[] = {"next track", "docked", "prefetch", "repair"};
+    Serial.printf("Download queue (%u items):\n", queuedDownloadCount());
+    
+    if (downloadInProgress) {
+        Serial.printf("  Downloading [%s]: %s (%d/%d bytes%s)\n", priorityNames[session.task.priority],
+                      session.task.localPath.c_str(), session.totalDownloaded, session.contentLength,
+                      session.resumedFrom > 0 ? ", resumed" : "");
+    }
+    
+    int index = 0;
+    for (int priority = 0; priority < DOWNLOAD_PRIORITY_COUNT; priority++) {
+        for (const auto& task : downloadQueues[priority]) {
+            Serial.printf("  %d. [%s] %s -> %s\n", ++index, priorityNames[priority], task.url.c_str(), task.localPath.c_str());
+            Serial.printf("      Attempt: %d/%d, Completed: %s\n", 
+                          task.retryCount, MAX_DOWNLOAD_ATTEMPTS,
+                          task.completed ? "yes" : "no");
+            
+            if (task.resumeOffset > 0) {
+                Serial.printf("      Suspended at %u bytes, resumes with a range request\n", task.resumeOffset);
+            }
+            if (!task.completed && task.nextAttemptAt != 0) {
+                long timeLeft = (long)(task.nextAttemptAt - millis());
+                if (timeLeft > 0) {
+                    Serial.printf("      Backing off, next attempt in %ld seconds\n", timeLeft / 1000);
+                }
             }
         }
     }
@@ -1229,11 +2756,13 @@ void FileManager::printDownloadQueue() {
 void FileManager::printRequiredFiles() {
     Serial.printf("Required files (%d items):\n", requiredFiles.size());
     
+    char pathBuffer[TrackId::PATH_MAX_LEN];
     for (size_t i = 0; i < requiredFiles.size(); i++) {
         const auto& file = requiredFiles[i];
-        bool exists = fileExists(file.path);
+        const char* path = file.formatPath(pathBuffer, sizeof(pathBuffer));
+        bool exists = fileExists(path);
         Serial.printf("  %d. %s (exists: %s)\n", 
-                      i + 1, file.path.c_str(), exists ? "yes" : "no");
+                      i + 1, path, exists ? "yes" : "no");
     }
 }
 
@@ -1249,6 +2778,35 @@ String FileManager::getDownloadStatsString() {
         stats += "Success rate: " + String(successRate, 1) + "%\n";
     }
     
+    if (downloadRate.samples > 0) {
+        stats += "Estimated throughput: " + String(downloadRate.avgKBps, 1) + " KB/s (" + String(downloadRate.samples) + " samples)\n";
+    } else {
+        stats += "Estimated throughput: not measured yet\n";
+    }
+    stats += "Average time to first byte: " + String(downloadRate.avgTtfbMs, 0) + " ms\n";
+    stats += "Chunk size: " + formatBytes(downloadRate.chunkSize) + "\n";
+    if (downloadRate.lastBytes > 0) {
+        stats += "Last download: " + formatBytes(downloadRate.lastBytes) + " in " + String(downloadRate.lastDurationMs) +
+                 " ms (" + String(downloadRate.lastKBps, 1) + " KB/s, TTFB " + String(downloadRate.lastTtfbMs) + " ms)\n";
+    }
+    stats += "Idle polls: " + String(downloadRate.idleWaits) + "\n";
+    stats += "Compression: " + String(ConfigManager::getInstance().getInt("download_compression", 0) ? "gzip/deflate when heap allows" : "off") + "\n";
+    
+    stats += "Connectivity: " + String(!lastTransferFailed ? "last transfer OK" : (lastProbeOk ? "probe OK" : "offline")) + "\n";
+    for (const auto& circuit : hostCircuits) {
+        stats += "Host " + circuit.host + ": ";
+        if (!circuit.open) {
+            stats += "closed, " + String(circuit.consecutiveFailures) + " recent failures\n";
+        } else {
+            long wait = (long)(circuit.openMs - (millis() - circuit.openedAt));
+            if (wait > 0) {
+                stats += "open for " + String(wait / 1000) + " s more\n";
+            } else {
+                stats += "half-open, next download is the trial\n";
+            }
+        }
+    }
+    
     return stats;
 }
 
@@ -1258,17 +2816,19 @@ bool FileManager::saveDownloadQueue() {
     // In production, consider using a more efficient binary format
     
     String json = "[";
-    for (size_t i = 0; i < downloadQueue.size(); i++) {
-        if (i > 0) json += ",";
-        const auto& task = downloadQueue[i];
-        json += "{\"url\":\"" + task.url + "\",";
-        json += "\"path\":\"" + task.localPath + "\",";
-        json += "\"retries\":" + String(task.retryCount) + ",";
-        json += "\"retryBatch\":" + String(task.retryBatch) + ",";
-        json += "\"completed\":" + String(task.completed ? "true" : "false") + ",";
-        json += "\"lastAttempt\":" + String(task.lastAttempt) + ",";
-        json += "\"lastBatchAttempt\":" + String(task.lastBatchAttempt) + ",";
-        json += "\"checksum\":\"" + task.checksum + "\"}";
+    bool first = true;
+    for (int priority = 0; priority < DOWNLOAD_PRIORITY_COUNT; priority++) {
+        for (const auto& task : downloadQueues[priority]) {
+            if (!first) json += ",";
+            first = false;
+            json += "{\"url\":\"" + task.url + "\",";
+            json += "\"path\":\"" + task.localPath + "\",";
+            json += "\"priority\":" + String(priority) + ",";
+            json += "\"retries\":" + String(task.retryCount) + ",";
+            json += "\"completed\":" + String(task.completed ? "true" : "false") + ",";
+            json += "\"lastAttempt\":" + String(task.lastAttempt) + ",";
+            json += "\"checksum\":\"" + task.checksum + "\"}";
+        }
     }
     json += "]";
     
@@ -1307,7 +2867,9 @@ bool FileManager::loadDownloadQueue() {
     
     // Parse JSON and populate download queue
     // This is a simplified parser - in production, use ArduinoJson
-    downloadQueue.clear();
+    for (int priority = 0; priority < DOWNLOAD_PRIORITY_COUNT; priority++) {
+        downloadQueues[priority].clear();
+    }
     
     free(json_str);
     return true;
@@ -1316,10 +2878,13 @@ bool FileManager::loadDownloadQueue() {
 bool FileManager::saveRequiredFiles() {
     // Save required files as JSON string, similar to download queue
     String json = "[";
+    char pathBuffer[TrackId::PATH_MAX_LEN];
     for (size_t i = 0; i < requiredFiles.size(); i++) {
         if (i > 0) json += ",";
         const auto& file = requiredFiles[i];
-        json += "{\"path\":\"" + file.path + "\",";
+        json += "{\"path\":\"";
+        json += file.formatPath(pathBuffer, sizeof(pathBuffer));
+        json += "\",";
         json += "\"url\":\"" + file.url + "\",";
         json += "\"required\":" + String(file.required ? "true" : "false") + ",";
         json += "\"checksum\":\"" + file.checksum + "\"}";
@@ -1406,7 +2971,7 @@ bool FileManager::loadRequiredFiles() {
                     int pathStart = objStr.indexOf("\"path\":\"") + 8;
                     int pathEnd = objStr.indexOf("\"", pathStart);
                     if (pathStart > 7 && pathEnd > pathStart) {
-                        entry.path = objStr.substring(pathStart, pathEnd);
+                        entry.setPath(objStr.substring(pathStart, pathEnd));
                     }
                     
                     // Extract url
@@ -1426,7 +2991,7 @@ bool FileManager::loadRequiredFiles() {
                     // Set required to true (we only store required files)
                     entry.required = true;
                     
-                    if (!entry.path.isEmpty() && !entry.url.isEmpty()) {
+                    if ((entry.track.isValid() || !entry.path.isEmpty()) && !entry.url.isEmpty()) {
                         requiredFiles.push_back(entry);
                     }
                 }
@@ -1467,11 +3032,142 @@ bool FileManager::loadDownloadStats() {
     return true;
 }
 
-// Callback setters
-void FileManager::setDownloadProgressCallback(DownloadProgressCallback callback) {
-    downloadProgressCallback = callback;
+bool FileManager::saveCommitLog() {
+    esp_err_t err;
+    if (commitLogCount == 0) {
+        err = nvs_erase_key(nvsHandle, NVS_COMMIT_LOG_KEY);
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            err = ESP_OK;
+        }
+    } else {
+        err = nvs_set_blob(nvsHandle, NVS_COMMIT_LOG_KEY, commitLog, commitLogCount * sizeof(CommitIntent));
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(nvsHandle);
+    }
+    if (err != ESP_OK) {
+        Serial.printf("FileManager: Failed to save commit log: %s\n", esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+void FileManager::logCommitIntent(const String& path, CommitState state, uint32_t size) {
+    if (path.length() >= COMMIT_PATH_MAX) {
+        return;
+    }
+    
+    size_t index = 0;
+    while (index < commitLogCount && strcmp(commitLog[index].path, path.c_str()) != 0) {
+        index++;
+    }
+    if (index < commitLogCount) {
+        if (commitLog[index].state == state && commitLog[index].size == size) {
+            return; // A resumed attempt, already logged
+        }
+    } else {
+        if (commitLogCount == COMMIT_LOG_SLOTS) {
+            // Most likely a temp file removed on a path that does not clear its intent
+            memmove(commitLog, commitLog + 1, (COMMIT_LOG_SLOTS - 1) * sizeof(CommitIntent));
+            commitLogCount--;
+        }
+        index = commitLogCount++;
+        memset(&commitLog[index], 0, sizeof(CommitIntent));
+        strncpy(commitLog[index].path, path.c_str(), COMMIT_PATH_MAX - 1);
+    }
+    commitLog[index].state = state;
+    commitLog[index].size = size;
+    saveCommitLog();
+}
+
+void FileManager::clearCommitIntent(const String& path) {
+    for (size_t i = 0; i < commitLogCount; i++) {
+        if (strcmp(commitLog[i].path, path.c_str()) == 0) {
+            memmove(commitLog + i, commitLog + i + 1, (commitLogCount - i - 1) * sizeof(CommitIntent));
+            commitLogCount--;
+            saveCommitLog();
+            return;
+        }
+    }
+}
+
+void FileManager::recoverCommits() {
+    size_t size = sizeof(commitLog);
+    esp_err_t err = nvs_get_blob(nvsHandle, NVS_COMMIT_LOG_KEY, commitLog, &size);
+    commitLogCount = 0;
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return; // Clean shutdown or nothing was downloading
+    }
+    if (err != ESP_OK || size % sizeof(CommitIntent) != 0) {
+        Serial.printf("FileManager: Commit log unreadable (%s), leaving it to the periodic check\n",
+                      esp_err_to_name(err));
+        saveCommitLog();
+        return;
+    }
+    
+    unsigned long start = millis();
+    size_t entries = size / sizeof(CommitIntent);
+    int published = 0;
+    int dropped = 0;
+    int rescheduled = 0;
+    for (size_t i = 0; i < entries; i++) {
+        CommitIntent& intent = commitLog[i];
+        intent.path[COMMIT_PATH_MAX - 1] = '\0';
+        String path = intent.path;
+        String tempPath = path + ".tmp";
+        
+        long tempSize = -1;
+        File temp = sdFs->open(tempPath);
+        if (temp) {
+            tempSize = temp.size();
+            temp.close();
+        }
+        
+        if (intent.state == COMMIT_PUBLISHING && tempSize == (long)intent.size) {
+            // Cut off before or halfway through the rename: the new copy is whole, so finish it
+            if (replaceFile(tempPath, path)) {
+                Serial.printf("FileManager: Recovered %s from its completed download\n", path.c_str());
+                published++;
+                continue;
+            }
+        }
+        
+        if (tempSize >= 0) {
+            // An interrupted transfer; how much of its length was really written is unknown
+            sdFs->remove(tempPath);
+            rememberEntry(tempPath, SD_ENTRY_MISSING);
+            dropped++;
+        } else if (intent.state == COMMIT_PUBLISHING && lookupEntry(path) == SD_ENTRY_FILE) {
+            // The rename went through; a final copy of another length did not survive intact
+            File finalFile = sdFs->open(path);
+            size_t finalSize = finalFile ? finalFile.size() : 0;
+            finalFile.close();
+            if (finalSize != intent.size) {
+                Serial.printf("FileManager: %s is %u bytes, %u expected, removing it\n", path.c_str(),
+                              (unsigned)finalSize, (unsigned)intent.size);
+                sdFs->remove(path);
+                rememberEntry(path, SD_ENTRY_MISSING);
+            }
+        }
+        
+        // Queue the file again now rather than at the next periodic check
+        if (lookupEntry(path) != SD_ENTRY_FILE) {
+            for (const auto& file : requiredFiles) {
+                if (file.matchesPath(path)) {
+                    scheduleDownload(file.url, path, file.checksum, DOWNLOAD_PRIORITY_REPAIR);
+                    rescheduled++;
+                    break;
+                }
+            }
+        }
+    }
+    
+    saveCommitLog();
+    Serial.printf("FileManager: Commit recovery: %u pending, %d published, %d partial files dropped, %d rescheduled in %lu ms\n",
+                  (unsigned)entries, published, dropped, rescheduled, millis() - start);
 }
 
+// Callback setters
 void FileManager::setDownloadCompleteCallback(DownloadCompleteCallback callback) {
     downloadCompleteCallback = callback;
 }
@@ -1482,43 +3178,198 @@ void FileManager::setFileSystemEventCallback(FileSystemEventCallback callback) {
 
 // Additional utility methods
 void FileManager::cancelAllDownloads() {
-    downloadQueue.clear();
+    abortDownload();
+    for (int priority = 0; priority < DOWNLOAD_PRIORITY_COUNT; priority++) {
+        for (const auto& task : downloadQueues[priority]) {
+            if (task.resumeOffset > 0) {
+                deleteFile(task.localPath + ".tmp");
+            }
+        }
+        downloadQueues[priority].clear();
+    }
     saveDownloadQueue();
     Serial.println("FileManager: All downloads cancelled");
 }
 
 void FileManager::retryFailedDownloads() {
-    for (auto& task : downloadQueue) {
-        if (!task.completed) {
-            task.retryCount = 0; // Reset retry count within current batch
-            task.retryBatch = 0; // Reset to first batch
-            task.lastAttempt = 0; // Reset last attempt time
-            task.lastBatchAttempt = 0; // Reset batch attempt time
+    for (int priority = 0; priority < DOWNLOAD_PRIORITY_COUNT; priority++) {
+        for (auto& task : downloadQueues[priority]) {
+            if (!task.completed) {
+                task.retryCount = 0; // Reset attempt count
+                task.lastAttempt = 0; // Reset last attempt time
+                task.nextAttemptAt = 0; // Drop any backoff
+            }
         }
     }
+    // A manual retry also overrides open circuits and the cached connectivity state
+    hostCircuits.clear();
+    lastTransferFailed = false;
     saveDownloadQueue();
     Serial.println("FileManager: All failed downloads reset for retry");
 }
 
 int FileManager::getPendingDownloadsCount() {
-    int count = 0;
-    for (const auto& task : downloadQueue) {
-        if (!task.completed) {
-            count++;
+    int count = downloadInProgress ? 1 : 0;
+    for (int priority = 0; priority < DOWNLOAD_PRIORITY_COUNT; priority++) {
+        for (const auto& task : downloadQueues[priority]) {
+            if (!task.completed) {
+                count++;
+            }
         }
     }
     return count;
 }
 
-void FileManager::cleanupTempFiles() {
-    std::vector<String> tempFiles = listFiles("/temp");
-    for (const auto& file : tempFiles) {
-        String fullPath = "/temp/" + file;
-        if (file.endsWith(".tmp") || file.endsWith(".partial")) {
-            deleteFile(fullPath);
-            Serial.printf("FileManager: Cleaned up temp file: %s\n", fullPath.c_str());
+uint64_t FileManager::cleanupTempFiles() {
+    if (!sdCardInitialized) {
+        return 0;
+    }
+    
+    // Downloads, manifests and catalogue entries all write their .tmp beside the
+    // target, so the whole card is walked, not just /temp
+    uint32_t removed = 0;
+    uint64_t bytesFreed = 0;
+    std::vector<String> pending(1, "/");
+    while (!pending.empty()) {
+        String directory = pending.back();
+        pending.pop_back();
+        sweepTempFiles(directory, pending, removed, bytesFreed);
+    }
+    Serial.printf("FileManager: %u temp files removed, %s freed\n", removed, formatBytes(bytesFreed).c_str());
+    return bytesFreed;
+}
+
+void FileManager::sweepTempFiles(const String& directory, std::vector<String>& pending, uint32_t& removed,
+                                 uint64_t& bytesFreed, std::vector<String>* files) {
+    String prefix = directory.endsWith("/") ? directory : directory + "/";
+    for (const auto& name : listFiles(directory)) {
+        if (name.endsWith("/")) {
+            pending.push_back(prefix + name.substring(0, name.length() - 1));
+            continue;
+        }
+        String fullPath = prefix + name;
+        if (!(name.endsWith(".tmp") || name.endsWith(".partial"))) {
+            if (files != nullptr) {
+                files->push_back(fullPath);
+            }
+            continue;
+        }
+        if (isTempFileInUse(fullPath)) {
+            continue;
+        }
+        size_t size = getFileSize(fullPath);
+        if (deleteFile(fullPath)) {
+            removed++;
+            bytesFreed += size;
+        }
+    }
+}
+
+bool FileManager::isTempFileInUse(const String& tempPath) {
+    if (!tempPath.endsWith(".tmp")) {
+        return false;
+    }
+    String target = tempPath.substring(0, tempPath.length() - 4);
+    if (downloadInProgress && session.tempPath == tempPath) {
+        return true;
+    }
+    for (const auto& queue : downloadQueues) {
+        for (const auto& task : queue) {
+            if (task.localPath == target) {
+                return true; // May resume from it
+            }
+        }
+    }
+    for (size_t i = 0; i < commitLogCount; i++) {
+        if (target == commitLog[i].path) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FileManager::countFragments(const String& path, uint32_t& fragments, uint32_t& clusters) {
+    fragments = 0;
+    clusters = 0;
+    if (!sdCardInitialized) {
+        return false;
+    }
+    
+    // The VFS hides cluster chains, so the file is opened through FatFs directly. FIL
+    // carries a sector buffer, too big for the loop task's stack.
+    FIL* fil = (FIL*)malloc(sizeof(FIL));
+    if (fil == nullptr) {
+        return false;
+    }
+    String fatPath = String(SD_FATFS_DRIVE) + path;
+    if (f_open(fil, fatPath.c_str(), FA_READ) != FR_OK) {
+        free(fil);
+        return false;
+    }
+    FATFS* fs = fil->obj.fs;
+#if FF_MAX_SS != FF_MIN_SS
+    FSIZE_t clusterBytes = (FSIZE_t)fs->csize * fs->ssize;
+#else
+    FSIZE_t clusterBytes = (FSIZE_t)fs->csize * FF_MAX_SS;
+#endif
+    
+    // Seeking to the end of each cluster in turn leaves fil->clust on it; FatFs follows
+    // the chain forward from the last position, so this is one FAT lookup per cluster
+    FSIZE_t size = f_size(fil);
+    DWORD previous = 0;
+    bool ok = true;
+    for (FSIZE_t end = clusterBytes; end < size + clusterBytes; end += clusterBytes) {
+        if (f_lseek(fil, end < size ? end : size) != FR_OK) {
+            ok = false;
+            break;
+        }
+        if (fil->clust != previous + 1) {
+            fragments++;
         }
+        previous = fil->clust;
+        clusters++;
+    }
+    f_close(fil);
+    free(fil);
+    return ok;
+}
+
+File FileManager::beginRewrite(const String& path, size_t size) {
+    String tempPath = path + ".tmp";
+    logCommitIntent(path, COMMIT_WRITING, size);
+    File file = openFile(tempPath, FILE_WRITE);
+    if (file && preallocateFile(file, size)) {
+        accountSpace(0, size);
+        return file;
+    }
+    if (file) {
+        file.close();
     }
+    deleteFile(tempPath);
+    clearCommitIntent(path);
+    return File();
+}
+
+bool FileManager::finishRewrite(const String& path, size_t size, bool keep) {
+    String tempPath = path + ".tmp";
+    bool published = false;
+    if (keep && getFileSize(tempPath) == size) {
+        logCommitIntent(path, COMMIT_PUBLISHING, size);
+        published = replaceFile(tempPath, path);
+    }
+    // replaceFile() took the old copy off; the new one goes back where finishDownload() put it
+    TrackId track;
+    uint64_t blobKey;
+    if (published && TrackId::fromPath(path, track)) {
+        StorageManager::getInstance().onFileAdded(track.figure, size);
+    } else if (published && BlobStore::keyFromPath(path.c_str(), blobKey)) {
+        BlobStore::getInstance().onBlobAdded(blobKey, size);
+    }
+    if (!published) {
+        deleteFile(tempPath);
+    }
+    clearCommitIntent(path);
+    return published;
 }
 
 void FileManager::resetDownloadStats() {
@@ -1531,7 +3382,11 @@ void FileManager::resetDownloadStats() {
 }
 
 bool FileManager::removeDirectory(const String& path) {
-    bool success = SD.rmdir(path);
+    bool success = sdFs->rmdir(path);
+    if (success) {
+        // rmdir only succeeds on empty directories, so no children need invalidating
+        rememberEntry(path, SD_ENTRY_MISSING);
+    }
     
     if (fileSystemEventCallback) {
         fileSystemEventCallback("rmdir", path, success);
@@ -1550,7 +3405,7 @@ void FileManager::printFileTree() {
     Serial.println("=== SD Card File Tree ===");
 
     std::function<void(const String&, int)> printTree = [&](const String& dir, int depth) {
-        File dirFile = SD.open(dir);
+        File dirFile = sdFs->open(dir);
         if (!dirFile || !dirFile.isDirectory()) {
             if (dirFile) dirFile.close();
             return;
@@ -1592,7 +3447,7 @@ void FileManager::formatSDCard() {
 
     // Remove all files and directories recursively
     std::function<void(const String&)> removeAll = [&](const String& dir) {
-        File dirFile = SD.open(dir);
+        File dirFile = sdFs->open(dir);
         if (!dirFile) return;
         File entry = dirFile.openNextFile();
         while (entry) {
@@ -1603,13 +3458,13 @@ void FileManager::formatSDCard() {
                 if (!subDir.endsWith("/")) subDir += "/";
                 subDir += entryName;
                 removeAll(subDir);
-                SD.rmdir(subDir);
+                sdFs->rmdir(subDir);
             } else {
                 entry.close();
                 String filePath = dir;
                 if (!filePath.endsWith("/")) filePath += "/";
                 filePath += entryName;
-                SD.remove(filePath);
+                sdFs->remove(filePath);
             }
             entry = dirFile.openNextFile();
         }
@@ -1617,6 +3472,8 @@ void FileManager::formatSDCard() {
     };
 
     removeAll("/");
+    clearEntryCache();
+    spaceKnown = false;
 
     // Optionally recreate standard directories
     createDirectory("/audio");
@@ -1635,17 +3492,19 @@ void FileManager::clearAllRequiredFiles() {
     int filesNotFound = 0;
     
     // Delete files based on required files list
+    char pathBuffer[TrackId::PATH_MAX_LEN];
     for (const auto& file : requiredFiles) {
-        if (fileExists(file.path)) {
-            if (deleteFile(file.path)) {
+        String path = file.formatPath(pathBuffer, sizeof(pathBuffer));
+        if (fileExists(path)) {
+            if (deleteFile(path)) {
                 filesDeleted++;
-                Serial.printf("Deleted: %s\n", file.path.c_str());
+                Serial.printf("Deleted: %s\n", path.c_str());
             } else {
-                Serial.printf("Failed to delete: %s\n", file.path.c_str());
+                Serial.printf("Failed to delete: %s\n", path.c_str());
             }
         } else {
             filesNotFound++;
-            Serial.printf("File not found: %s\n", file.path.c_str());
+            Serial.printf("File not found: %s\n", path.c_str());
         }
     }
     
@@ -1654,8 +3513,7 @@ void FileManager::clearAllRequiredFiles() {
     saveRequiredFiles();
     
     // Also clear download queue
-    downloadQueue.clear();
-    saveDownloadQueue();
+    cancelAllDownloads();
     
     Serial.printf("FileManager: Cleared all required files. Deleted %d files, %d were already missing.\n", 
                  filesDeleted, filesNotFound);
@@ -1664,15 +3522,28 @@ void FileManager::clearAllRequiredFiles() {
 bool FileManager::deleteFigureFiles(const String& figureId) {
     Serial.printf("FileManager: Deleting all files for figure ID: %s\n", figureId.c_str());
     
+    unsigned long startTime = millis();
     String figureDir = "/figures/" + figureId;
-    int filesDeleted = 0;
+    String figurePrefix = figureDir + "/";
+    uint32_t numericFigureId = strtoul(figureId.c_str(), nullptr, 10);
     int requiredFilesRemoved = 0;
+    int downloadsRemoved = 0;
+    
+    // Shared audio the figure was the last user of goes with it, in the same passes as
+    // its own files; needs the manifest, so before the walk
+    std::vector<String> releasedBlobs;
+    BlobStore::getInstance().releaseFigure(numericFigureId, releasedBlobs);
+    std::sort(releasedBlobs.begin(), releasedBlobs.end());
+    auto isReleasedBlob = [&releasedBlobs](const String& path) {
+        return std::binary_search(releasedBlobs.begin(), releasedBlobs.end(), path);
+    };
     
     // Remove files from required files list that belong to this figure
     auto it = requiredFiles.begin();
     while (it != requiredFiles.end()) {
-        if (it->path.startsWith(figureDir)) {
-            Serial.printf("Removing from required list: %s\n", it->path.c_str());
+        bool belongsToFigure = it->track.isValid() ? (it->track.figure == numericFigureId)
+                                                   : it->path.startsWith(figurePrefix) || isReleasedBlob(it->path);
+        if (belongsToFigure) {
             it = requiredFiles.erase(it);
             requiredFilesRemoved++;
         } else {
@@ -1680,43 +3551,131 @@ bool FileManager::deleteFigureFiles(const String& figureId) {
         }
     }
     
-    // Remove from download queue as well
-    auto queueIt = downloadQueue.begin();
-    while (queueIt != downloadQueue.end()) {
-        if (queueIt->localPath.startsWith(figureDir)) {
-            Serial.printf("Removing from download queue: %s\n", queueIt->localPath.c_str());
-            queueIt = downloadQueue.erase(queueIt);
-        } else {
-            ++queueIt;
+    // Remove from download queue as well, including a transfer in flight; partial files
+    // and their commit intents go with the directory below, or with the blobs
+    std::vector<String> blobPartials;
+    if (downloadInProgress && (session.task.localPath.startsWith(figurePrefix) || isReleasedBlob(session.task.localPath))) {
+        abortDownload();
+        downloadsRemoved++;
+    }
+    for (int priority = 0; priority < DOWNLOAD_PRIORITY_COUNT; priority++) {
+        std::deque<DownloadTask>& queue = downloadQueues[priority];
+        auto queueIt = queue.begin();
+        while (queueIt != queue.end()) {
+            bool blob = isReleasedBlob(queueIt->localPath);
+            if (queueIt->localPath.startsWith(figurePrefix) || blob) {
+                if (blob && queueIt->resumeOffset > 0) {
+                    blobPartials.push_back(queueIt->localPath + ".tmp");
+                }
+                queueIt = queue.erase(queueIt);
+                downloadsRemoved++;
+            } else {
+                ++queueIt;
+            }
+        }
+    }
+    size_t intentsKept = 0;
+    for (size_t i = 0; i < commitLogCount; i++) {
+        if (strncmp(commitLog[i].path, figurePrefix.c_str(), figurePrefix.length()) != 0 &&
+            !isReleasedBlob(commitLog[i].path)) {
+            commitLog[intentsKept++] = commitLog[i];
         }
     }
+    if (intentsKept != commitLogCount) {
+        commitLogCount = intentsKept;
+        saveCommitLog();
+    }
     
-    // Delete the entire figure directory from storage
-    if (fileExists(figureDir)) {
-        // List all files in the figure directory recursively and delete them
-        std::vector<String> allFiles = listFiles(figureDir);
-        for (const String& file : allFiles) {
-            String fullPath = figureDir + "/" + file;
-            if (deleteFile(fullPath)) {
-                filesDeleted++;
-                Serial.printf("Deleted file: %s\n", fullPath.c_str());
-            }
+    // Delete the entire figure directory from storage in one walk
+    uint32_t filesDeleted = 0;
+    uint64_t bytesFreed = 0;
+    bool removed = true;
+    if (sdCardInitialized && lookupEntry(figureDir) == SD_ENTRY_DIRECTORY) {
+        removed = removeTree(figureDir, filesDeleted, bytesFreed);
+        if (fileSystemEventCallback) {
+            fileSystemEventCallback("delete_tree", figureDir, removed);
         }
-        
-        // Try to remove the directory structure
-        if (removeDirectory(figureDir)) {
-            Serial.printf("Removed directory: %s\n", figureDir.c_str());
+        if (!removed) {
+            Serial.printf("FileManager: Failed to remove everything under %s\n", figureDir.c_str());
         }
     } else {
         Serial.printf("Figure directory does not exist: %s\n", figureDir.c_str());
     }
     
-    // Save updated required files and download queue
-    saveRequiredFiles();
-    saveDownloadQueue();
+    // Released blobs and their partial downloads live outside the figure's directory
+    releasedBlobs.insert(releasedBlobs.end(), blobPartials.begin(), blobPartials.end());
+    for (const auto& blobPath : releasedBlobs) {
+        size_t size = getFileSize(blobPath);
+        if (sdCardInitialized && sdFs->remove(blobPath)) {
+            rememberEntry(blobPath, SD_ENTRY_MISSING);
+            accountSpace(size, 0);
+            bytesFreed += size;
+            filesDeleted++;
+        }
+    }
     
-    Serial.printf("FileManager: Figure deletion complete. Removed %d required file entries, deleted %d files.\n", 
-                 requiredFilesRemoved, filesDeleted);
+    // Metadata is saved once for the whole figure
+    if (requiredFilesRemoved > 0) {
+        saveRequiredFiles();
+    }
+    if (downloadsRemoved > 0) {
+        saveDownloadQueue();
+    }
     
-    return true;
+    Serial.printf("FileManager: Figure deletion complete. Removed %d required file entries and %d downloads, "
+                  "deleted %u files, freed %s in %lu ms\n",
+                  requiredFilesRemoved, downloadsRemoved, filesDeleted, formatBytes(bytesFreed).c_str(),
+                  millis() - startTime);
+    
+    StorageManager::getInstance().onFigureDeleted(numericFigureId);
+    return removed;
+}
+
+bool FileManager::removeTree(const String& path, uint32_t& filesDeleted, uint64_t& bytesFreed) {
+    // POSIX directory calls through the VFS: readdir reports the entry type, where
+    // File::openNextFile() would open every file just to ask
+    String vfsPath = String(SD_MOUNT_POINT) + path;
+    DIR* dir = opendir(vfsPath.c_str());
+    if (dir == nullptr) {
+        return false;
+    }
+    
+    // Files go while the listing is open; subdirectories are entered once it is closed
+    bool ok = true;
+    std::vector<String> subdirs;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        String child = path + "/" + entry->d_name;
+        if (entry->d_type == DT_DIR) {
+            subdirs.push_back(child);
+            continue;
+        }
+        // The size comes from the directory entry, so the space counters stay current
+        // without walking the whole card afterwards
+        String vfsChild = String(SD_MOUNT_POINT) + child;
+        struct stat st;
+        size_t size = stat(vfsChild.c_str(), &st) == 0 ? st.st_size : 0;
+        if (unlink(vfsChild.c_str()) == 0) {
+            rememberEntry(child, SD_ENTRY_MISSING);
+            accountSpace(size, 0);
+            bytesFreed += size;
+            filesDeleted++;
+        } else {
+            ok = false;
+        }
+    }
+    closedir(dir);
+    
+    for (const String& subdir : subdirs) {
+        ok = removeTree(subdir, filesDeleted, bytesFreed) && ok;
+    }
+    
+    if (ok && sdFs->rmdir(path)) {
+        rememberEntry(path, SD_ENTRY_MISSING);
+        return true;
+    }
+    return false;
 }
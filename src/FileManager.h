@@ -2,30 +2,113 @@
 #define FILEMANAGER_H
 
 #include <Arduino.h>
+#include <FS.h>
 #include <SD.h>
+#include <SD_MMC.h>
 #include <WiFi.h>
 #include <nvs_flash.h>
 #include <nvs.h>
 #include <vector>
+#include <deque>
 #include <map>
+#include <atomic>
+#include "TrackId.h"
+#include "HttpResponseParser.h"
+#include "StreamInflater.h"
 
 
+// Physical bus the SD card is mounted on
+enum SdBusMode : uint8_t {
+    SD_BUS_NONE = 0,
+    SD_BUS_SPI,
+    SD_BUS_SDMMC_1BIT,
+    SD_BUS_SDMMC_4BIT
+};
+
+// Result of FileManager::benchmarkBus(), kept so it can be reported upstream
+struct SdBenchResult {
+    static const int BLOCK_SIZE_COUNT = 3;
+    
+    bool valid;
+    SdBusMode busMode;
+    uint32_t blockSizes[BLOCK_SIZE_COUNT];
+    float seqWriteKBps[BLOCK_SIZE_COUNT];
+    float seqReadKBps[BLOCK_SIZE_COUNT];
+    float randReadIops;            // 4KB reads at random offsets
+    uint32_t writeLatencyUs[4];    // 4KB writes: p50, p95, p99, max
+    uint32_t randReadLatencyUs[4]; // 4KB random reads: p50, p95, p99, max
+    unsigned long timestamp;       // millis() when the run finished
+};
+
+// Download urgency, most urgent first. Each class is served FIFO, and a transfer is
+// suspended between chunks when a more urgent task becomes ready.
+enum DownloadPriority : uint8_t {
+    DOWNLOAD_PRIORITY_NEXT_TRACK = 0, // The docked figure's next track to play
+    DOWNLOAD_PRIORITY_DOCKED,         // The rest of the docked figure
+    DOWNLOAD_PRIORITY_PREFETCH,       // Figures that may be docked later, and undocked ones
+    DOWNLOAD_PRIORITY_REPAIR,         // Required files the periodic check found missing
+    DOWNLOAD_PRIORITY_COUNT
+};
+
 struct DownloadTask {
     String url;
+    String host; // Parsed from url when queued, empty for an invalid URL; keys the host circuit
     String localPath;
-    int retryCount;
-    int retryBatch; // Track which batch of retries we're on
+    int retryCount; // Attempts made so far
     bool completed;
     unsigned long lastAttempt;
-    unsigned long lastBatchAttempt; // Track when the last retry batch was attempted
+    unsigned long nextAttemptAt; // millis() before which the task is not retried, 0 = ready
     String checksum; // Optional for file integrity verification
+    DownloadPriority priority;
+    size_t resumeOffset; // Bytes already in <localPath>.tmp from a suspended attempt
+};
+
+// Snapshot of the transfer in flight, see FileManager::getDownloadProgress()
+struct DownloadProgress {
+    uint32_t taskId;         // FileManager::downloadIdFor(localPath), 0 = nothing downloading
+    uint32_t bytes;          // Including what a resumed attempt started with
+    uint32_t total;          // 0 = unknown (chunked or compressed)
+    uint32_t bytesPerSecond; // Over the last rate window, or since the start until one closes
+    uint32_t etaMs;          // 0 = unknown
+    uint16_t queued;         // Tasks waiting behind it
+    uint8_t priority;        // DownloadPriority
 };
 
 struct FileEntry {
-    String path;
+    TrackId track; // Set for figure tracks, the path is formatted from it on demand
+    String path;   // Only used for files outside the /figures/<fig>/<ep>/<track>.wav layout
     String url;
     bool required;
     String checksum; // Optional for file integrity verification
+
+    void setPath(const String& localPath) {
+        if (TrackId::fromPath(localPath, track)) {
+            path = "";
+        } else {
+            track = TrackId();
+            path = localPath;
+        }
+    }
+
+    const char* formatPath(char* buffer, size_t size) const {
+        if (track.isValid()) {
+            track.formatPath(buffer, size);
+            return buffer;
+        }
+        return path.c_str();
+    }
+
+    bool hasSamePath(const FileEntry& other) const {
+        return track == other.track && path == other.path;
+    }
+
+    bool matchesPath(const String& localPath) const {
+        TrackId other;
+        if (TrackId::fromPath(localPath, other)) {
+            return track == other;
+        }
+        return !track.isValid() && path == localPath;
+    }
 };
 
 class FileManager {
@@ -38,32 +121,126 @@ private:
     static const int SD_MISO_PIN = 12;
     static const int SD_MOSI_PIN = 13;
     static const int SD_CLK_PIN = 14;
+    static const char* SD_MOUNT_POINT; // VFS prefix for POSIX calls the SD class does not wrap
+    static const char* SD_FATFS_DRIVE; // FatFs volume of the card, for calls the VFS does not offer
+    
+    // SDMMC is only attempted when the board routes the card to the native host pins
+    // (build flag SD_SDMMC_WIRED, plus SD_SDMMC_4BIT for the 4-bit bus). The current
+    // TilkieTalkie wiring does not, so by default the card is mounted over SPI.
     
     // SD Card speed configuration (optimized for high-speed cards)
     // Default initialization tries 25MHz first, falls back to slower speeds if neededß
     
     // Download configuration
-    static const int MAX_RETRY_COUNT = 5;
-    static const int MAX_RETRY_BATCHES = 10; // Maximum number of retry batches
-    static const unsigned long RETRY_DELAY_MS = 10000; // 10 seconds between individual retries
-    static const unsigned long RETRY_BATCH_DELAY_MS = 60000; // 1 minute between retry batches
-    static const unsigned long CONNECTIVITY_TIMEOUT_MS = 10000; // 10 seconds
-    static const size_t DOWNLOAD_BUFFER_SIZE = 4096; // 4KB buffer for downloads (increased from 2KB)
-    static const unsigned long DOWNLOAD_TIMEOUT_MS = 300000; // 5 minutes per download
+    // Retries back off exponentially (2 s, 4 s, ... capped at 10 minutes) with the upper
+    // half of each delay randomised, so devices that failed together do not retry together
+    static const int MAX_DOWNLOAD_ATTEMPTS = 10;
+    static const unsigned long RETRY_BASE_DELAY_MS = 2000;
+    static const unsigned long RETRY_MAX_DELAY_MS = 600000;
+    // Per-host circuit breaker: after a few network or server failures in a row the host
+    // is left alone for a while, then one trial download decides whether it recovered
+    static const int CIRCUIT_FAILURE_THRESHOLD = 3;
+    static const unsigned long CIRCUIT_OPEN_MS = 30000;
+    static const unsigned long CIRCUIT_MAX_OPEN_MS = 600000;
+    static const size_t MAX_HOST_CIRCUITS = 8;
+    // Connectivity is inferred from the last transfer; the internet probe only runs after
+    // a network failure, at most this often
+    static const unsigned long CONNECTIVITY_PROBE_INTERVAL_MS = 60000;
+    static const size_t DOWNLOAD_BUFFER_SIZE = 4096; // Smallest download chunk, also the benchmark block size
+    static const size_t MAX_DOWNLOAD_CHUNK_SIZE = 32768; // Largest chunk the rate estimate can grow to
+    static const unsigned long CHUNK_TARGET_MS = 100; // Size chunks to ~100 ms of traffic per card write
+    static const unsigned long RATE_WINDOW_MS = 500; // Throughput is re-measured this often during a download
+    static const size_t MIN_RATE_SAMPLE_BYTES = 16384; // Smaller files are mostly TCP slow start
+    static const int SOCKET_RCVBUF_SIZE = 16384;
+    static const unsigned long DOWNLOAD_TIMEOUT_MS = 300000; // 5 minutes per download attempt
+    static const unsigned long DOWNLOAD_NO_DATA_TIMEOUT_MS = 10000; // Stalled transfer
+    static const unsigned long DOWNLOAD_SLICE_MS = 20; // Longest a download step holds the loop
+    static const size_t HEADER_READ_SIZE = 256; // Socket reads while the response headers come in
+    // gzip/deflate is only asked for (config download_compression, off by default) when
+    // the decoder fits and this much heap is still left after it
+    static const size_t INFLATE_HEAP_RESERVE = 40000;
     
     // NVS storage keys
     static const char* NVS_NAMESPACE;
     static const char* NVS_DOWNLOAD_QUEUE_KEY;
     static const char* NVS_FILE_LIST_KEY;
     static const char* NVS_DOWNLOAD_STATS_KEY;
+    static const char* NVS_COMMIT_LOG_KEY;
+    
+    // Commit intent log. A download's temp file and the rename that publishes it are
+    // recorded in NVS before they happen and dropped once done, so after a brownout
+    // boot recovery only has to look at the paths listed here instead of rescanning
+    // every required file. Three small NVS writes per download.
+    enum CommitState : uint8_t {
+        COMMIT_WRITING = 1,   // <path>.tmp is being filled; its (pre-allocated) length means nothing
+        COMMIT_PUBLISHING = 2 // <path>.tmp is complete at size bytes and is replacing <path>
+    };
+    static const size_t COMMIT_LOG_SLOTS = 8; // Oldest entry is dropped when full
+    static const size_t COMMIT_PATH_MAX = 64; // Longer paths go unlogged, the periodic check covers them
+    struct CommitIntent {
+        uint8_t state;
+        uint32_t size;
+        char path[COMMIT_PATH_MAX];
+    };
+    CommitIntent commitLog[COMMIT_LOG_SLOTS];
+    size_t commitLogCount;
     
     // Private members
     bool sdCardInitialized;
     bool downloadInProgress;
-    std::vector<DownloadTask> downloadQueue;
+    std::deque<DownloadTask> downloadQueues[DOWNLOAD_PRIORITY_COUNT]; // One FIFO per priority
     std::vector<FileEntry> requiredFiles;
     nvs_handle_t nvsHandle;
     
+    // Mounted filesystem, SD or SD_MMC depending on which bus came up
+    fs::FS* sdFs;
+    SdBusMode sdBusMode;
+    
+    // SD entry cache: remembers whether a path is a file, a directory or missing so
+    // repeated existence checks do not walk the FAT over SPI. Keyed by two independent
+    // 32-bit path hashes plus length (12 bytes per entry), so a wrong answer takes a
+    // collision in both, and kept coherent by FileManager's own mutations; nothing
+    // else writes to the card.
+    enum SdEntryState : uint8_t {
+        SD_ENTRY_MISSING = 0,
+        SD_ENTRY_FILE = 1,
+        SD_ENTRY_DIRECTORY = 2
+    };
+    struct SdEntryCacheItem {
+        uint32_t hash;
+        uint32_t check; // checkPath(), tells apart paths whose hash and length collide
+        uint16_t length;
+        uint8_t state;
+    };
+    static const size_t SD_ENTRY_CACHE_MAX = 384; // ~4.5KB of heap when full
+    std::vector<SdEntryCacheItem> sdEntryCache; // Sorted by (hash, length, check)
+    struct SdCacheStats {
+        uint32_t hits;
+        uint32_t misses;
+        uint32_t flushes;
+    } sdCacheStats;
+    
+    // Card usage, kept current by FileManager's own writes and deletes so the space
+    // queries (the device report every 5 s, every download) do not walk the FAT. Sizes
+    // are rounded up to SPACE_ALLOCATION_UNIT; whatever that, and changes of unknown
+    // size, get wrong is put right by reconciling with the filesystem while idle.
+    static const size_t SPACE_ALLOCATION_UNIT = 32768; // FAT32 cluster on the usual SDHC format
+    static const unsigned long SPACE_RECONCILE_MS = 600000;
+    static const int64_t SPACE_DRIFT_REPORT = 1048576; // Reconciles moving the figure more than this are logged
+    uint64_t spaceUsed;
+    uint64_t spaceTotal;
+    bool spaceKnown;
+    bool spaceReconcileDue; // Something of unknown size changed
+    unsigned long lastSpaceReconcile;
+    int64_t lastSpaceDrift;
+    
+    // Last sdbench run
+    static const size_t SD_BENCH_FILE_SIZE = 1024 * 1024;
+    static const int SD_BENCH_RANDOM_READS = 256;
+    static const int DOWNLOAD_BENCH_MAX_RUNS = 20;
+    static const int DOWNLOAD_BENCH_MAX_ATTEMPTS = 3; // Per run, later ones resume
+    SdBenchResult lastSdBench;
+    
     // Download statistics
     struct DownloadStats {
         int totalDownloads;
@@ -72,13 +249,108 @@ private:
         unsigned long totalBytesDownloaded;
     } downloadStats;
     
+    // Transfer rate estimate, smoothed over downloads (EWMA) and used to size the
+    // next download's read/write chunks. RAM only, relearnt after a reboot.
+    struct DownloadRate {
+        float avgKBps;           // 0 = no sample yet
+        float avgTtfbMs;         // Request sent to first response byte
+        size_t chunkSize;        // Chunk the last download settled on
+        float lastKBps;
+        uint32_t lastTtfbMs;
+        size_t lastBytes;
+        unsigned long lastDurationMs;
+        uint32_t samples;
+        uint32_t idleWaits;      // Polls that found no data, across all downloads
+    } downloadRate;
+    
+    // Why the last download attempt failed, decides what the failure counts against
+    enum DownloadFailure : uint8_t {
+        DOWNLOAD_FAILED_LOCAL = 0, // SD card, space or file errors
+        DOWNLOAD_FAILED_NETWORK,   // Connect, read, stall or truncated transfer
+        DOWNLOAD_FAILED_SERVER,    // HTTP 5xx or 429
+        DOWNLOAD_FAILED_REJECTED   // Any other non-200 status
+    };
+    DownloadFailure lastDownloadFailure;
+    
+    // The transfer in flight. A download runs a slice at a time from update(), so the
+    // loop keeps going and a more urgent task can take over at a chunk boundary.
+    struct DownloadSession {
+        DownloadTask task;         // Out of the queue while it runs
+        WiFiClient* client;
+        File file;
+        String tempPath;
+        uint8_t* buffer;
+        size_t bufferSize;
+        size_t chunkSize;
+        size_t nextChunkSize;
+        size_t staged;             // Received but not yet written to the card
+        int contentLength;         // Whole file on the card, -1 = unknown (no length, chunked or compressed)
+        int transferLength;        // Resumed bytes plus the body on the wire, -1 = unknown; drives progress
+        int totalDownloaded;       // Written to the file, including what a resumed attempt started with
+        HttpResponseParser http;
+        StreamInflater inflater;   // Only holds memory while a compressed response is decoded
+        uint8_t* wireBuffer;       // Compressed bytes on their way to the inflater, else nullptr
+        bool writeFailed;
+        bool awaitingHeaders;      // Request sent, the response not yet parsed; no file or buffers yet
+        bool reusedSocket;         // client came from the pool and has not answered yet
+        String request;            // Sent again on a new connection if the pooled one was stale
+        size_t resumedFrom;
+        size_t allocatedSize;      // Length of the .tmp file on the card (pre-allocation)
+        uint32_t targetFigure;
+        int32_t ttfbMs;
+        unsigned long startTime;
+        unsigned long lastDataTime;
+        unsigned long windowStart;
+        size_t windowBytes;
+        uint32_t windowBps;        // Rate over the last closed window, 0 until the first closes
+        int lastProgress;
+    } session;
+    
+    // Progress of the transfer in flight, published once per slice and read without a
+    // lock (seqlock): the sequence is odd while an update is being written, and a
+    // reader keeps its copy only if it saw the same even value before and after
+    std::atomic<uint32_t> progressSeq;
+    DownloadProgress progress;
+    
+    enum DownloadStep : uint8_t {
+        DOWNLOAD_STEP_RUNNING,
+        DOWNLOAD_STEP_DONE,
+        DOWNLOAD_STEP_FAILED
+    };
+    
+    struct HostCircuit {
+        String host;
+        uint8_t consecutiveFailures;
+        uint8_t trips;              // Times opened without a success in between
+        bool open;
+        unsigned long openedAt;
+        unsigned long openMs;
+    };
+    std::vector<HostCircuit> hostCircuits;
+    bool lastTransferFailed; // Network failure with no successful transfer since
+    bool lastProbeOk;
+    unsigned long lastProbeAt;
+    
     // Constructor (private for singleton)
     FileManager();
     
     // Helper methods
     bool initializeSDCard();
+    bool mountSPI();
+    bool mountSDMMC(bool oneBitMode);
+    void unmountSDCard();
+    uint8_t sdCardType();
+    uint64_t sdCardSize();
+    uint64_t sdUsedBytes(); // Walks the FAT the first time after a mount, see spaceUsed
+    uint64_t reconcileSpace();
+    void accountSpace(size_t oldSize, size_t newSize); // A file on the card changed size, 0 = absent
+    void noteTrackRemoved(const String& path, size_t size); // Per-figure usage for StorageManager
     bool checkConnectivity();
     bool pingGoogle();
+    unsigned long retryDelayMs(int attempt);
+    HostCircuit* findCircuit(const String& host);
+    bool circuitAllows(const String& host);
+    void recordHostResult(const String& host, bool success);
     bool isChargingRequired();
 
     // NVS operations
@@ -89,18 +361,53 @@ private:
     bool loadRequiredFiles();
     bool saveDownloadStats();
     bool loadDownloadStats();
+    bool saveCommitLog();
+    void logCommitIntent(const String& path, CommitState state, uint32_t size);
+    void clearCommitIntent(const String& path);
+    void recoverCommits(); // Boot pass over the commit log, before anything else touches the card
     
     // Download operations
-    bool downloadFileFromURL(const String& url, const String& localPath, String& errorMsg);
+    bool startDownload(DownloadTask& task, String& errorMsg);
+    DownloadStep stepDownload(String& errorMsg);
+    DownloadStep stepHeaders(String& errorMsg);
+    bool reopenDownloadStream(String& errorMsg);
+    bool beginBody(const uint8_t* earlyBody, size_t earlyBodyBytes, String& errorMsg);
+    bool finishDownload(String& errorMsg);
+    void closeSession(bool keepPartial);
+    void releaseSessionBuffers();
+    void publishProgress();
+    void clearProgress();
+    bool takeBody(uint8_t* data, size_t length, String& errorMsg);
+    bool stageBody(const uint8_t* data, size_t length);
+    bool writeStagedChunk();
+    static bool inflateSink(const uint8_t* data, size_t length);
+    void suspendDownload();
+    void abortDownload(); // Drops the transfer and its partial file, the task is not requeued
+    void completeAttempt(DownloadTask& task, bool success, const String& errorMsg);
+    bool readyTaskAbove(DownloadPriority priority);
+    size_t queuedDownloadCount() const;
+    size_t chunkSizeForRate(float kBps, size_t bufferSize);
+    void tuneDownloadSocket(WiFiClient& client);
+    void recordDownloadRate(size_t bytes, unsigned long durationMs, uint32_t ttfbMs);
     bool verifyFileIntegrity(const String& filePath, const String& expectedChecksum);
     void processDownloadQueue();
-    void addToDownloadQueue(const String& url, const String& localPath, const String& checksum = "");
+    void addToDownloadQueue(const String& url, const String& localPath, const String& checksum, DownloadPriority priority);
+    static String hostOf(const String& url); // Empty for an invalid URL
+    
+    // SD entry cache
+    SdEntryState lookupEntry(const String& path);
+    void rememberEntry(const String& path, SdEntryState state);
+    void clearEntryCache();
+    static uint32_t hashPath(const char* path, size_t length);
+    static uint32_t checkPath(const char* path, size_t length);
+    static bool sdEntryLess(const SdEntryCacheItem& a, const SdEntryCacheItem& b);
     
     // File operations
+    bool preallocateFile(File& file, size_t size);
     bool createDirectoryStructure(const String& path);
     bool createDirectoryRecursive(const String& path);
+    bool removeTree(const String& path, uint32_t& filesDeleted, uint64_t& bytesFreed); // Everything under path, then path itself
     String getDirectoryFromPath(const String& path);
-    size_t getFileSize(const String& path);
     
     public:
     // Singleton access
@@ -120,60 +427,92 @@ private:
     bool removeDirectory(const String& path);
     std::vector<String> listFiles(const String& directory = "/");
     bool fileExists(const String& path);
+    size_t getFileSize(const String& path); // 0 for a missing file or a directory
+    File openFile(const String& path, const char* mode = FILE_READ); // Keeps the entry cache in step
+    bool replaceFile(const String& tempPath, const String& path);     // Rename over an existing file
     void printFileTree();
     void formatSDCard(); // Format SD card as FAT32
 
     // Download management methods
-    bool scheduleDownload(const String& url, const String& localPath, const String& checksum = "");
+    bool scheduleDownload(const String& url, const String& localPath, const String& checksum = "",
+                          DownloadPriority priority = DOWNLOAD_PRIORITY_DOCKED);
+    bool promoteDownload(const String& localPath, DownloadPriority priority); // Raise only, false if not queued
+    void demoteDownloads(DownloadPriority floor); // Move everything more urgent than floor down to it
     void cancelAllDownloads();
     void retryFailedDownloads();
     int getPendingDownloadsCount();
     bool isDownloadInProgress() const { return downloadInProgress; }
+    // Latest progress snapshot, safe from any task at any rate; false when nothing is
+    // downloading (or, rarely, when an update was being written, so poll again later)
+    bool getDownloadProgress(DownloadProgress& out) const;
+    static uint32_t downloadIdFor(const String& localPath) { return hashPath(localPath.c_str(), localPath.length()); }
     
     // Required files management
     bool addRequiredFile(const String& localPath, const String& url, const String& checksum = "");
     void checkRequiredFiles();
-    std::vector<String> getRequiredFilesByPattern(const String& pattern); // Get required files matching pattern
+    std::vector<TrackId> getRequiredTracksForFigure(uint32_t figureId); // Get required tracks of one figure
     
     // Bulk deletion methods
     void clearAllRequiredFiles(); // Clear all required files from NVS and storage
-    bool deleteFigureFiles(const String& figureId); // Delete all files for a specific figure
+    bool deleteFigureFiles(const String& figureId); // Delete the figure's whole directory tree and metadata
     
     // Status and info methods
     bool isSDCardAvailable() const { return sdCardInitialized; }
-    size_t getSDCardTotalSpace();
-    size_t getSDCardUsedSpace();
-    size_t getSDCardFreeSpace();
+    fs::FS& getFS() { return *sdFs; } // For readers such as the audio source
+    SdBusMode getBusMode() const { return sdBusMode; }
+    static const char* getBusModeName(SdBusMode mode);
+    bool remountSDCard(SdBusMode mode);
+    String benchmarkBus(); // Throughput and latency on /temp for the current bus, result kept for the device report
+    const SdBenchResult& getLastSDBenchmark() const { return lastSdBench; }
+    size_t formatSDBenchmarkJson(char* buffer, size_t size) const;
+    String runDownloadBenchmark(const String& url, int runs); // Timed downloads to /temp, see tools/mock_content_server.py
+    uint64_t getSDCardTotalSpace();
+    uint64_t getSDCardUsedSpace(); // Cached, O(1)
+    uint64_t getSDCardFreeSpace(); // Cached, O(1)
     String getSDCardInfo();
+    String getSDCacheStatsString();
+    String benchmarkReadThroughput(const String& path);
     
     // Download statistics
     DownloadStats getDownloadStats() const { return downloadStats; }
     void resetDownloadStats();
     String getDownloadStatsString();
+    float getEstimatedThroughputKBps() const { return downloadRate.avgKBps; } // 0 until measured
     
     // Utility methods
     void printDownloadQueue();
     void printRequiredFiles();
-    String formatBytes(size_t bytes);
+    String formatBytes(uint64_t bytes);
     
     // File integrity
     String calculateFileChecksum(const String& filePath);
     
     // Maintenance operations
-    void cleanupTempFiles();
+    uint64_t cleanupTempFiles(); // Stale temps anywhere on the card, returns bytes freed
+    // One directory of that walk, for callers that spread it over several steps: stale
+    // temps are deleted, subdirectories appended to pending, other files to files if given
+    void sweepTempFiles(const String& directory, std::vector<String>& pending, uint32_t& removed,
+                        uint64_t& bytesFreed, std::vector<String>* files = nullptr);
+    // A .tmp is in use while its download runs or can still resume, and while it is in
+    // the commit log (recoverCommits() settles those)
+    bool isTempFileInUse(const String& tempPath);
+    // Number of contiguous cluster runs the file occupies, 1 = unfragmented
+    bool countFragments(const String& path, uint32_t& fragments, uint32_t& clusters);
+    // Rewrites for SdMaintenance: <path>.tmp is opened pre-allocated to size and logged
+    // like a download, so a power cut part way leaves the original; finishRewrite()
+    // renames it over path, or discards it when keep is false
+    File beginRewrite(const String& path, size_t size);
+    bool finishRewrite(const String& path, size_t size, bool keep);
     
     // Event callbacks
-    typedef void (*DownloadProgressCallback)(const String& url, const String& path, int progress, size_t downloaded, size_t total);
     typedef void (*DownloadCompleteCallback)(const String& url, const String& path, bool success, const String& error);
     typedef void (*FileSystemEventCallback)(const String& operation, const String& path, bool success);
     
-    void setDownloadProgressCallback(DownloadProgressCallback callback);
     void setDownloadCompleteCallback(DownloadCompleteCallback callback);
     void setFileSystemEventCallback(FileSystemEventCallback callback);
     
 private:
     // Callbacks
-    DownloadProgressCallback downloadProgressCallback;
     DownloadCompleteCallback downloadCompleteCallback;
     FileSystemEventCallback fileSystemEventCallback;
 };
@@ -0,0 +1,314 @@
+#include "HttpResponseParser.h"
+
+HttpResponseParser::HttpResponseParser() {
+    reset();
+}
+
+void HttpResponseParser::reset() {
+    state = STATE_STATUS_LINE;
+    error = "";
+    headersDone = false;
+    headerBytes = 0;
+    line[0] = '\0';
+    lineLength = 0;
+    lineTruncated = false;
+    lineReady = false;
+    statusCode = 0;
+    httpMinor = 1;
+    contentLength = -1;
+    chunked = false;
+    contentEncoding = ENCODING_IDENTITY;
+    rangeStart = -1;
+    rangeTotal = -1;
+    keepAlive = true;
+    remaining = 0;
+    bodyBytes = 0;
+}
+
+void HttpResponseParser::fail(const char* message) {
+    state = STATE_FAILED;
+    error = message;
+}
+
+const char* HttpResponseParser::encodingName(ContentEncoding encoding) {
+    switch (encoding) {
+        case ENCODING_IDENTITY: return "identity";
+        case ENCODING_GZIP: return "gzip";
+        case ENCODING_DEFLATE: return "deflate";
+        default: return "unsupported";
+    }
+}
+
+bool HttpResponseParser::takeLine(const uint8_t*& p, const uint8_t* end) {
+    if (lineReady) {
+        lineLength = 0;
+        lineTruncated = false;
+        lineReady = false;
+    }
+    while (p < end) {
+        char c = (char)*p++;
+        if (c == '\n') {
+            if (lineLength > 0 && line[lineLength - 1] == '\r') {
+                lineLength--;
+            }
+            line[lineLength] = '\0';
+            lineReady = true;
+            return true;
+        }
+        if (lineLength < MAX_LINE_LENGTH) {
+            line[lineLength++] = c;
+        } else {
+            lineTruncated = true;
+        }
+    }
+    return false;
+}
+
+size_t HttpResponseParser::parseHeaders(const uint8_t* data, size_t length) {
+    const uint8_t* p = data;
+    const uint8_t* end = data + length;
+
+    while (p < end && !headersDone && state != STATE_FAILED) {
+        const uint8_t* lineStart = p;
+        bool complete = takeLine(p, end);
+        headerBytes += p - lineStart;
+        if (headerBytes > MAX_HEADER_BYTES) {
+            fail("Response headers too large");
+            break;
+        }
+        if (!complete) {
+            break;
+        }
+
+        if (state == STATE_STATUS_LINE) {
+            parseStatusLine();
+        } else if (lineLength == 0) {
+            endHeaders();
+        } else if (!lineTruncated) {
+            parseHeaderLine();
+        }
+    }
+    return p - data;
+}
+
+void HttpResponseParser::parseStatusLine() {
+    if (lineLength == 0) {
+        return; // Stray CRLF left over from a previous response
+    }
+    // "HTTP/1.1 200 OK"
+    if (lineTruncated || strncmp(line, "HTTP/1.", 7) != 0 || !isdigit((unsigned char)line[7]) ||
+        line[8] != ' ' || !isdigit((unsigned char)line[9]) || !isdigit((unsigned char)line[10]) ||
+        !isdigit((unsigned char)line[11])) {
+        fail("Not an HTTP/1.x response");
+        return;
+    }
+    httpMinor = line[7] - '0';
+    statusCode = (line[9] - '0') * 100 + (line[10] - '0') * 10 + (line[11] - '0');
+    keepAlive = httpMinor >= 1;
+    state = STATE_HEADERS;
+}
+
+void HttpResponseParser::parseHeaderLine() {
+    char* colon = strchr(line, ':');
+    if (colon == nullptr) {
+        return; // Not a header, ignore it like other clients do
+    }
+    *colon = '\0';
+    const char* name = line;
+    char* value = colon + 1;
+    while (*value == ' ' || *value == '\t') {
+        value++;
+    }
+    char* valueEnd = value + strlen(value);
+    while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t')) {
+        *--valueEnd = '\0';
+    }
+
+    if (strcasecmp(name, "Content-Length") == 0) {
+        long length;
+        if (!parseNumber(value, length) || (contentLength >= 0 && contentLength != length)) {
+            fail("Invalid Content-Length");
+            return;
+        }
+        contentLength = length;
+    } else if (strcasecmp(name, "Transfer-Encoding") == 0) {
+        if (hasToken(value, "chunked")) {
+            chunked = true;
+        } else if (strcasecmp(value, "identity") != 0) {
+            fail("Unsupported Transfer-Encoding");
+        }
+    } else if (strcasecmp(name, "Content-Encoding") == 0) {
+        if (strcasecmp(value, "gzip") == 0 || strcasecmp(value, "x-gzip") == 0) {
+            contentEncoding = ENCODING_GZIP;
+        } else if (strcasecmp(value, "deflate") == 0) {
+            contentEncoding = ENCODING_DEFLATE;
+        } else if (*value != '\0' && strcasecmp(value, "identity") != 0) {
+            contentEncoding = ENCODING_UNSUPPORTED; // Including stacked codings
+        }
+    } else if (strcasecmp(name, "Content-Range") == 0) {
+        // "bytes <start>-<end>/<total>" or "bytes */<total>" on a 416
+        if (strncasecmp(value, "bytes ", 6) == 0) {
+            const char* spec = value + 6;
+            if (isdigit((unsigned char)*spec)) {
+                rangeStart = strtol(spec, nullptr, 10);
+            }
+            const char* slash = strchr(spec, '/');
+            if (slash != nullptr && isdigit((unsigned char)slash[1])) {
+                rangeTotal = strtol(slash + 1, nullptr, 10);
+            }
+        }
+    } else if (strcasecmp(name, "Connection") == 0) {
+        if (hasToken(value, "close")) {
+            keepAlive = false;
+        } else if (hasToken(value, "keep-alive")) {
+            keepAlive = true;
+        }
+    }
+}
+
+void HttpResponseParser::endHeaders() {
+    // Interim responses (100 Continue and friends) are followed by the real one
+    if (statusCode >= 100 && statusCode < 200) {
+        int minor = httpMinor;
+        reset();
+        httpMinor = minor;
+        return;
+    }
+
+    headersDone = true;
+    if (chunked) {
+        contentLength = -1; // Chunking wins over a Content-Length sent alongside
+        state = STATE_CHUNK_SIZE;
+    } else if (statusCode == 204 || statusCode == 304) {
+        contentLength = 0;
+        state = STATE_DONE;
+    } else if (contentLength >= 0) {
+        remaining = contentLength;
+        state = remaining > 0 ? STATE_BODY : STATE_DONE;
+    } else {
+        keepAlive = false; // Only the close marks the end
+        state = STATE_BODY;
+    }
+}
+
+void HttpResponseParser::parseChunkSize() {
+    // "<hex>[;extension]"; a truncated line still has the size at its start
+    size_t size = 0;
+    int digits = 0;
+    const char* c = line;
+    while (isxdigit((unsigned char)*c)) {
+        if (++digits > MAX_CHUNK_SIZE_DIGITS) {
+            fail("Chunk size too large");
+            return;
+        }
+        size = size * 16 + (isdigit((unsigned char)*c) ? *c - '0' : (tolower((unsigned char)*c) - 'a' + 10));
+        c++;
+    }
+    if (digits == 0 || (*c != '\0' && *c != ';' && *c != ' ' && *c != '\t')) {
+        fail("Malformed chunk size");
+        return;
+    }
+    remaining = size;
+    state = size > 0 ? STATE_CHUNK_DATA : STATE_TRAILERS;
+}
+
+size_t HttpResponseParser::takeData(uint8_t*& out, const uint8_t*& p, const uint8_t* end) {
+    size_t count = end - p;
+    if (state != STATE_BODY || contentLength >= 0) {
+        if (count > remaining) {
+            count = remaining;
+        }
+        remaining -= count;
+    }
+    // out never runs ahead of p, it only falls behind by the framing removed so far
+    if (out != p) {
+        memmove(out, p, count);
+    }
+    out += count;
+    p += count;
+    bodyBytes += count;
+    return count;
+}
+
+size_t HttpResponseParser::decodeBody(uint8_t* data, size_t length) {
+    uint8_t* out = data;
+    const uint8_t* p = data;
+    const uint8_t* end = data + length;
+
+    while (p < end && headersDone && state != STATE_DONE && state != STATE_FAILED) {
+        switch (state) {
+            case STATE_BODY:
+                takeData(out, p, end);
+                if (contentLength >= 0 && remaining == 0) {
+                    state = STATE_DONE;
+                }
+                break;
+
+            case STATE_CHUNK_SIZE:
+                if (takeLine(p, end)) {
+                    parseChunkSize();
+                }
+                break;
+
+            case STATE_CHUNK_DATA:
+                takeData(out, p, end);
+                if (remaining == 0) {
+                    state = STATE_CHUNK_DATA_END;
+                }
+                break;
+
+            case STATE_CHUNK_DATA_END:
+                if (takeLine(p, end)) {
+                    if (lineLength != 0) {
+                        fail("Missing CRLF after chunk");
+                    } else {
+                        state = STATE_CHUNK_SIZE;
+                    }
+                }
+                break;
+
+            case STATE_TRAILERS:
+                // Trailer fields are not used; the empty line ends the message
+                if (takeLine(p, end) && lineLength == 0 && !lineTruncated) {
+                    state = STATE_DONE;
+                }
+                break;
+
+            default:
+                p = end;
+                break;
+        }
+    }
+    return out - data;
+}
+
+bool HttpResponseParser::hasToken(const char* value, const char* token) {
+    size_t tokenLength = strlen(token);
+    const char* p = value;
+    while (*p != '\0') {
+        while (*p == ' ' || *p == '\t' || *p == ',') {
+            p++;
+        }
+        const char* start = p;
+        while (*p != '\0' && *p != ',') {
+            p++;
+        }
+        const char* tokenEnd = p;
+        while (tokenEnd > start && (tokenEnd[-1] == ' ' || tokenEnd[-1] == '\t')) {
+            tokenEnd--;
+        }
+        if ((size_t)(tokenEnd - start) == tokenLength && strncasecmp(start, token, tokenLength) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HttpResponseParser::parseNumber(const char* text, long& value) {
+    if (!isdigit((unsigned char)*text)) {
+        return false;
+    }
+    char* end;
+    value = strtol(text, &end, 10);
+    return *end == '\0' && value >= 0 && value != LONG_MAX;
+}
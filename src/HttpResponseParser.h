@@ -0,0 +1,103 @@
+#ifndef HTTP_RESPONSE_PARSER_H
+#define HTTP_RESPONSE_PARSER_H
+
+#include <Arduino.h>
+
+// Incremental HTTP/1.1 response parser for the file downloader. It is fed whatever
+// the socket returned and never allocates: header lines are assembled in a fixed
+// buffer (longer ones are skipped, none of the headers read here come close) and
+// only the fields a download needs are kept. The body is de-chunked in place, so a
+// Content-Length or read-to-close body passes through without being copied.
+//
+// Content-Encoding is only reported; StreamInflater undoes gzip and deflate.
+class HttpResponseParser {
+public:
+    enum ContentEncoding : uint8_t {
+        ENCODING_IDENTITY = 0,
+        ENCODING_GZIP,
+        ENCODING_DEFLATE,
+        ENCODING_UNSUPPORTED
+    };
+
+    HttpResponseParser();
+    void reset(); // Ready for the next response
+
+    // Status line and headers. Returns the bytes used and stops right after the blank
+    // line that ends the headers; whatever follows in data is body.
+    size_t parseHeaders(const uint8_t* data, size_t length);
+
+    // Strips the transfer framing from raw body bytes in place and returns how many
+    // body bytes are left at the start of data. Anything past the end of the body is
+    // dropped.
+    size_t decodeBody(uint8_t* data, size_t length);
+
+    bool headersComplete() const { return headersDone; }
+    bool done() const { return state == STATE_DONE; }
+    bool failed() const { return state == STATE_FAILED; }
+    const char* getError() const { return error; }
+
+    // Valid once headersComplete()
+    int getStatusCode() const { return statusCode; }
+    long getContentLength() const { return contentLength; } // -1 = not sent or chunked
+    bool isChunked() const { return chunked; }
+    ContentEncoding getContentEncoding() const { return contentEncoding; }
+    long getRangeStart() const { return rangeStart; }        // Content-Range, -1 = none
+    long getRangeTotal() const { return rangeTotal; }        // -1 = none or '*'
+    bool isKeepAlive() const { return keepAlive; }           // Connection may serve another request
+    bool endsAtClose() const { return headersDone && !chunked && contentLength < 0; }
+    size_t getBodyBytes() const { return bodyBytes; }        // Body delivered so far, framing excluded
+
+    static const char* encodingName(ContentEncoding encoding);
+
+private:
+    static const size_t MAX_LINE_LENGTH = 192;
+    static const size_t MAX_HEADER_BYTES = 16384;
+    static const int MAX_CHUNK_SIZE_DIGITS = 8;
+
+    enum State : uint8_t {
+        STATE_STATUS_LINE = 0,
+        STATE_HEADERS,
+        STATE_BODY,           // Content-Length or read-to-close
+        STATE_CHUNK_SIZE,
+        STATE_CHUNK_DATA,
+        STATE_CHUNK_DATA_END, // CRLF after the chunk's data
+        STATE_TRAILERS,
+        STATE_DONE,
+        STATE_FAILED
+    };
+
+    State state;
+    const char* error;
+    bool headersDone;
+    size_t headerBytes;
+
+    char line[MAX_LINE_LENGTH + 1];
+    size_t lineLength;
+    bool lineTruncated;
+    bool lineReady; // line holds a complete line, cleared when the next one starts
+
+    int statusCode;
+    int httpMinor;
+    long contentLength;
+    bool chunked;
+    ContentEncoding contentEncoding;
+    long rangeStart;
+    long rangeTotal;
+    bool keepAlive;
+
+    size_t remaining; // Left in the Content-Length body or the current chunk
+    size_t bodyBytes;
+
+    bool takeLine(const uint8_t*& p, const uint8_t* end);
+    void parseStatusLine();
+    void parseHeaderLine();
+    void endHeaders();
+    void parseChunkSize();
+    size_t takeData(uint8_t*& out, const uint8_t*& p, const uint8_t* end);
+    void fail(const char* message);
+
+    static bool hasToken(const char* value, const char* token);
+    static bool parseNumber(const char* text, long& value);
+};
+
+#endif // HTTP_RESPONSE_PARSER_H
@@ -1,5 +1,6 @@
 #include "LedController.h"
 #include "ConfigManager.h"
+#include "FileManager.h"
 
 LedController::LedController() {
     pulseActive = false;
@@ -20,6 +21,11 @@ LedController::LedController() {
     // Ensure the value is within valid range
     maxBrightness = min(maxBrightness, LED_MAX_POWER);
     maxBrightness = max(maxBrightness, 0);
+    
+    downloadIndicator = config.getInt("led_download_progress", 1) != 0;
+    showingDownload = false;
+    lastProgressPoll = 0;
+    lastProgressSeen = 0;
 }
 
 void LedController::begin() {
@@ -30,6 +36,11 @@ void LedController::begin() {
 }
 
 void LedController::update() {
+    // A running download takes over from the steady pulse; rapid pulses are short
+    // notifications and still show on top of it
+    if (downloadIndicator && !pulseRapidActive && updateDownloadProgress()) {
+        return;
+    }
     if (pulseActive) {
         updatePulse();
     }
@@ -90,6 +101,16 @@ void LedController::turnOff() {
     FastLED.show();
 }
 
+void LedController::setDownloadIndicator(bool enabled) {
+    downloadIndicator = enabled;
+    if (!enabled && showingDownload) {
+        showingDownload = false;
+        FastLED.clear();
+        FastLED.show();
+    }
+    ConfigManager::getInstance().storeInt("led_download_progress", enabled ? 1 : 0);
+}
+
 void LedController::setMaxBrightness(int brightness) {
     // Clamp brightness to valid range (0-255)
     maxBrightness = min(brightness, LED_MAX_POWER);
@@ -169,4 +190,39 @@ void LedController::updatePulseRapid() {
     }
     
     FastLED.show();
-}
\ No newline at end of file
+}
+
+bool LedController::updateDownloadProgress() {
+    unsigned long currentTime = millis();
+    if (currentTime - lastProgressPoll < PROGRESS_POLL_MS) {
+        return showingDownload;
+    }
+    lastProgressPoll = currentTime;
+    
+    // Polled from the snapshot, nothing calls into here from the download loop
+    DownloadProgress progress;
+    if (!FileManager::getInstance().getDownloadProgress(progress)) {
+        if (showingDownload && currentTime - lastProgressSeen >= PROGRESS_LINGER_MS) {
+            showingDownload = false;
+            if (!pulseActive) {
+                FastLED.clear();
+                FastLED.show();
+            }
+        }
+        return showingDownload;
+    }
+    lastProgressSeen = currentTime;
+    showingDownload = true;
+    
+    // Hue walks from blue to green as the file fills; an unknown size stays cyan
+    uint8_t hue = 128;
+    if (progress.total > 0) {
+        uint32_t done = min(progress.bytes, progress.total);
+        hue = 160 - (uint8_t)((uint64_t)done * 64 / progress.total);
+    }
+    // Slow breathing between ~40% and full brightness, about two seconds per cycle
+    uint8_t level = 100 + scale8(sin8(currentTime / 8), 155);
+    leds[0] = scaleColor(CRGB(CHSV(hue, 255, 255)), (int)level * maxBrightness / 255);
+    FastLED.show();
+    return true;
+}
@@ -12,6 +12,8 @@ private:
     static const int LED_PIN = 16;          // GPIO16 for WS2812B data pin
     static const int NUM_LEDS = 1;          // Single LED
     static const int LED_MAX_POWER = 255;   // Max brightness (0-255)
+    static const unsigned long PROGRESS_POLL_MS = 100;    // Download snapshot read rate
+    static const unsigned long PROGRESS_LINGER_MS = 1500; // Keep showing across the gap between files
     
     CRGB leds[NUM_LEDS];
     bool pulseActive;
@@ -25,12 +27,17 @@ private:
     int pulseDirection;
     int currentBrightness;
     int maxBrightness;  // Dynamic max brightness (0-255)
+    bool downloadIndicator;  // Show download progress (config led_download_progress)
+    bool showingDownload;
+    unsigned long lastProgressPoll;
+    unsigned long lastProgressSeen;
     
     // Helper functions
     CRGB hexToRgb(uint32_t hexColor);
     CRGB scaleColor(CRGB color, int intensity);
     void updatePulse();
     void updatePulseRapid();
+    bool updateDownloadProgress(); // True while it owns the LED
     
 public:
     LedController();
@@ -44,6 +51,8 @@ public:
     void turnOff();
     void setMaxBrightness(int brightness);  // Set max brightness (0-255)
     int getMaxBrightness() const { return maxBrightness; }
+    void setDownloadIndicator(bool enabled);  // Persisted, on by default
+    bool getDownloadIndicator() const { return downloadIndicator; }
 };
 
 #endif // LED_CONTROLLER_H
\ No newline at end of file
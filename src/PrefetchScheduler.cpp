@@ -0,0 +1,204 @@
+#include "PrefetchScheduler.h"
+#include "AudioController.h"
+#include "BatteryManagement.h"
+#include "ConfigManager.h"
+#include "FileManager.h"
+#include "NfcController.h"
+
+// Initialize static members
+PrefetchScheduler* PrefetchScheduler::instance = nullptr;
+
+PrefetchScheduler::PrefetchScheduler() :
+    state(IDLE),
+    lastCheck(0),
+    stateSince(0),
+    nextPassAt(0),
+    nextCandidate(0) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+PrefetchScheduler& PrefetchScheduler::getInstance() {
+    if (instance == nullptr) {
+        instance = new PrefetchScheduler();
+    }
+    return *instance;
+}
+
+void PrefetchScheduler::begin() {
+    RequestManager::getInstance().setLibraryListingCallback(staticLibraryListingCallback);
+    // First pass once the device has settled after boot
+    nextPassAt = millis() + RETRY_INTERVAL_MS;
+}
+
+void PrefetchScheduler::runNow() {
+    nextPassAt = millis();
+    Serial.println("PrefetchScheduler: Pass requested, starts when charging, idle and on Wi-Fi");
+}
+
+bool PrefetchScheduler::conditionsMet(String& reason) {
+    if (!ConfigManager::getInstance().getInt("prefetch_enabled", 1)) {
+        reason = "disabled";
+        return false;
+    }
+    if (!BatteryManager::getInstance().getChargingStatus()) {
+        reason = "not charging";
+        return false;
+    }
+    if (!WiFi.isConnected()) {
+        reason = "no Wi-Fi";
+        return false;
+    }
+    if (NfcController::getInstance().isCardPresent() || !AudioController::getInstance().isStopped()) {
+        reason = "figure docked or audio playing";
+        return false;
+    }
+    return true;
+}
+
+bool PrefetchScheduler::hasSpace() {
+    FileManager& fileManager = FileManager::getInstance();
+    if (!fileManager.isSDCardAvailable()) {
+        return false;
+    }
+    uint64_t minFree = (uint64_t)ConfigManager::getInstance().getInt("prefetch_min_free_mb", DEFAULT_MIN_FREE_MB) * 1024ULL * 1024ULL;
+    return fileManager.getSDCardFreeSpace() >= minFree;
+}
+
+void PrefetchScheduler::finishPass(unsigned long retryAfterMs) {
+    state = IDLE;
+    candidates.clear();
+    candidates.shrink_to_fit();
+    nextCandidate = 0;
+    nextPassAt = millis() + retryAfterMs;
+}
+
+void PrefetchScheduler::update() {
+    unsigned long now = millis();
+    if (now - lastCheck < CHECK_INTERVAL_MS) {
+        return;
+    }
+    lastCheck = now;
+
+    if (state == IDLE && (long)(now - nextPassAt) < 0) {
+        return;
+    }
+
+    String reason;
+    if (!conditionsMet(reason)) {
+        // A pass is paused, not lost; it resumes where it left off
+        lastSkipReason = reason;
+        return;
+    }
+    lastSkipReason = "";
+
+    RequestManager& requestManager = RequestManager::getInstance();
+    FileManager& fileManager = FileManager::getInstance();
+
+    switch (state) {
+        case IDLE:
+            if (requestManager.requestLibraryListing()) {
+                Serial.println("PrefetchScheduler: Fetching figure library");
+                state = LISTING;
+                stateSince = now;
+            } else {
+                finishPass(RETRY_INTERVAL_MS);
+            }
+            break;
+
+        case LISTING:
+            // The callback moves us on; this only guards against a lost response
+            if (now - stateSince > LISTING_TIMEOUT_MS) {
+                Serial.println("PrefetchScheduler: Library listing timed out");
+                stats.listingFailures++;
+                finishPass(RETRY_INTERVAL_MS);
+            }
+            break;
+
+        case PREFETCHING:
+            // One figure at a time, and only after the previous one's downloads are done,
+            // so the free space check reflects what has actually been written
+            if (requestManager.isRequestPending() || fileManager.isDownloadInProgress() ||
+                fileManager.getPendingDownloadsCount() > 0) {
+                break;
+            }
+            if (nextCandidate >= candidates.size()) {
+                Serial.printf("PrefetchScheduler: Pass complete, %u figures checked\n", candidates.size());
+                finishPass(RUN_INTERVAL_MS);
+                break;
+            }
+            if (!hasSpace()) {
+                Serial.println("PrefetchScheduler: Free space below the prefetch floor, stopping");
+                stats.stoppedForSpace++;
+                finishPass(RUN_INTERVAL_MS);
+                break;
+            }
+            {
+                const String& uid = candidates[nextCandidate++];
+                Serial.printf("PrefetchScheduler: Prefetching figure %s (%u/%u)\n",
+                              uid.c_str(), nextCandidate, candidates.size());
+                if (requestManager.prefetchFigure(uid)) {
+                    stats.figuresRequested++;
+                }
+            }
+            break;
+    }
+}
+
+void PrefetchScheduler::onLibraryListing(bool success, const std::vector<RequestManager::LibraryEntry>& entries) {
+    if (state != LISTING) {
+        return;
+    }
+    if (!success) {
+        stats.listingFailures++;
+        finishPass(RETRY_INTERVAL_MS);
+        return;
+    }
+
+    // Flagged figures first, then ones this device has docked before
+    RequestManager& requestManager = RequestManager::getInstance();
+    candidates.clear();
+    for (const auto& entry : entries) {
+        if (entry.flagged && candidates.size() < (size_t)MAX_FIGURES_PER_PASS) {
+            candidates.push_back(entry.uid);
+        }
+    }
+    for (const auto& entry : entries) {
+        if (!entry.flagged && requestManager.wasDockedBefore(entry.uid) &&
+            candidates.size() < (size_t)MAX_FIGURES_PER_PASS) {
+            candidates.push_back(entry.uid);
+        }
+    }
+
+    stats.passes++;
+    nextCandidate = 0;
+    state = PREFETCHING;
+    stateSince = millis();
+    Serial.printf("PrefetchScheduler: %u of %u library figures selected for prefetch\n",
+                  candidates.size(), entries.size());
+}
+
+void PrefetchScheduler::staticLibraryListingCallback(bool success, const std::vector<RequestManager::LibraryEntry>& entries) {
+    getInstance().onLibraryListing(success, entries);
+}
+
+String PrefetchScheduler::getStatusString() {
+    static const char* stateNames[] = {"idle", "listing", "prefetching"};
+    String info = "Prefetch Scheduler:\n";
+    info += "Enabled: " + String(ConfigManager::getInstance().getInt("prefetch_enabled", 1) ? "yes" : "no") + "\n";
+    info += "State: " + String(stateNames[state]);
+    if (state == PREFETCHING) {
+        info += " (" + String(nextCandidate) + "/" + String(candidates.size()) + ")";
+    }
+    info += "\n";
+    if (!lastSkipReason.isEmpty()) {
+        info += "Waiting: " + lastSkipReason + "\n";
+    }
+    if (state == IDLE) {
+        long wait = (long)(nextPassAt - millis());
+        info += "Next pass in: " + String(wait > 0 ? wait / 1000 : 0) + " s\n";
+    }
+    info += "Free space floor: " + String(ConfigManager::getInstance().getInt("prefetch_min_free_mb", DEFAULT_MIN_FREE_MB)) + " MB\n";
+    info += "Passes: " + String(stats.passes) + ", figures requested: " + String(stats.figuresRequested) + "\n";
+    info += "Stopped for space: " + String(stats.stoppedForSpace) + ", listing failures: " + String(stats.listingFailures) + "\n";
+    return info;
+}
@@ -0,0 +1,68 @@
+#ifndef PREFETCH_SCHEDULER_H
+#define PREFETCH_SCHEDULER_H
+
+#include <Arduino.h>
+#include <vector>
+#include "RequestManager.h"
+
+// Pre-downloads figures that are likely to be docked next, so a dock is normally a
+// catalogue cache hit with every track already on the card.
+//
+// Runs only while the device is charging, on Wi-Fi and idle (nothing docked, no audio,
+// no request or download in flight). It pulls the owner's library listing, keeps the
+// figures the server flags plus the ones docked before, and fetches them one at a
+// time through RequestManager, waiting for each figure's downloads to drain before
+// the next. It stops when free space on the card falls below a floor.
+class PrefetchScheduler {
+public:
+    static PrefetchScheduler& getInstance();
+
+    void begin();
+    void update(); // Call from loop()
+
+    void runNow(); // Start a pass at the next idle moment, ignoring the interval
+    String getStatusString();
+
+private:
+    static PrefetchScheduler* instance;
+
+    static const unsigned long RUN_INTERVAL_MS = 6UL * 60UL * 60UL * 1000UL; // Between complete passes
+    static const unsigned long RETRY_INTERVAL_MS = 10UL * 60UL * 1000UL;     // After a failed listing
+    static const unsigned long CHECK_INTERVAL_MS = 2000;
+    static const unsigned long LISTING_TIMEOUT_MS = 60000;
+    static const int MAX_FIGURES_PER_PASS = 16;
+    static const int DEFAULT_MIN_FREE_MB = 256; // Config key prefetch_min_free_mb
+
+    enum State {
+        IDLE,        // Waiting for the next pass
+        LISTING,     // Library request in flight
+        PREFETCHING  // Working through the candidate list
+    };
+
+    State state;
+    unsigned long lastCheck;
+    unsigned long stateSince;
+    unsigned long nextPassAt;
+    std::vector<String> candidates;
+    size_t nextCandidate;
+
+    struct Stats {
+        uint32_t passes;
+        uint32_t figuresRequested;
+        uint32_t stoppedForSpace;
+        uint32_t listingFailures;
+    } stats;
+    String lastSkipReason;
+
+    PrefetchScheduler();
+    PrefetchScheduler(const PrefetchScheduler&) = delete;
+    PrefetchScheduler& operator=(const PrefetchScheduler&) = delete;
+
+    bool conditionsMet(String& reason);
+    bool hasSpace();
+    void finishPass(unsigned long retryAfterMs);
+    void onLibraryListing(bool success, const std::vector<RequestManager::LibraryEntry>& entries);
+    static void staticLibraryListingCallback(bool success, const std::vector<RequestManager::LibraryEntry>& entries);
+};
+
+#endif // PREFETCH_SCHEDULER_H
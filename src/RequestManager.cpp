@@ -1,8 +1,10 @@
 #include "RequestManager.h"
+#include "AudioController.h"
 
 // Initialize static members
 const char* RequestManager::NVS_NAMESPACE = "requestmgr";
 const char* RequestManager::NVS_UID_MAPPING_KEY = "uid_mappings";
+const char* RequestManager::CATALOG_DIR = "/catalog";
 
 // Singleton instance getter
 RequestManager &RequestManager::getInstance(const String &baseUrl)
@@ -14,12 +16,17 @@ RequestManager &RequestManager::getInstance(const String &baseUrl)
 // Constructor
 RequestManager::RequestManager(const String &baseUrl)
 {
-    this->baseUrl = convertToHttp(baseUrl);
+    this->baseUrl = baseUrl;
     this->timeout = 15000; // 15 seconds timeout for robustness
     this->lastStatusCode = 0;
     this->lastError = "";
     this->figureDownloadCompleteCallback = nullptr;
     this->nvsHandle = 0;
+    this->pendingRevalidationAt = 0;
+    this->libraryListingCallback = nullptr;
+    this->jobQueue = nullptr;
+    this->resultQueue = nullptr;
+    this->workerTask = nullptr;
     
     // Pre-reserve memory for containers to prevent frequent reallocations
     activeDownloads.reserve(5);
@@ -28,8 +35,6 @@ RequestManager::RequestManager(const String &baseUrl)
 // Destructor
 RequestManager::~RequestManager()
 {
-    http.end();
-    
     // Save UID mappings before cleanup
     saveUidMappings();
     
@@ -49,6 +54,9 @@ bool RequestManager::begin()
 {
     Serial.println(F("RequestManager: Initializing..."));
     
+    // Figure fetches run on their own task so the loop keeps serving audio and buttons
+    startWorker();
+    
     // Initialize NVS for UID mappings
     if (!initializeNVS()) {
         Serial.println(F("RequestManager: Failed to initialize NVS"));
@@ -80,7 +88,7 @@ bool RequestManager::begin()
 // Configuration methods
 void RequestManager::setBaseUrl(const String &url)
 {
-    this->baseUrl = convertToHttp(url);
+    this->baseUrl = url;
 }
 
 void RequestManager::setAuthToken(const String &token)
@@ -121,18 +129,6 @@ bool RequestManager::checkNetworkConnectivity()
     return true;
 }
 
-// Convert HTTPS URLs to HTTP for memory efficiency
-String RequestManager::convertToHttp(const String& url)
-{
-    String convertedUrl = url;
-    if (convertedUrl.startsWith("https://"))
-    {
-        convertedUrl.replace("https://", "http://");
-        Serial.println(F("RequestManager: Converted HTTPS to HTTP for memory efficiency"));
-    }
-    return convertedUrl;
-}
-
 // Memory-efficient string building helper
 String RequestManager::buildUrl(const String& endpoint) const
 {
@@ -167,15 +163,20 @@ void RequestManager::cleanupCompletedTrackers()
     }
 }
 
-void RequestManager::setDefaultHeaders()
+void RequestManager::setDefaultHeaders(HTTPClient &http)
+{
+    addDefaultHeaders(http, authToken);
+}
+
+void RequestManager::addDefaultHeaders(HTTPClient &http, const String &token)
 {
     http.addHeader("Content-Type", "application/json");
     http.addHeader("Accept", "application/json");
     http.addHeader("User-Agent", "TilkieTalkie/1.0");
 
-    if (authToken.length() > 0)
+    if (token.length() > 0)
     {
-        http.addHeader("Authorization", "Bearer " + authToken);
+        http.addHeader("Authorization", "Bearer " + token);
     }
 }
 
@@ -243,22 +244,21 @@ JsonDocument RequestManager::get(const String &endpoint)
 
     String url = buildUrl(endpoint);
     
-    // Clean up any previous connections
-    http.end();
-    
-    // Begin HTTP connection (not HTTPS)
-    if (!http.begin(client, url))
+    // Pooled keep-alive connection, reused when one to the same host is idle
+    HTTPClient *request = ConnectionManager::getInstance().beginRequest(url, lastError);
+    if (!request)
     {
-        lastError = "Failed to establish HTTP connection to " + url;
+        lastError = "Failed to establish HTTP connection: " + lastError;
         Serial.println("RequestManager: " + lastError);
         emptyDoc["error"] = true;
         emptyDoc["message"] = lastError;
         return emptyDoc;
     }
 
+    HTTPClient &http = *request;
     http.setTimeout(timeout);
     http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-    setDefaultHeaders();
+    setDefaultHeaders(http);
 
     Serial.print(F("RequestManager: Sending GET request to "));
     Serial.println(url);
@@ -268,7 +268,7 @@ JsonDocument RequestManager::get(const String &endpoint)
     if (httpResponseCode > 0)
     {
         String response = http.getString();
-        http.end();
+        ConnectionManager::getInstance().endRequest(&http);
         
         Serial.printf("RequestManager: GET response code: %d, size: %d bytes\n", httpResponseCode, response.length());
         return parseResponse(response);
@@ -296,7 +296,7 @@ JsonDocument RequestManager::get(const String &endpoint)
         lastError = "HTTP GET failed with code: " + String(httpResponseCode) + " (" + errorDetail + ")";
         Serial.println("RequestManager: " + lastError + " to URL: " + url);
         
-        http.end();
+        ConnectionManager::getInstance().endRequest(&http);
         emptyDoc["error"] = true;
         emptyDoc["message"] = lastError;
         return emptyDoc;
@@ -331,22 +331,21 @@ JsonDocument RequestManager::post(const String &endpoint, const JsonDocument &da
 
     String url = buildUrl(endpoint);
     
-    // Clean up any previous connections
-    http.end();
-    
-    // Begin HTTP connection
-    if (!http.begin(client, url))
+    // Pooled keep-alive connection, reused when one to the same host is idle
+    HTTPClient *request = ConnectionManager::getInstance().beginRequest(url, lastError);
+    if (!request)
     {
-        lastError = "Failed to establish HTTP POST connection to " + url;
+        lastError = "Failed to establish HTTP POST connection: " + lastError;
         Serial.println("RequestManager: " + lastError);
         emptyDoc["error"] = true;
         emptyDoc["message"] = lastError;
         return emptyDoc;
     }
     
+    HTTPClient &http = *request;
     http.setTimeout(timeout);
     http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-    setDefaultHeaders();
+    setDefaultHeaders(http);
 
     String jsonString;
     jsonString.reserve(512); // Pre-reserve space for JSON serialization
@@ -360,7 +359,7 @@ JsonDocument RequestManager::post(const String &endpoint, const JsonDocument &da
     if (httpResponseCode > 0)
     {
         String response = http.getString();
-        http.end();
+        ConnectionManager::getInstance().endRequest(&http);
         
         Serial.printf("RequestManager: POST response code: %d, size: %d bytes\n", httpResponseCode, response.length());
         return parseResponse(response);
@@ -370,7 +369,7 @@ JsonDocument RequestManager::post(const String &endpoint, const JsonDocument &da
         lastError = "HTTP POST failed with code: " + String(httpResponseCode);
         Serial.println("RequestManager: " + lastError);
         
-        http.end();
+        ConnectionManager::getInstance().endRequest(&http);
         emptyDoc["error"] = true;
         emptyDoc["message"] = lastError;
         return emptyDoc;
@@ -401,19 +400,18 @@ String RequestManager::getJWTToken()
     String endpoint = "/hubs/" + String(macAddress, 10) + "/token";
     String url = buildUrl(endpoint);
     
-    // Clean up any previous connections
-    http.end();
-    
-    // Begin HTTP connection
-    if (!http.begin(client, url))
+    // Pooled keep-alive connection, reused when one to the same host is idle
+    HTTPClient *request = ConnectionManager::getInstance().beginRequest(url, lastError);
+    if (!request)
     {
-        lastError = "Failed to establish JWT token connection";
+        lastError = "Failed to establish JWT token connection: " + lastError;
         Serial.println("RequestManager: " + lastError);
         return String();
     }
     
+    HTTPClient &http = *request;
     http.setTimeout(timeout);
-    setDefaultHeaders();
+    setDefaultHeaders(http);
 
     Serial.println(F("RequestManager: Requesting JWT token"));
     int httpResponseCode = http.GET();
@@ -422,7 +420,7 @@ String RequestManager::getJWTToken()
     if (httpResponseCode > 0)
     {
         String response = http.getString();
-        http.end();
+        ConnectionManager::getInstance().endRequest(&http);
         
         JsonDocument doc = parseResponse(response);
         // check if status is success
@@ -444,7 +442,7 @@ String RequestManager::getJWTToken()
         lastError = "HTTP GET failed with code: " + String(httpResponseCode);
         Serial.println("RequestManager: " + lastError);
         
-        http.end();
+        ConnectionManager::getInstance().endRequest(&http);
         return String();
     }
 }
@@ -457,19 +455,18 @@ bool RequestManager::validateToken(const String& token)
     String endpoint = "/hubs/" + String(macAddress, 10) + "/validate-token";
     String url = buildUrl(endpoint);
     
-    // Clean up any previous connections
-    http.end();
-    
-    // Begin HTTP connection
-    if (!http.begin(client, url))
+    // Pooled keep-alive connection, reused when one to the same host is idle
+    HTTPClient *request = ConnectionManager::getInstance().beginRequest(url, lastError);
+    if (!request)
     {
-        lastError = "Failed to establish token validation connection";
+        lastError = "Failed to establish token validation connection: " + lastError;
         Serial.println("RequestManager: " + lastError);
         return false;
     }
     
+    HTTPClient &http = *request;
     http.setTimeout(timeout);
-    setDefaultHeaders();
+    setDefaultHeaders(http);
 
     // add Authorization header
     String authHeader = "Bearer " + token;
@@ -479,7 +476,7 @@ bool RequestManager::validateToken(const String& token)
     int httpResponseCode = http.GET();
     lastStatusCode = httpResponseCode;
 
-    http.end();
+    ConnectionManager::getInstance().endRequest(&http);
     
     if (httpResponseCode == 200)
     {
@@ -532,364 +529,1255 @@ void RequestManager::initConnection()
     setAuthToken(storedToken);
 }
 
+// Builds the figure model from streamed parser events, so nothing but the model itself
+// grows with the catalogue size. The same listener reads the server response and the
+// cached copy on SD; the mode decides what happens to each track's audio file.
+class FigureBuilder : public FigureStreamParser::Listener
+{
+public:
+    enum Mode
+    {
+        FETCHED,    // Server response on the worker task: build the model only, no SD access
+        FROM_CACHE, // Unchanged metadata: tracks are already required, only fetch missing ones
+        OFFLINE     // No network: keep only the tracks that are on the card
+    };
+
+    RequestManager::Figure figure;
+    int tracksToDownload;
+    int tracksAlreadyExist;
+
+    explicit FigureBuilder(Mode mode, DownloadPriority priority = DOWNLOAD_PRIORITY_DOCKED)
+        : tracksToDownload(0), tracksAlreadyExist(0), mode(mode), priority(priority) {}
+
+    void onEpisodeStart(uint32_t figureId, uint32_t episodeId) override
+    {
+        RequestManager::Episode episode;
+        episode.id = String(episodeId);
+        figure.episodes.push_back(std::move(episode));
+    }
+
+    void onTrack(uint32_t figureId, uint32_t episodeId, FigureStreamParser::TrackFields &fields) override
+    {
+        RequestManager::Track track;
+        track.ref = TrackId(figureId, episodeId, fields.id);
+        track.name = std::move(fields.name);
+        track.description = std::move(fields.description);
+        track.audioUrl = std::move(fields.audioUrl);
+        track.duration = fields.duration;
+        track.size = fields.size;
+        track.contentTag = FigureManifest::contentTag(fields.contentHash, fields.version);
+        // The catalogue cache does not keep hashes; where a cached track's audio lives is
+        // whatever the manifest written by the last sync says
+        track.blobKey = mode == FETCHED ? BlobStore::keyFor(fields.contentHash) : BlobStore::getInstance().lookupKey(track.ref);
+
+        if (fields.audioUrlTruncated)
+        {
+            Serial.print(F("RequestManager: Audio URL too long, skipping download: "));
+            Serial.println(track.name);
+            track.audioUrl = ""; // Never keep or cache a cut-off URL
+        }
+
+        if (mode == FETCHED)
+        {
+            figure.episodes.back().tracks.push_back(std::move(track));
+            return;
+        }
+
+        if (!track.ref.isValid())
+        {
+            if (mode == OFFLINE)
+            {
+                return;
+            }
+        }
+        else
+        {
+            char pathBuffer[TrackId::PATH_MAX_LEN];
+            BlobStore::localPath(track.ref, track.blobKey, pathBuffer, sizeof(pathBuffer));
+            FileManager &fileManager = FileManager::getInstance();
+
+            if (fileManager.fileExists(pathBuffer))
+            {
+                tracksAlreadyExist++;
+            }
+            else if (mode == OFFLINE)
+            {
+                return;
+            }
+            else if (track.audioUrl.length() > 0)
+            {
+                Serial.print(F("RequestManager: Starting download: "));
+                Serial.println(track.name);
+                fileManager.scheduleDownload(track.audioUrl, pathBuffer, "", priority);
+                tracksToDownload++;
+            }
+        }
+
+        figure.episodes.back().tracks.push_back(std::move(track));
+    }
+
+    void onEpisodeEnd(uint32_t episodeId, const String &name, const String &description) override
+    {
+        if (mode == OFFLINE && figure.episodes.back().tracks.empty())
+        {
+            figure.episodes.pop_back();
+            return;
+        }
+        figure.episodes.back().name = name;
+        figure.episodes.back().description = description;
+    }
+
+    void onFigureEnd(uint32_t figureId, const String &name, const String &description) override
+    {
+        figure.id = String(figureId);
+        figure.name = name;
+        figure.description = description;
+    }
+
+private:
+    Mode mode;
+    DownloadPriority priority;
+};
+
 void RequestManager::getCheckFigureTracks(const String &uid)
 {
     Serial.println(F("RequestManager: Processing figure tracks request"));
     Serial.print(F("UID: "));
     Serial.println(uid);
     
+    // A new dock supersedes anything still running for the previous one
+    cancelFigureRequests();
+    
     // Check if we have WiFi connectivity
     bool isOnline = checkNetworkConnectivity();
     Serial.print(F("RequestManager: Device is "));
     Serial.println(isOnline ? F("online") : F("offline"));
     
+    if (isOnline && ConfigManager::getInstance().getInt("swr_playback", 1)) {
+        // Stale-while-revalidate: play what is already on the card right away and let
+        // update() check the server afterwards, instead of waiting on the round trip
+        Figure cachedFigure;
+        if (loadCachedFigure(uid, FigureBuilder::OFFLINE, cachedFigure) && !cachedFigure.episodes.empty()) {
+            Serial.println(F("RequestManager: Playing from catalogue cache, revalidating in the background"));
+            pendingRevalidationUid = uid;
+            pendingRevalidationAt = millis() + REVALIDATE_DELAY_MS;
+            startTrackingFigure(uid, std::move(cachedFigure));
+            return;
+        }
+    }
+    
     if (isOnline) {
-        // Online mode - fetch from server and update local storage
-        processOnlineFigureRequest(uid);
+        // Online mode - fetch from server on the worker task, the result arrives in update()
+        submitFigureRequest(uid, RequestJob::DOCK);
     } else {
         // Offline mode - check if we have local data for this UID
         processOfflineFigureRequest(uid);
     }
 }
 
-void RequestManager::processOnlineFigureRequest(const String &uid)
+void RequestManager::update()
 {
-    String endpoint = "/units/" + uid;
-    String url = buildUrl(endpoint);
-    
-    // Clean up any previous connections
-    http.end();
-    
-    // Begin HTTP connection
-    if (!http.begin(client, url))
-    {
-        lastError = "Failed to establish figure tracks connection";
-        Serial.println("RequestManager: " + lastError);
-        return;
-    }
-    
-    http.setTimeout(timeout);
-    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-    setDefaultHeaders();
-
-    Serial.println(F("RequestManager: Fetching figure tracks from server"));
-    int httpResponseCode = http.GET();
-    lastStatusCode = httpResponseCode;
-
-    if (httpResponseCode > 0)
+    // Finished fetches are applied here, on the loop task that owns the SD card,
+    // the figure trackers and the callbacks
+    RequestJob *job;
+    while (resultQueue != nullptr && xQueueReceive(resultQueue, &job, 0) == pdTRUE)
     {
-        String response = http.getString();
-        http.end();
-        
-        JsonDocument doc = parseResponse(response);
-        if (doc["error"].as<bool>())
+        for (auto it = requestJobs.begin(); it != requestJobs.end(); ++it)
         {
-            Serial.println(F("RequestManager: API returned error"));
-            return;
-        }
-
-        // Get file manager instance
-        FileManager &fileManager = FileManager::getInstance();
-        
-        JsonObject figure = doc["figure"].as<JsonObject>();
-        if (figure.isNull()) {
-            // Try alternative keys that might contain the figure data
-            if (!doc["data"].isNull()) {
-                figure = doc["data"].as<JsonObject>();
-            } else if (!doc["unit"].isNull()) {
-                figure = doc["unit"].as<JsonObject>();
-            }
-        }
-        
-        if (figure.isNull()) {
-            if (figureDownloadCompleteCallback)
+            if (*it == job)
             {
-                Figure emptyFigure;
-                figureDownloadCompleteCallback(uid, "null", false, "No figure data found", emptyFigure);
+                requestJobs.erase(it);
+                break;
             }
-            return;
-        }
-        
-        String figureId = String(figure["id"].as<int>());
-        String figureName = figure["name"].as<String>();
-        JsonArray episodes = figure["episodes"].as<JsonArray>();
-        
-        // Store UID to Figure ID mapping in NVS immediately
-        storeUidToFigureIdMapping(uid, figureId);
-        
-        // Parse the complete figure structure for the callback
-        Figure figureData;
-        figureData.id = figureId;
-        figureData.name = figureName;
-        figureData.description = figure["description"].as<String>();
-        
-        // Pre-reserve capacity based on episodes count
-        if (episodes.size() > 0) {
-            figureData.episodes.reserve(episodes.size());
         }
-        
-        // Parse episodes and tracks
-        std::vector<String> trackPaths;
-        int tracksToDownload = 0;
-        int tracksAlreadyExist = 0;
-        
-        for (JsonVariant episodeVar : episodes)
+        if (job->kind == RequestJob::LIBRARY)
         {
-            JsonObject episodeObj = episodeVar.as<JsonObject>();
-            Episode episode;
-            episode.id = String(episodeObj["id"].as<int>());
-            episode.name = episodeObj["name"].as<String>();
-            episode.description = episodeObj["description"].as<String>();
-            
-            JsonArray tracks = episodeObj["tracks"].as<JsonArray>();
-            if (tracks.size() > 0) {
-                episode.tracks.reserve(tracks.size());
-            }
-            
-            for (JsonVariant trackVar : tracks)
-            {
-                JsonObject trackObj = trackVar.as<JsonObject>();
-                Track track;
-                track.id = String(trackObj["id"].as<int>());
-                track.name = trackObj["name"].as<String>();
-                track.description = trackObj["description"].as<String>();
-                track.audioUrl = trackObj["audio_url"].as<String>();
-                track.duration = trackObj["duration"].as<int>();
-                
-                // Create local path for the track using the original file structure
-                track.localPath = "/figures/" + figureId + "/" + episode.id + "/" + track.id + ".wav";
-                trackPaths.push_back(track.localPath);
-                
-                // Always add to required files list (regardless of whether file exists)
-                if (track.audioUrl.length() > 0)
-                {
-                    // Add to required files list first
-                    fileManager.addRequiredFile(track.localPath, track.audioUrl);
-                    
-                    // Then check if we need to download
-                    if (!fileManager.fileExists(track.localPath))
-                    {
-                        Serial.print(F("RequestManager: Starting download: "));
-                        Serial.println(track.name);
-                        fileManager.scheduleDownload(track.audioUrl, track.localPath);
-                        tracksToDownload++;
-                    }
-                    else
-                    {
-                        Serial.print(F("RequestManager: File already exists, skipping download: "));
-                        Serial.println(track.name);
-                        tracksAlreadyExist++;
-                    }
-                }
-                
-                episode.tracks.push_back(std::move(track));
-            }
-            
-            figureData.episodes.push_back(std::move(episode));
+            applyLibraryResult(*job);
         }
-        
-        // Start tracking the download progress
-        startTrackingFigure(uid, figureName, figureId, trackPaths, figureData);
-        
-        // More informative download summary
-        if (tracksToDownload > 0)
+        else if (job->cancelled)
         {
-            Serial.print(F("RequestManager: Started downloading "));
-            Serial.print(tracksToDownload);
-            Serial.print(F(" new tracks for figure: "));
-            Serial.println(figureName);
+            Serial.printf("RequestManager: Discarded cancelled figure request for %s\n", job->uid.c_str());
         }
-        if (tracksAlreadyExist > 0)
+        else
         {
-            Serial.print(F("RequestManager: "));
-            Serial.print(tracksAlreadyExist);
-            Serial.print(F(" tracks already exist for figure: "));
-            Serial.println(figureName);
+            applyFigureResult(*job);
         }
+        delete job;
     }
-    else
-    {
-        lastError = "HTTP GET failed with code: " + String(httpResponseCode);
-        Serial.println("RequestManager: " + lastError);
-        http.end();
-    }
-}
 
-void RequestManager::processOfflineFigureRequest(const String &uid)
-{
-    Serial.println(F("RequestManager: Processing offline figure request"));
-    
-    // Check if we have a mapping for this UID
-    String figureId = getFigureIdFromUid(uid);
-    if (figureId.isEmpty()) {
-        Serial.println(F("RequestManager: No offline data found for this UID"));
-        if (figureDownloadCompleteCallback) {
-            Figure emptyFigure;
-            figureDownloadCompleteCallback(uid, "Unknown", false, "No offline data available for this figure", emptyFigure);
-        }
+    if (pendingRevalidationUid.isEmpty() || (long)(millis() - pendingRevalidationAt) < 0)
+    {
         return;
     }
-    
-    Serial.print(F("RequestManager: Found offline mapping for UID "));
-    Serial.print(uid);
-    Serial.print(F(" -> Figure ID "));
-    Serial.println(figureId);
-    
-    // Construct figure from local files
-    Figure figureData = constructFigureFromLocalFiles(uid, figureId);
-    
-    if (figureData.episodes.empty()) {
-        Serial.println(F("RequestManager: No local tracks found for figure"));
-        if (figureDownloadCompleteCallback) {
-            figureDownloadCompleteCallback(uid, figureData.name.isEmpty() ? "Unknown" : figureData.name, 
-                                         false, "No local tracks available", figureData);
-        }
+
+    String uid = pendingRevalidationUid;
+    pendingRevalidationUid = "";
+    if (!isWiFiConnected())
+    {
+        Serial.println(F("RequestManager: WiFi lost, skipping figure revalidation"));
         return;
     }
-    
-    // Create track paths for tracking
-    std::vector<String> trackPaths;
-    for (const auto& episode : figureData.episodes) {
-        for (const auto& track : episode.tracks) {
-            trackPaths.push_back(track.localPath);
+
+    // The result reaches the app through the normal completion callback, which patches
+    // the playlist in place. Failures only get logged, playback from the card goes on.
+    Serial.print(F("RequestManager: Revalidating figure "));
+    Serial.println(uid);
+    submitFigureRequest(uid, RequestJob::REVALIDATE);
+}
+
+void RequestManager::cancelFigureRequests()
+{
+    pendingRevalidationUid = "";
+
+    // Whatever the removed figure still needs becomes background work
+    FileManager::getInstance().demoteDownloads(DOWNLOAD_PRIORITY_PREFETCH);
+
+    // The worker polls the flag while reading the body; a fetch still connecting runs
+    // until its timeout but its result is dropped in update()
+    for (RequestJob *job : requestJobs)
+    {
+        if (!job->cancelled)
+        {
+            job->cancelled = true;
+            Serial.printf("RequestManager: Cancelling request for %s\n", job->kind == RequestJob::LIBRARY ? "figure library" : job->uid.c_str());
         }
     }
-    
-    // Start tracking (all tracks should be ready since we're offline)
-    startTrackingFigure(uid, figureData.name, figureId, trackPaths, figureData);
-    
-    Serial.print(F("RequestManager: Offline figure ready with "));
-    Serial.print(trackPaths.size());
-    Serial.print(F(" tracks: "));
-    Serial.println(figureData.name);
 }
 
-// Figure download callback system implementation
-void RequestManager::setFigureDownloadCompleteCallback(FigureDownloadCompleteCallback callback)
+bool RequestManager::startWorker()
 {
-    this->figureDownloadCompleteCallback = callback;
+    if (workerTask != nullptr)
+    {
+        return true;
+    }
+
+    // Create the pool before the worker can race the loop task to it
+    ConnectionManager::getInstance();
+
+    jobQueue = xQueueCreate(JOB_QUEUE_LENGTH, sizeof(RequestJob *));
+    resultQueue = xQueueCreate(JOB_QUEUE_LENGTH + 1, sizeof(RequestJob *)); // Queued jobs plus the one in flight
+    if (jobQueue == nullptr || resultQueue == nullptr)
+    {
+        Serial.println(F("RequestManager: Failed to create request queues"));
+        return false;
+    }
+
+    // Same core as the WiFi stack, the Arduino loop keeps core 1 to itself
+    if (xTaskCreatePinnedToCore(workerLoop, "reqmgr", WORKER_STACK_SIZE, this, WORKER_PRIORITY, &workerTask, 0) != pdPASS)
+    {
+        Serial.println(F("RequestManager: Failed to start request worker"));
+        workerTask = nullptr;
+        return false;
+    }
+
+    Serial.println(F("RequestManager: Request worker started"));
+    return true;
 }
 
-void RequestManager::startTrackingFigure(const String &uid, const String &figureName, const String &figureId, const std::vector<String> &trackPaths, const Figure &figureData)
+void RequestManager::workerLoop(void *param)
 {
-    // Clean up completed trackers periodically to prevent memory bloat
-    cleanupCompletedTrackers();
-    
-    // Remove any existing tracker for this UID to prevent duplicates
-    for (auto it = activeDownloads.begin(); it != activeDownloads.end(); ++it)
+    RequestManager *self = static_cast<RequestManager *>(param);
+    RequestJob *job;
+    while (true)
     {
-        if (it->uid == uid)
+        if (xQueueReceive(self->jobQueue, &job, portMAX_DELAY) != pdTRUE)
         {
-            activeDownloads.erase(it);
-            break;
+            continue;
         }
-    }
-    
-    // Create new tracker
-    FigureDownloadTracker tracker;
-    tracker.uid = uid;
-    tracker.figureName = figureName;
-    tracker.figureId = figureId;
-    tracker.totalTracks = trackPaths.size();
-    tracker.tracksReady = 0;
-    tracker.tracksFailed = 0;
-    tracker.trackPaths = trackPaths;
-    tracker.completed = false;
-    tracker.figureData = figureData;
-    
-    // Count tracks that already exist
-    FileManager &fileManager = FileManager::getInstance();
-    for (const String &path : trackPaths)
-    {
-        if (fileManager.fileExists(path))
+        if (job->cancelled)
         {
-            tracker.tracksReady++;
+            // Dropped before it started
         }
-    }
-    
-    Serial.print(F("Started tracking figure '"));
-    Serial.print(figureName);
-    Serial.print(F("' (UID: "));
-    Serial.print(uid);
-    Serial.print(F("): "));
-    Serial.print(tracker.totalTracks);
-    Serial.print(F(" total tracks, "));
-    Serial.print(tracker.tracksReady);
-    Serial.println(F(" already ready"));
-    
-    // Check if all tracks are already ready before adding to activeDownloads
-    bool allTracksReady = (tracker.tracksReady >= tracker.totalTracks && tracker.totalTracks > 0);
-    
-    if (allTracksReady)
-    {
-        Serial.println(F("All tracks already exist, triggering immediate callback"));
-        tracker.completed = true;
-        
-        if (figureDownloadCompleteCallback)
+        else if (job->kind == RequestJob::LIBRARY)
+        {
+            self->fetchLibrary(*job);
+        }
+        else
         {
-            figureDownloadCompleteCallback(uid, figureName, true, "", figureData);
+            self->fetchFigure(*job);
         }
+        xQueueSend(self->resultQueue, &job, portMAX_DELAY);
     }
-    
-    activeDownloads.push_back(std::move(tracker));
 }
 
-void RequestManager::checkFigureDownloadStatus(const String &uid)
+bool RequestManager::submitFigureRequest(const String &uid, RequestJob::Origin origin)
 {
-    for (auto &tracker : activeDownloads)
+    // Re-docks shortly after a successful check skip the network entirely
+    auto validated = catalogValidatedAt.find(uid);
+    if (validated != catalogValidatedAt.end() && millis() - validated->second < CATALOG_FRESH_MS &&
+        hasFigureManifest(uid))
     {
-        if (tracker.uid == uid && !tracker.completed)
+        if (origin == RequestJob::PREFETCH)
         {
-            if (tracker.tracksReady + tracker.tracksFailed >= tracker.totalTracks)
-            {
-                tracker.completed = true;
-                bool success = (tracker.tracksReady > 0) && (tracker.tracksFailed == 0);
-                
-                if (figureDownloadCompleteCallback)
-                {
-                    String error = success ? "" : "Some tracks failed to download";
-                    figureDownloadCompleteCallback(uid, tracker.figureName, success, error, tracker.figureData);
-                }
-                
-                Serial.print(F("Figure download completed for: "));
-                Serial.print(tracker.figureName);
-                Serial.print(F(" - Success: "));
-                Serial.print(success ? "Yes" : "No");
-                Serial.print(F(" ("));
-                Serial.print(tracker.tracksReady);
-                Serial.print(F("/"));
-                Serial.print(tracker.totalTracks);
-                Serial.println(F(" tracks ready)"));
-                break;
-            }
+            return true;
+        }
+        Serial.println(F("RequestManager: Figure metadata checked recently, using catalogue cache"));
+        if (serveCachedFigure(uid))
+        {
+            return true;
         }
+        catalogValidatedAt.erase(validated);
     }
+
+    // Everything the worker needs is copied into the job so it never reads shared state
+    RequestJob *job = createJob(RequestJob::FIGURE, "/units/" + uid);
+    job->uid = uid;
+    job->origin = origin;
+    job->etag = loadCachedETag(uid);
+    return enqueueJob(job);
 }
 
-void RequestManager::onTrackDownloadComplete(const String &path, bool success)
+bool RequestManager::prefetchFigure(const String &uid)
 {
-    // Find which figure this track belongs to
-    for (auto &tracker : activeDownloads)
+    return submitFigureRequest(uid, RequestJob::PREFETCH);
+}
+
+bool RequestManager::requestLibraryListing()
+{
+    if (!isWiFiConnected())
     {
-        if (!tracker.completed)
+        return false;
+    }
+    return enqueueJob(createJob(RequestJob::LIBRARY, "/units"));
+}
+
+RequestManager::RequestJob *RequestManager::createJob(RequestJob::Kind kind, const String &endpoint)
+{
+    RequestJob *job = new RequestJob();
+    job->kind = kind;
+    job->origin = RequestJob::DOCK;
+    job->url = buildUrl(endpoint);
+    job->authToken = authToken;
+    job->cancelled = false;
+    job->submittedAt = millis();
+    job->statusCode = 0;
+    job->parsed = false;
+    job->bytesRead = 0;
+    return job;
+}
+
+bool RequestManager::enqueueJob(RequestJob *job)
+{
+    if (workerTask == nullptr)
+    {
+        // No worker (begin() not run or failed), run inline as before
+        if (job->kind == RequestJob::LIBRARY)
+        {
+            fetchLibrary(*job);
+            applyLibraryResult(*job);
+        }
+        else
+        {
+            fetchFigure(*job);
+            applyFigureResult(*job);
+        }
+        delete job;
+        return true;
+    }
+
+    requestJobs.push_back(job);
+    if (xQueueSend(jobQueue, &job, 0) != pdTRUE)
+    {
+        requestJobs.pop_back();
+        delete job;
+        lastError = "Request queue full";
+        Serial.println("RequestManager: " + lastError);
+        return false;
+    }
+    Serial.println(F("RequestManager: Request queued"));
+    return true;
+}
+
+// Runs on the worker task. Only the uid list is kept, filtered while it is read.
+// Expected shape: {"data":[{"uid":"..","prefetch":true},..]} ("units" also accepted)
+void RequestManager::fetchLibrary(RequestJob &job)
+{
+    HTTPClient *request = ConnectionManager::getInstance().beginRequest(job.url, job.error);
+    if (!request)
+    {
+        job.error = "Failed to establish library connection: " + job.error;
+        return;
+    }
+
+    HTTPClient &http = *request;
+    http.setTimeout(timeout);
+    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
+    http.useHTTP10(true);
+    addDefaultHeaders(http, job.authToken);
+
+    job.statusCode = http.GET();
+    if (job.statusCode != HTTP_CODE_OK)
+    {
+        job.error = "Library request failed with code: " + String(job.statusCode);
+        ConnectionManager::getInstance().endRequest(&http, false);
+        return;
+    }
+
+    DynamicJsonDocument filter(256);
+    filter["data"][0]["uid"] = true;
+    filter["data"][0]["prefetch"] = true;
+    filter["units"][0]["uid"] = true;
+    filter["units"][0]["prefetch"] = true;
+
+    WiFiClient *stream = http.getStreamPtr();
+    if (stream == nullptr)
+    {
+        job.error = "Library response has no body";
+        ConnectionManager::getInstance().endRequest(&http, false);
+        return;
+    }
+
+    DynamicJsonDocument doc(MAX_RESPONSE_SIZE);
+    DeserializationError error = deserializeJson(doc, *stream, DeserializationOption::Filter(filter));
+    ConnectionManager::getInstance().endRequest(&http, !error);
+    if (error)
+    {
+        job.error = "Library JSON parsing error: " + String(error.c_str());
+        return;
+    }
+
+    JsonArray units = doc["data"].as<JsonArray>();
+    if (units.isNull())
+    {
+        units = doc["units"].as<JsonArray>();
+    }
+    for (JsonObject unit : units)
+    {
+        const char *uid = unit["uid"];
+        if (uid == nullptr || uid[0] == '\0')
+        {
+            continue;
+        }
+        LibraryEntry entry;
+        entry.uid = uid;
+        entry.flagged = unit["prefetch"] | false;
+        job.library.push_back(std::move(entry));
+    }
+    job.parsed = true;
+}
+
+void RequestManager::applyLibraryResult(RequestJob &job)
+{
+    bool success = job.parsed && !job.cancelled;
+    if (job.cancelled)
+    {
+        Serial.println(F("RequestManager: Library request cancelled"));
+    }
+    else if (!success)
+    {
+        lastError = job.error;
+        Serial.println("RequestManager: " + lastError);
+    }
+    else
+    {
+        Serial.printf("RequestManager: Library lists %u figures\n", job.library.size());
+    }
+
+    // Reported even when cancelled, so the caller is never left waiting
+    if (libraryListingCallback)
+    {
+        libraryListingCallback(success, job.library);
+    }
+}
+
+bool RequestManager::hasCachedFigure(const String &uid)
+{
+    return FileManager::getInstance().fileExists(getCatalogPath(uid, ".json"));
+}
+
+bool RequestManager::wasDockedBefore(const String &uid) const
+{
+    return uidToFigureIdMap.find(uid) != uidToFigureIdMap.end();
+}
+
+void RequestManager::setLibraryListingCallback(LibraryListingCallback callback)
+{
+    this->libraryListingCallback = callback;
+}
+
+// Runs on the worker task: network and parsing only, no SD card, callbacks or members
+// other than the read-only timeout
+void RequestManager::fetchFigure(RequestJob &job)
+{
+    // Pooled keep-alive connection, reused when one to the same host is idle
+    HTTPClient *request = ConnectionManager::getInstance().beginRequest(job.url, job.error);
+    if (!request)
+    {
+        job.error = "Failed to establish figure tracks connection: " + job.error;
+        return;
+    }
+    
+    HTTPClient &http = *request;
+    http.setTimeout(timeout);
+    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
+    // HTTP/1.0 so the body arrives unchunked and can be parsed straight off the socket
+    http.useHTTP10(true);
+    addDefaultHeaders(http, job.authToken);
+
+    // Conditional request when we hold a cached copy, the server answers 304 if unchanged
+    if (!job.etag.isEmpty())
+    {
+        http.addHeader("If-None-Match", job.etag);
+    }
+    const char *collectedHeaders[] = {"ETag"};
+    http.collectHeaders(collectedHeaders, 1);
+
+    job.statusCode = http.GET();
+    if (job.statusCode <= 0)
+    {
+        job.error = "HTTP GET failed with code: " + String(job.statusCode);
+        ConnectionManager::getInstance().endRequest(&http);
+        return;
+    }
+
+    if (job.statusCode == HTTP_CODE_NOT_MODIFIED || job.cancelled)
+    {
+        // A cancelled request leaves its body unread, so its socket cannot be reused
+        ConnectionManager::getInstance().endRequest(&http, !job.cancelled);
+        return;
+    }
+
+    job.responseETag = http.header("ETag");
+
+    // Parse the body as it streams in instead of buffering the whole response
+    WiFiClient *stream = http.getStreamPtr();
+    FigureBuilder builder(FigureBuilder::FETCHED);
+    if (stream)
+    {
+        FigureStreamParser parser(*stream, stream, builder, timeout);
+        parser.setCancelFlag(&job.cancelled);
+        job.parsed = parser.parse();
+        job.bytesRead = parser.getBytesRead();
+        if (!job.parsed)
+        {
+            job.error = "Figure response parse error: " + parser.getError();
+        }
+        else if (!parser.foundFigure())
+        {
+            job.error = parser.getServerMessage().isEmpty() ? String("No figure data found") : parser.getServerMessage();
+            job.parsed = false;
+        }
+    }
+    ConnectionManager::getInstance().endRequest(&http, job.parsed);
+    job.figure = std::move(builder.figure);
+}
+
+void RequestManager::applyFigureResult(RequestJob &job)
+{
+    const String &uid = job.uid;
+    lastStatusCode = job.statusCode;
+    Serial.printf("RequestManager: Figure request for %s took %lu ms (HTTP %d, %u bytes streamed)\n",
+                  uid.c_str(), millis() - job.submittedAt, job.statusCode, job.bytesRead);
+
+    if (job.statusCode <= 0)
+    {
+        lastError = job.error;
+        Serial.println("RequestManager: " + lastError);
+        return;
+    }
+
+    if (job.statusCode == HTTP_CODE_NOT_MODIFIED && job.origin == RequestJob::PREFETCH)
+    {
+        // Nothing changed, only make sure every track is downloaded or queued
+        Figure cachedFigure;
+        if (loadCachedFigure(uid, FigureBuilder::FROM_CACHE, cachedFigure, DOWNLOAD_PRIORITY_PREFETCH))
+        {
+            catalogValidatedAt[uid] = millis();
+        }
+        return;
+    }
+
+    if (job.statusCode == HTTP_CODE_NOT_MODIFIED)
+    {
+        Serial.println(F("RequestManager: Figure metadata not modified (304), using catalogue cache"));
+        if (serveCachedFigure(uid))
         {
-            for (const String &trackPath : tracker.trackPaths)
+            catalogValidatedAt[uid] = millis();
+            return;
+        }
+        // The cached copy went missing between the check and the read, refetch next dock
+        FileManager::getInstance().deleteFile(getCatalogPath(uid, ".etag"));
+        lastError = "Catalogue cache unreadable after 304";
+        if (figureDownloadCompleteCallback && job.origin == RequestJob::DOCK)
+        {
+            Figure emptyFigure;
+            figureDownloadCompleteCallback(uid, "null", false, lastError, emptyFigure);
+        }
+        return;
+    }
+
+    if (!job.parsed)
+    {
+        lastError = job.error.isEmpty() ? String("No figure data found") : job.error;
+        Serial.println("RequestManager: " + lastError);
+        if (figureDownloadCompleteCallback && job.origin == RequestJob::DOCK)
+        {
+            Figure emptyFigure;
+            figureDownloadCompleteCallback(uid, "null", false, lastError, emptyFigure);
+        }
+        return;
+    }
+
+    Figure &figure = job.figure;
+    int tracksToDownload = 0;
+    int tracksAlreadyExist = 0;
+    DownloadPriority priority = job.origin == RequestJob::PREFETCH ? DOWNLOAD_PRIORITY_PREFETCH : DOWNLOAD_PRIORITY_DOCKED;
+    syncFigureTracks(figure, priority, tracksToDownload, tracksAlreadyExist);
+
+    // Keep the metadata for re-docks and offline playback
+    if (saveCachedFigure(uid, figure, job.responseETag))
+    {
+        catalogValidatedAt[uid] = millis();
+    }
+
+    String figureName = figure.name;
+    
+    // Store UID to Figure ID mapping in NVS
+    storeUidToFigureIdMapping(uid, figure.id);
+    
+    if (job.origin == RequestJob::PREFETCH)
+    {
+        // Not docked, so nothing to track or play; the downloads run in the background
+        Serial.printf("RequestManager: Prefetched figure '%s', %d tracks queued, %d already on card\n",
+                      figureName.c_str(), tracksToDownload, tracksAlreadyExist);
+        return;
+    }
+    
+    // Start tracking the download progress
+    startTrackingFigure(uid, std::move(figure));
+    
+    // More informative download summary
+    if (tracksToDownload > 0)
+    {
+        Serial.print(F("RequestManager: Started downloading "));
+        Serial.print(tracksToDownload);
+        Serial.print(F(" new tracks for figure: "));
+        Serial.println(figureName);
+    }
+    if (tracksAlreadyExist > 0)
+    {
+        Serial.print(F("RequestManager: "));
+        Serial.print(tracksAlreadyExist);
+        Serial.print(F(" tracks already exist for figure: "));
+        Serial.println(figureName);
+    }
+}
+
+void RequestManager::syncFigureTracks(const Figure &figure, DownloadPriority priority, int &tracksToDownload, int &tracksAlreadyExist)
+{
+    FileManager &fileManager = FileManager::getInstance();
+    uint32_t figureId = strtoul(figure.id.c_str(), nullptr, 10);
+    if (figureId == 0)
+    {
+        return;
+    }
+
+    // What the server lists now, keyed like the manifest on the card
+    FigureManifest remote;
+    std::map<TrackId, const Track *> remoteTracks;
+    for (const auto &episode : figure.episodes)
+    {
+        for (const auto &track : episode.tracks)
+        {
+            // Tracks without a usable URL still count as listed, so their files stay
+            if (!track.ref.isValid())
+            {
+                continue;
+            }
+            remote.add(track.ref, track.size, track.contentTag, track.blobKey);
+            remoteTracks[track.ref] = &track;
+        }
+    }
+    remote.sort();
+
+    FigureManifest local;
+    bool hadManifest = local.load(figureId);
+    FigureManifest::Changes changes;
+    FigureManifest::diff(local, remote, changes);
+
+    // The manifest written back is the server's, except for tracks left alone: those
+    // keep their old record (or none) so the next sync looks at them again. What is
+    // left alone is settled first, since nothing may change on the card until the new
+    // manifest is saved; references and downloads have to describe what is on disk.
+    std::vector<FigureManifest::Entry> kept;
+    std::vector<TrackId> dropped;
+    std::vector<const FigureManifest::Entry *> removed, changed, added;
+    String playingPath = AudioController::getInstance().getCurrentTrack();
+    char pathBuffer[TrackId::PATH_MAX_LEN];
+
+    for (const auto &entry : changes.removed)
+    {
+        BlobStore::localPath(entry.ref, entry.blobKey, pathBuffer, sizeof(pathBuffer));
+        if (playingPath == pathBuffer)
+        {
+            // Deleting an open file would pull the clusters from under the decoder
+            kept.push_back(entry);
+            continue;
+        }
+        removed.push_back(&entry);
+    }
+    for (const auto &entry : changes.changed)
+    {
+        const Track *track = remoteTracks[entry.ref];
+        const FigureManifest::Entry *old = local.find(entry.ref);
+        BlobStore::localPath(entry.ref, old->blobKey, pathBuffer, sizeof(pathBuffer));
+        if (playingPath == pathBuffer || track->audioUrl.length() == 0)
+        {
+            kept.push_back(*old);
+            continue;
+        }
+        changed.push_back(&entry);
+    }
+    for (const auto &entry : changes.added)
+    {
+        if (remoteTracks[entry.ref]->audioUrl.length() == 0)
+        {
+            dropped.push_back(entry.ref);
+            continue;
+        }
+        added.push_back(&entry);
+    }
+
+    FigureManifest updated = remote;
+    for (const auto &ref : dropped)
+    {
+        updated.remove(ref);
+    }
+    for (const auto &entry : kept)
+    {
+        updated.remove(entry.ref);
+    }
+    for (const auto &entry : kept)
+    {
+        updated.add(entry.ref, entry.size, entry.contentTag, entry.blobKey);
+    }
+    updated.sort();
+    bool manifestChanged = !hadManifest || updated.entries.size() != local.entries.size() ||
+                           memcmp(updated.entries.data(), local.entries.data(),
+                                  updated.entries.size() * sizeof(FigureManifest::Entry)) != 0;
+    if (manifestChanged && !updated.save(figureId))
+    {
+        // The old manifest still stands, the next sync finds the same changes
+        Serial.printf("RequestManager: Failed to save manifest for figure %u, tracks left as they are\n", figureId);
+        return;
+    }
+    if (manifestChanged)
+    {
+        // Blob references move from the old manifest to the new one; shared audio that
+        // nothing refers to any more is deleted there
+        BlobStore::getInstance().updateFigure(figureId, local, updated);
+    }
+
+    for (const auto *entry : removed)
+    {
+        if (entry->blobKey == 0)
+        {
+            entry->ref.formatPath(pathBuffer, sizeof(pathBuffer));
+            Serial.printf("RequestManager: Track removed on the server, deleting %s\n", pathBuffer);
+            fileManager.deleteFileAndRemoveFromRequired(pathBuffer);
+        }
+    }
+
+    for (const auto *entry : changed)
+    {
+        const Track *track = remoteTracks[entry->ref];
+        const FigureManifest::Entry *old = local.find(entry->ref);
+        Serial.print(F("RequestManager: Track changed on the server: "));
+        Serial.println(track->name);
+        if (old->blobKey == 0)
+        {
+            // The old copy has to go first, the queue treats an existing file as done
+            old->ref.formatPath(pathBuffer, sizeof(pathBuffer));
+            fileManager.deleteFileAndRemoveFromRequired(pathBuffer);
+        }
+        BlobStore::localPath(entry->ref, entry->blobKey, pathBuffer, sizeof(pathBuffer));
+        fileManager.addRequiredFile(pathBuffer, track->audioUrl);
+        if (fileManager.fileExists(pathBuffer))
+        {
+            tracksAlreadyExist++; // Another track already brought this audio
+            continue;
+        }
+        fileManager.scheduleDownload(track->audioUrl, pathBuffer, "", priority);
+        tracksToDownload++;
+    }
+
+    for (const auto *entry : added)
+    {
+        const Track *track = remoteTracks[entry->ref];
+        BlobStore::localPath(entry->ref, entry->blobKey, pathBuffer, sizeof(pathBuffer));
+        if (entry->blobKey != 0)
+        {
+            // A copy kept at the track path (from before the blob store) moves into the
+            // store instead of being downloaded again
+            char trackPath[TrackId::PATH_MAX_LEN];
+            entry->ref.formatPath(trackPath, sizeof(trackPath));
+            if (fileManager.fileExists(trackPath) && playingPath != trackPath)
             {
-                if (trackPath == path)
+                if (!fileManager.fileExists(pathBuffer))
                 {
-                    if (success)
-                    {
-                        tracker.tracksReady++;
-                    }
-                    else
+                    // The bytes leave the figure's usage and are counted by BlobStore instead
+                    size_t movedSize = fileManager.getFileSize(trackPath);
+                    if (fileManager.replaceFile(trackPath, pathBuffer))
                     {
-                        tracker.tracksFailed++;
+                        StorageManager::getInstance().onFileRemoved(figureId, movedSize);
+                        BlobStore::getInstance().onBlobAdded(entry->blobKey, movedSize);
                     }
-                    
-                    // Check if this figure is now complete
-                    checkFigureDownloadStatus(tracker.uid);
-                    return;
                 }
+                fileManager.deleteFileAndRemoveFromRequired(trackPath);
+            }
+        }
+        fileManager.addRequiredFile(pathBuffer, track->audioUrl);
+        if (!fileManager.fileExists(pathBuffer))
+        {
+            Serial.print(F("RequestManager: Starting download: "));
+            Serial.println(track->name);
+            fileManager.scheduleDownload(track->audioUrl, pathBuffer, "", priority);
+            tracksToDownload++;
+        }
+        else
+        {
+            tracksAlreadyExist++;
+        }
+    }
+
+    // Unchanged tracks are required already; a file that went missing since is picked up
+    // by FileManager's periodic required-file check
+    tracksAlreadyExist += changes.unchanged;
+
+    Serial.printf("RequestManager: Synced figure %u: %u added, %u changed, %u removed, %u unchanged\n",
+                  figureId, changes.added.size(), changes.changed.size(), changes.removed.size(), changes.unchanged);
+}
+
+void RequestManager::processOfflineFigureRequest(const String &uid)
+{
+    Serial.println(F("RequestManager: Processing offline figure request"));
+    
+    // Cached metadata carries the real names and durations, prefer it over a placeholder figure
+    Figure figureData;
+    if (loadCachedFigure(uid, FigureBuilder::OFFLINE, figureData) && !figureData.episodes.empty())
+    {
+        Serial.println(F("RequestManager: Using catalogue cache for offline playback"));
+    }
+    else
+    {
+        // Check if we have a mapping for this UID
+        String figureId = getFigureIdFromUid(uid);
+        if (figureId.isEmpty()) {
+            Serial.println(F("RequestManager: No offline data found for this UID"));
+            if (figureDownloadCompleteCallback) {
+                Figure emptyFigure;
+                figureDownloadCompleteCallback(uid, "Unknown", false, "No offline data available for this figure", emptyFigure);
+            }
+            return;
+        }
+        
+        Serial.print(F("RequestManager: Found offline mapping for UID "));
+        Serial.print(uid);
+        Serial.print(F(" -> Figure ID "));
+        Serial.println(figureId);
+        
+        // Construct figure from local files
+        figureData = constructFigureFromLocalFiles(uid, figureId);
+    }
+    
+    if (figureData.episodes.empty()) {
+        Serial.println(F("RequestManager: No local tracks found for figure"));
+        if (figureDownloadCompleteCallback) {
+            figureDownloadCompleteCallback(uid, figureData.name.isEmpty() ? "Unknown" : figureData.name, 
+                                         false, "No local tracks available", figureData);
+        }
+        return;
+    }
+    
+    size_t trackCount = 0;
+    for (const auto& episode : figureData.episodes) {
+        trackCount += episode.tracks.size();
+    }
+    String figureName = figureData.name;
+    
+    // Start tracking (all tracks should be ready since we're offline)
+    startTrackingFigure(uid, std::move(figureData));
+    
+    Serial.print(F("RequestManager: Offline figure ready with "));
+    Serial.print(trackCount);
+    Serial.print(F(" tracks: "));
+    Serial.println(figureName);
+}
+
+// Catalogue cache: one file per UID holding the figure in the server's own JSON shape,
+// so it is read back with the same streaming parser, plus the ETag it was served with
+String RequestManager::getCatalogPath(const String &uid, const char *extension)
+{
+    // UIDs come from the NFC reader as hex, drop anything that is not safe in a FAT name
+    String path = CATALOG_DIR;
+    path += '/';
+    for (size_t i = 0; i < uid.length(); i++)
+    {
+        char c = uid[i];
+        if (isalnum((unsigned char)c))
+        {
+            path += c;
+        }
+    }
+    path += extension;
+    return path;
+}
+
+bool RequestManager::hasFigureManifest(const String &uid)
+{
+    // Deleting or evicting a figure takes its manifest and required entries but leaves
+    // the catalogue cache; serving from that would schedule tracks without either, so
+    // such a figure needs the full response and a full sync again
+    auto mapping = uidToFigureIdMap.find(uid);
+    if (mapping == uidToFigureIdMap.end())
+    {
+        return false;
+    }
+    FigureManifest manifest;
+    return manifest.load(strtoul(mapping->second.c_str(), nullptr, 10));
+}
+
+String RequestManager::loadCachedETag(const String &uid)
+{
+    FileManager &fileManager = FileManager::getInstance();
+    if (!fileManager.fileExists(getCatalogPath(uid, ".json")) || !hasFigureManifest(uid))
+    {
+        return String();
+    }
+
+    File file = fileManager.openFile(getCatalogPath(uid, ".etag"));
+    if (!file)
+    {
+        return String();
+    }
+    String etag = file.readStringUntil('\n');
+    file.close();
+    etag.trim();
+    return etag;
+}
+
+bool RequestManager::loadCachedFigure(const String &uid, int mode, Figure &figure, DownloadPriority priority)
+{
+    File file = FileManager::getInstance().openFile(getCatalogPath(uid, ".json"));
+    if (!file)
+    {
+        return false;
+    }
+
+    FigureBuilder builder((FigureBuilder::Mode)mode, priority);
+    FigureStreamParser parser(file, nullptr, builder, timeout);
+    bool parsed = parser.parse() && parser.foundFigure();
+    file.close();
+
+    if (!parsed)
+    {
+        Serial.printf("RequestManager: Catalogue cache for %s unreadable: %s\n", uid.c_str(), parser.getError().c_str());
+        return false;
+    }
+
+    figure = std::move(builder.figure);
+    return true;
+}
+
+bool RequestManager::serveCachedFigure(const String &uid)
+{
+    Figure figureData;
+    if (!loadCachedFigure(uid, FigureBuilder::FROM_CACHE, figureData))
+    {
+        return false;
+    }
+
+    // The mapping is normally there already, avoid an NVS write on every dock
+    auto mapping = uidToFigureIdMap.find(uid);
+    if (mapping == uidToFigureIdMap.end() || mapping->second != figureData.id)
+    {
+        storeUidToFigureIdMapping(uid, figureData.id);
+    }
+
+    Serial.print(F("RequestManager: Figure loaded from catalogue cache: "));
+    Serial.println(figureData.name);
+    startTrackingFigure(uid, std::move(figureData));
+    return true;
+}
+
+// Writes one JSON value (escaped as needed) without building a document for the whole figure
+static void writeJsonValue(Print &out, const String &value)
+{
+    DynamicJsonDocument doc(value.length() + 64);
+    doc.set(value);
+    serializeJson(doc, out);
+}
+
+bool RequestManager::saveCachedFigure(const String &uid, const Figure &figure, const String &etag)
+{
+    FileManager &fileManager = FileManager::getInstance();
+    fileManager.createDirectory(CATALOG_DIR);
+
+    String path = getCatalogPath(uid, ".json");
+    String tempPath = getCatalogPath(uid, ".tmp");
+    File file = fileManager.openFile(tempPath, FILE_WRITE);
+    if (!file)
+    {
+        Serial.println(F("RequestManager: Failed to open catalogue cache for writing"));
+        return false;
+    }
+
+    file.print(F("{\"figure\":{\"id\":"));
+    file.print(strtoul(figure.id.c_str(), nullptr, 10));
+    file.print(F(",\"name\":"));
+    writeJsonValue(file, figure.name);
+    file.print(F(",\"description\":"));
+    writeJsonValue(file, figure.description);
+    file.print(F(",\"episodes\":["));
+    for (size_t e = 0; e < figure.episodes.size(); e++)
+    {
+        const Episode &episode = figure.episodes[e];
+        file.print(e == 0 ? F("{\"id\":") : F(",{\"id\":"));
+        file.print(strtoul(episode.id.c_str(), nullptr, 10));
+        file.print(F(",\"name\":"));
+        writeJsonValue(file, episode.name);
+        file.print(F(",\"description\":"));
+        writeJsonValue(file, episode.description);
+        file.print(F(",\"tracks\":["));
+        for (size_t t = 0; t < episode.tracks.size(); t++)
+        {
+            const Track &track = episode.tracks[t];
+            file.print(t == 0 ? F("{\"id\":") : F(",{\"id\":"));
+            file.print(track.ref.track);
+            file.print(F(",\"name\":"));
+            writeJsonValue(file, track.name);
+            file.print(F(",\"description\":"));
+            writeJsonValue(file, track.description);
+            file.print(F(",\"audio_url\":"));
+            writeJsonValue(file, track.audioUrl);
+            file.print(F(",\"duration\":"));
+            file.print(track.duration);
+            file.print('}');
+        }
+        file.print(F("]}"));
+    }
+    bool written = file.print(F("]}}")) > 0;
+    file.close();
+
+    if (!written || !fileManager.replaceFile(tempPath, path))
+    {
+        Serial.println(F("RequestManager: Failed to write catalogue cache"));
+        fileManager.deleteFile(tempPath);
+        return false;
+    }
+
+    // Without an ETag there is nothing to revalidate with, the next dock does a full GET
+    String etagPath = getCatalogPath(uid, ".etag");
+    if (etag.isEmpty())
+    {
+        if (fileManager.fileExists(etagPath))
+        {
+            fileManager.deleteFile(etagPath);
+        }
+    }
+    else
+    {
+        File etagFile = fileManager.openFile(etagPath, FILE_WRITE);
+        if (etagFile)
+        {
+            etagFile.println(etag);
+            etagFile.close();
+        }
+    }
+
+    Serial.printf("RequestManager: Cached figure metadata at %s (ETag: %s)\n", path.c_str(), etag.isEmpty() ? "none" : etag.c_str());
+    return true;
+}
+
+// Figure download callback system implementation
+void RequestManager::setFigureDownloadCompleteCallback(FigureDownloadCompleteCallback callback)
+{
+    this->figureDownloadCompleteCallback = callback;
+}
+
+void RequestManager::startTrackingFigure(const String &uid, Figure &&figureData)
+{
+    // Clean up completed trackers periodically to prevent memory bloat
+    cleanupCompletedTrackers();
+    
+    // Remove any existing tracker for this UID to prevent duplicates
+    for (auto it = activeDownloads.begin(); it != activeDownloads.end(); ++it)
+    {
+        if (it->uid == uid)
+        {
+            activeDownloads.erase(it);
+            break;
+        }
+    }
+    
+    // Create new tracker, taking ownership of the parsed figure instead of copying it
+    FigureDownloadTracker tracker;
+    tracker.uid = uid;
+    tracker.figureName = figureData.name;
+    tracker.figureId = figureData.id;
+    tracker.tracksReady = 0;
+    tracker.tracksFailed = 0;
+    tracker.completed = false;
+    tracker.figureData = std::move(figureData);
+    
+    // Most recently docked figures are the last to be evicted
+    StorageManager::getInstance().noteDock(strtoul(tracker.figureId.c_str(), nullptr, 10));
+    
+    // Collect compact track ids and count tracks that already exist
+    FileManager &fileManager = FileManager::getInstance();
+    char pathBuffer[TrackId::PATH_MAX_LEN];
+    for (const auto &episode : tracker.figureData.episodes)
+    {
+        for (const auto &track : episode.tracks)
+        {
+            tracker.tracks.push_back(track.ref);
+            tracker.blobKeys.push_back(track.blobKey);
+            BlobStore::localPath(track.ref, track.blobKey, pathBuffer, sizeof(pathBuffer));
+            if (fileManager.fileExists(pathBuffer))
+            {
+                tracker.tracksReady++;
+            }
+        }
+    }
+    tracker.totalTracks = tracker.tracks.size();
+    
+    Serial.print(F("Started tracking figure '"));
+    Serial.print(tracker.figureName);
+    Serial.print(F("' (UID: "));
+    Serial.print(uid);
+    Serial.print(F("): "));
+    Serial.print(tracker.totalTracks);
+    Serial.print(F(" total tracks, "));
+    Serial.print(tracker.tracksReady);
+    Serial.println(F(" already ready"));
+    
+    // Check if all tracks are already ready before adding to activeDownloads
+    bool allTracksReady = (tracker.tracksReady >= tracker.totalTracks && tracker.totalTracks > 0);
+    
+    if (allTracksReady)
+    {
+        Serial.println(F("All tracks already exist, triggering immediate callback"));
+        tracker.completed = true;
+        
+        if (figureDownloadCompleteCallback)
+        {
+            figureDownloadCompleteCallback(uid, tracker.figureName, true, "", tracker.figureData);
+        }
+    }
+    else
+    {
+        promoteFigureDownloads(tracker);
+    }
+    
+    activeDownloads.push_back(std::move(tracker));
+}
+
+void RequestManager::promoteFigureDownloads(const FigureDownloadTracker &tracker)
+{
+    // Docked figure ahead of prefetch and repairs, and its first missing track in play
+    // order ahead of everything, since that is the one being waited for
+    FileManager &fileManager = FileManager::getInstance();
+    char pathBuffer[TrackId::PATH_MAX_LEN];
+    bool nextFound = false;
+    for (size_t i = 0; i < tracker.tracks.size(); i++)
+    {
+        BlobStore::localPath(tracker.tracks[i], tracker.blobKeys[i], pathBuffer, sizeof(pathBuffer));
+        if (fileManager.fileExists(pathBuffer))
+        {
+            continue;
+        }
+        if (fileManager.promoteDownload(pathBuffer, nextFound ? DOWNLOAD_PRIORITY_DOCKED : DOWNLOAD_PRIORITY_NEXT_TRACK))
+        {
+            nextFound = true;
+        }
+    }
+}
+
+void RequestManager::checkFigureDownloadStatus(const String &uid)
+{
+    for (auto &tracker : activeDownloads)
+    {
+        if (tracker.uid == uid && !tracker.completed)
+        {
+            if (tracker.tracksReady + tracker.tracksFailed >= tracker.totalTracks)
+            {
+                tracker.completed = true;
+                bool success = (tracker.tracksReady > 0) && (tracker.tracksFailed == 0);
+                
+                if (figureDownloadCompleteCallback)
+                {
+                    String error = success ? "" : "Some tracks failed to download";
+                    figureDownloadCompleteCallback(uid, tracker.figureName, success, error, tracker.figureData);
+                }
+                
+                Serial.print(F("Figure download completed for: "));
+                Serial.print(tracker.figureName);
+                Serial.print(F(" - Success: "));
+                Serial.print(success ? "Yes" : "No");
+                Serial.print(F(" ("));
+                Serial.print(tracker.tracksReady);
+                Serial.print(F("/"));
+                Serial.print(tracker.totalTracks);
+                Serial.println(F(" tracks ready)"));
+                break;
+            }
+        }
+    }
+}
+
+void RequestManager::onTrackDownloadComplete(const String &path, bool success)
+{
+    // Only figure tracks are tracked, anything else cannot match. A blob can be the
+    // audio of several tracks, so one download credits every track that uses it.
+    TrackId completedTrack;
+    uint64_t completedKey = 0;
+    if (!TrackId::fromPath(path, completedTrack) && !BlobStore::keyFromPath(path.c_str(), completedKey))
+    {
+        return;
+    }
+    
+    std::vector<String> touched;
+    for (auto &tracker : activeDownloads)
+    {
+        if (tracker.completed)
+        {
+            continue;
+        }
+        int matches = 0;
+        for (size_t i = 0; i < tracker.tracks.size(); i++)
+        {
+            bool match = completedKey != 0 ? tracker.blobKeys[i] == completedKey
+                                           : (tracker.blobKeys[i] == 0 && tracker.tracks[i] == completedTrack);
+            if (match)
+            {
+                matches++;
+            }
+        }
+        if (matches == 0)
+        {
+            continue;
+        }
+        if (success)
+        {
+            tracker.tracksReady += matches;
+        }
+        else
+        {
+            tracker.tracksFailed += matches;
+        }
+        touched.push_back(tracker.uid);
+    }
+    
+    // Check if these figures are now complete, otherwise line up their next track. The
+    // completion callback may start playback, so the trackers are looked up afresh.
+    for (const String &uid : touched)
+    {
+        checkFigureDownloadStatus(uid);
+        for (auto &tracker : activeDownloads)
+        {
+            if (tracker.uid == uid && !tracker.completed)
+            {
+                promoteFigureDownloads(tracker);
             }
         }
     }
@@ -899,7 +1787,7 @@ void RequestManager::onTrackDownloadComplete(const String &path, bool success)
 void RequestManager::staticFileDownloadCallback(const String& url, const String& path, bool success, const String& error)
 {
     // Get the singleton instance and forward the call
-    RequestManager &instance = RequestManager::getInstance("http://portal.tilkietalkie.com/api");
+    RequestManager &instance = RequestManager::getInstance("https://portal.tilkietalkie.com/api");
     instance.onTrackDownloadComplete(path, success);
 }
 
@@ -1050,57 +1938,51 @@ RequestManager::Figure RequestManager::constructFigureFromLocalFiles(const Strin
     figure.name = "Local Figure"; // Default name since we don't have metadata
     figure.description = "Offline figure data";
     
-    // Get all required files for this figure
-    std::vector<String> figurePaths = getRequiredFilesForFigure(figureId);
+    // The manifest lists every track with where its audio lives, blobs included; the
+    // required list only holds track paths for figures synced before manifests existed
+    std::vector<FigureManifest::Entry> figureTracks;
+    FigureManifest manifest;
+    if (manifest.load(strtoul(figureId.c_str(), nullptr, 10))) {
+        figureTracks = manifest.entries;
+    } else {
+        for (const TrackId& trackRef : getRequiredTracksForFigure(figureId)) {
+            FigureManifest::Entry entry = {trackRef, 0, 0, 0};
+            figureTracks.push_back(entry);
+        }
+    }
     
-    if (figurePaths.empty()) {
+    if (figureTracks.empty()) {
         Serial.println(F("RequestManager: No local files found for figure"));
         return figure;
     }
     
-    // Group files by episode (parse path structure: /figures/{figureId}/{episodeId}/{trackId}.wav)
-    std::map<String, std::vector<String>> episodeTrackMap;
+    // Group tracks by episode, the ids already carry the episode so no path parsing is needed
+    std::map<uint32_t, std::vector<FigureManifest::Entry>> episodeTrackMap;
     FileManager &fileManager = FileManager::getInstance();
+    char pathBuffer[TrackId::PATH_MAX_LEN];
     
-    // Pre-calculate prefix length to avoid repeated String operations
-    const int prefixLen = 9 + figureId.length() + 1; // "/figures/" + figureId + "/"
-    
-    for (const String& path : figurePaths) {
+    for (const auto& entry : figureTracks) {
         // Only process files that actually exist
-        if (!fileManager.fileExists(path)) {
+        BlobStore::localPath(entry.ref, entry.blobKey, pathBuffer, sizeof(pathBuffer));
+        if (!fileManager.fileExists(pathBuffer)) {
             continue;
         }
-        
-        // Parse path to extract episode ID
-        // Expected format: /figures/{figureId}/{episodeId}/{trackId}.wav
-        if (path.length() > prefixLen && path.startsWith("/figures/" + figureId + "/")) {
-            // Find the episode ID (after the figureId)
-            int episodeEnd = path.indexOf('/', prefixLen);
-            
-            if (episodeEnd > prefixLen) {
-                String episodeId = path.substring(prefixLen, episodeEnd);
-                episodeTrackMap[episodeId].push_back(path);
-            }
-        }
+        episodeTrackMap[entry.ref.episode].push_back(entry);
     }
     
     // Build episodes and tracks
     for (const auto& episodePair : episodeTrackMap) {
         Episode episode;
-        episode.id = episodePair.first;
-        episode.name = "Episode " + episodePair.first;
+        episode.id = String(episodePair.first);
+        episode.name = "Episode " + episode.id;
         episode.description = "Local episode";
         
-        for (const String& trackPath : episodePair.second) {
-            // Extract track ID from filename
-            String filename = trackPath.substring(trackPath.lastIndexOf('/') + 1);
-            String trackId = filename.substring(0, filename.lastIndexOf('.'));
-            
+        for (const auto& entry : episodePair.second) {
             Track track;
-            track.id = trackId;
-            track.name = "Track " + trackId;
+            track.ref = entry.ref;
+            track.blobKey = entry.blobKey;
+            track.name = "Track " + String(entry.ref.track);
             track.description = "Local track";
-            track.localPath = trackPath;
             track.audioUrl = ""; // Not needed for offline
             track.duration = 0; // Unknown for offline
             
@@ -1118,17 +2000,16 @@ RequestManager::Figure RequestManager::constructFigureFromLocalFiles(const Strin
     return figure;
 }
 
-std::vector<String> RequestManager::getRequiredFilesForFigure(const String &figureId)
+std::vector<TrackId> RequestManager::getRequiredTracksForFigure(const String &figureId)
 {
     FileManager &fileManager = FileManager::getInstance();
-    String figurePrefix = "/figures/" + figureId + "/";
     
-    // Use FileManager's pattern matching to get required files for this figure
-    std::vector<String> figurePaths = fileManager.getRequiredFilesByPattern(figurePrefix);
+    // Required tracks are matched on the numeric figure id, no prefix string needed
+    std::vector<TrackId> figureTracks = fileManager.getRequiredTracksForFigure(strtoul(figureId.c_str(), nullptr, 10));
     
     Serial.print(F("RequestManager: Found "));
-    Serial.print(figurePaths.size());
+    Serial.print(figureTracks.size());
     Serial.print(F(" required files for figure "));
     Serial.println(figureId);
-    return figurePaths;
+    return figureTracks;
 }
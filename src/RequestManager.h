@@ -6,9 +6,18 @@
 #include <ArduinoJson.h>
 #include <WiFi.h>
 #include <WiFiClient.h>
+#include <ConnectionManager.h>
+#include <BlobStore.h>
+#include <FigureManifest.h>
+#include <FigureStreamParser.h>
 #include <FileManager.h>
+#include <StorageManager.h>
+#include <TrackId.h>
 #include <nvs_flash.h>
 #include <nvs.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
 #include <vector>
 #include <map>
 #include <memory>
@@ -16,8 +25,6 @@
 class RequestManager
 {
 private:
-    HTTPClient http;
-    WiFiClient client; // Regular WiFi client for HTTP connections
     String baseUrl;
     String authToken;
     int timeout;
@@ -28,9 +35,9 @@ private:
     // Private helper methods
     bool isWiFiConnected();
     bool checkNetworkConnectivity();
-    void setDefaultHeaders();
+    void setDefaultHeaders(HTTPClient& http);
+    static void addDefaultHeaders(HTTPClient& http, const String& token);
     JsonDocument parseResponse(const String& response);
-    String convertToHttp(const String& url);
     
     // Memory-efficient string building helper
     String buildUrl(const String& endpoint) const;
@@ -69,16 +76,24 @@ public:
     bool validateToken(const String& token);
     void initConnection();
 
-    void getCheckFigureTracks(const String &uid); // Method to fetch figure tracks
+    // Fetch figure tracks. Online fetches run on a worker task and report through the
+    // figure callback from update(), so this returns without waiting on the network
+    void getCheckFigureTracks(const String &uid);
+    void update(); // Delivers finished requests and runs background revalidation, call from loop()
+    void cancelFigureRequests(); // Figure removed: drop queued, in-flight and pending fetches
+    bool isRequestPending() const { return !requestJobs.empty(); }
+    bool isRevalidationPending() const { return !pendingRevalidationUid.isEmpty(); }
 
     // Track and Episode structures for playlist - using move semantics and reserved capacity
     struct Track {
-        String id;
+        TrackId ref;       // Figure/episode/track ids, the local path is formatted from these
         String name;
         String description;
         String audioUrl;
-        String localPath;  // Local file path after download
         int duration;
+        uint32_t size = 0;       // From the server, for the figure manifest
+        uint32_t contentTag = 0; // FigureManifest::contentTag() of the server's hash/version
+        uint64_t blobKey = 0;    // BlobStore::keyFor() the server's hash, 0 = stored at the track path
         
         // Move constructor and assignment operator for better memory management
         Track() = default;
@@ -116,6 +131,18 @@ public:
         Figure& operator=(const Figure& other) = default;
     };
 
+    // Owner's figure library, used for prefetching
+    struct LibraryEntry {
+        String uid;
+        bool flagged; // Server asks for it to be on the device ahead of a dock
+    };
+    typedef void (*LibraryListingCallback)(bool success, const std::vector<LibraryEntry> &entries);
+    void setLibraryListingCallback(LibraryListingCallback callback);
+    bool requestLibraryListing(); // Result arrives through the callback from update()
+    bool prefetchFigure(const String &uid); // Fetch metadata and queue downloads without docking
+    bool hasCachedFigure(const String &uid);
+    bool wasDockedBefore(const String &uid) const;
+
     // Figure download callback system
     typedef void (*FigureDownloadCompleteCallback)(const String &uid, const String &figureName, bool success, const String &error, const Figure &figure);
     void setFigureDownloadCompleteCallback(FigureDownloadCompleteCallback callback);
@@ -138,6 +165,7 @@ private:
     
     // Figure download tracking
     FigureDownloadCompleteCallback figureDownloadCompleteCallback;
+    LibraryListingCallback libraryListingCallback;
     
     struct FigureDownloadTracker {
         String uid;
@@ -146,13 +174,12 @@ private:
         int totalTracks;
         int tracksReady; // tracks that existed or were successfully downloaded
         int tracksFailed; // tracks that failed to download
-        std::vector<String> trackPaths;
+        std::vector<TrackId> tracks;
+        std::vector<uint64_t> blobKeys; // Per track, BlobStore::keyFor() its hash, 0 = stored at its track path
         bool completed;
         Figure figureData; // Store the complete figure structure
         
-        // Constructor with reserved capacity to prevent reallocations
         FigureDownloadTracker() { 
-            trackPaths.reserve(20); // Reserve space for typical track count
             totalTracks = 0;
             tracksReady = 0;
             tracksFailed = 0;
@@ -172,7 +199,8 @@ private:
     std::map<String, String> uidToFigureIdMap;
     
     // Helper methods for tracking
-    void startTrackingFigure(const String &uid, const String &figureName, const String &figureId, const std::vector<String> &trackPaths, const Figure &figureData);
+    void startTrackingFigure(const String &uid, Figure &&figureData);
+    void promoteFigureDownloads(const FigureDownloadTracker &tracker);
     void checkFigureDownloadStatus(const String &uid);
     void onTrackDownloadComplete(const String &path, bool success);
     void storeUidToFigureIdMapping(const String &uid, const String &figureId);
@@ -183,10 +211,73 @@ private:
     bool saveUidMappings();
     bool loadUidMappings();
     
+    // Catalogue cache of figure metadata on SD, revalidated with If-None-Match
+    static const char* CATALOG_DIR;
+    static const unsigned long CATALOG_FRESH_MS = 5UL * 60UL * 1000UL; // Re-docks within this skip the network
+    std::map<String, unsigned long> catalogValidatedAt;
+    
+    // Stale-while-revalidate: a dock served from the cache is checked against the server
+    // shortly after playback starts
+    static const unsigned long REVALIDATE_DELAY_MS = 2000;
+    String pendingRevalidationUid;
+    unsigned long pendingRevalidationAt;
+    
+    // Asynchronous figure fetches. A job is created on the loop task, handed to the
+    // worker through jobQueue and comes back through resultQueue; between the two only
+    // the worker touches it, except for the cancelled flag.
+    struct RequestJob {
+        enum Kind { FIGURE, LIBRARY };
+        enum Origin {
+            DOCK,       // Figure on the dock waiting for it, failures are reported
+            REVALIDATE, // Already playing from the cache, only changes are reported
+            PREFETCH    // Not docked: register and download, no tracking or callback
+        };
+        Kind kind;
+        Origin origin;
+        String uid;
+        String url;
+        String authToken;
+        String etag;             // Sent as If-None-Match when not empty
+        volatile bool cancelled; // Set from the loop task, polled by the worker
+        unsigned long submittedAt;
+        
+        // Filled in by the worker
+        int statusCode;
+        bool parsed;
+        String error;
+        String responseETag;
+        size_t bytesRead;
+        Figure figure;
+        std::vector<LibraryEntry> library;
+    };
+    static const uint32_t WORKER_STACK_SIZE = 12288; // TLS handshakes run on this stack
+    static const UBaseType_t WORKER_PRIORITY = 1;
+    static const int JOB_QUEUE_LENGTH = 4;
+    QueueHandle_t jobQueue;
+    QueueHandle_t resultQueue;
+    TaskHandle_t workerTask;
+    std::vector<RequestJob*> requestJobs; // Outstanding jobs, only touched on the loop task
+    
+    bool startWorker();
+    static void workerLoop(void *param);
+    RequestJob *createJob(RequestJob::Kind kind, const String &endpoint);
+    bool enqueueJob(RequestJob *job);
+    bool submitFigureRequest(const String &uid, RequestJob::Origin origin);
+    void fetchFigure(RequestJob &job);        // Worker task
+    void fetchLibrary(RequestJob &job);       // Worker task
+    void applyFigureResult(RequestJob &job);  // Loop task
+    void applyLibraryResult(RequestJob &job); // Loop task
+    void syncFigureTracks(const Figure &figure, DownloadPriority priority, int &tracksToDownload, int &tracksAlreadyExist);
+    String getCatalogPath(const String &uid, const char *extension);
+    String loadCachedETag(const String &uid);
+    bool hasFigureManifest(const String &uid); // Catalogue cache is only usable alongside the manifest
+    bool loadCachedFigure(const String &uid, int mode, Figure &figure, DownloadPriority priority = DOWNLOAD_PRIORITY_DOCKED);
+    bool serveCachedFigure(const String &uid);
+    bool saveCachedFigure(const String &uid, const Figure &figure, const String &etag);
+    
     // Offline mode methods
     Figure constructFigureFromLocalFiles(const String &uid, const String &figureId);
-    std::vector<String> getRequiredFilesForFigure(const String &figureId);
-    void processOnlineFigureRequest(const String &uid);
+    std::vector<TrackId> getRequiredTracksForFigure(const String &figureId);
     void processOfflineFigureRequest(const String &uid);
 };
 
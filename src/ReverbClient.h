@@ -13,6 +13,8 @@
 #include "AudioController.h"
 #include "NfcController.h"
 #include "ConfigManager.h"
+#include "ConnectionManager.h"
+#include "StorageManager.h"
 
 class ReverbClient
 {
@@ -43,13 +45,7 @@ public:
         _deviceId = deviceId;
         _initialized = true;
 
-        // Pre-allocate all objects at once to minimize fragmentation
-        if (!_httpClient)
-        {
-            _httpClient = new WiFiClientSecure();
-            ((WiFiClientSecure *)_httpClient)->setInsecure();
-        }
-
+        // REST calls go through the shared ConnectionManager TLS client
         if (_ws == nullptr)
         {
             _ws = new WebSocketsClient();
@@ -179,28 +175,25 @@ public:
             delete _ws;
             _ws = nullptr;
         }
-
-        if (_httpClient)
-        {
-            delete _httpClient;
-            _httpClient = nullptr;
-        }
     }
 
     bool sendMessage(const String &text)
     {
-        if (!isConnected() || !_httpClient)
+        if (!isConnected())
         {
             Serial.printf("ReverbClient: Cannot send message - Connection status: %s\n",
                           getConnectionStatus().c_str());
             return false;
         }
 
-        HTTPClient http;
+        ConnectionManager &connections = ConnectionManager::getInstance();
+        String connectError;
         snprintf(urlBuffer, sizeof(urlBuffer), "https://%s/api/chat/device/%s", _host.c_str(), _deviceId.c_str());
 
-        if (http.begin(*_httpClient, urlBuffer))
+        HTTPClient *request = connections.beginRequest(urlBuffer, connectError);
+        if (request)
         {
+            HTTPClient &http = *request;
             snprintf(headerBuffer, sizeof(headerBuffer), "Bearer %s", _authToken.c_str());
             http.addHeader("Authorization", headerBuffer);
             http.addHeader("Content-Type", "application/json");
@@ -212,7 +205,7 @@ public:
 
             Serial.printf("ReverbClient: Sending message: %s\n", text.c_str());
             int httpCode = http.POST((uint8_t *)tempBuffer, strlen(tempBuffer));
-            http.end();
+            connections.endRequest(request);
 
             if (httpCode == 200)
             {
@@ -225,7 +218,7 @@ public:
                 return false;
             }
         }
-        Serial.println("ReverbClient: Failed to initialize HTTP request");
+        Serial.printf("ReverbClient: Failed to initialize HTTP request: %s\n", connectError.c_str());
         return false;
     }
 
@@ -233,14 +226,13 @@ private:
     ReverbClient() = default;
 
     // Pre-allocated static buffers to reduce heap fragmentation
-    static char jsonBuffer[512];
+    static char jsonBuffer[1024]; // Room for the storage and optional sd_bench blocks
     static char urlBuffer[128];
     static char headerBuffer[256];
     static char channelBuffer[64];
     static char tempBuffer[256];
 
     WebSocketsClient *_ws = nullptr;
-    WiFiClientSecure *_httpClient = nullptr;
     String _host, _appKey, _authToken, _deviceId, _socketId;
     uint16_t _port;
     std::function<void(const String &)> _chatCb;
@@ -418,7 +410,8 @@ private:
         float batteryPercent = battery.getBatteryPercentage();
         float batteryVoltage = battery.getBatteryVoltage();
         bool isFileSyncing = fileManager.getPendingDownloadsCount() > 0;
-        uint32_t sdFreeSpace = fileManager.getSDCardFreeSpace();
+        uint64_t sdFree = fileManager.getSDCardFreeSpace();
+        uint32_t sdFreeSpace = sdFree > UINT32_MAX ? UINT32_MAX : (uint32_t)sdFree; // Field is 32-bit, saturate rather than wrap
         String wifiSSID = config.getWiFiSSID();
         int wifiRSSI = WiFi.RSSI();
         int audioState = audio.getState(); // Use int instead of enum
@@ -446,6 +439,18 @@ private:
         wifiSSID.replace("\"", "\\\"");
         currentTrack.replace("\"", "\\\"");
 
+        // Last sdbench result, only when enabled with "sdbench report on"
+        char sdBenchJson[256];
+        sdBenchJson[0] = '\0';
+        if (config.getInt("sdbench_report", 0) != 0)
+        {
+            fileManager.formatSDBenchmarkJson(sdBenchJson, sizeof(sdBenchJson));
+        }
+
+        // Storage budget and eviction counters
+        char storageJson[128];
+        StorageManager::getInstance().formatReportJson(storageJson, sizeof(storageJson));
+
         // Get NFC card ID
         String nfcCardId = "";
         if (isReedActive && isCardPresent)
@@ -471,6 +476,8 @@ private:
                                "\"sd_remaining\":%u,"
                                "\"wifi_ssid\":\"%s\","
                                "\"wifi_rssi\":%d"
+                               "%s%s"
+                               "%s%s"
                                "},"
                                "\"audio\":{"
                                "\"current_track_status\":\"%s\""
@@ -492,6 +499,10 @@ private:
                                sdFreeSpace,
                                wifiSSID.c_str(),
                                wifiRSSI,
+                               storageJson[0] ? ",\"storage\":" : "",
+                               storageJson,
+                               sdBenchJson[0] ? ",\"sd_bench\":" : "",
+                               sdBenchJson,
                                audioStatus,
                                currentTrack.length() > 0 ? ",\"current_track_id\":\"" : "",
                                currentTrack.c_str(),
@@ -509,16 +520,19 @@ private:
 
     bool subscribeToPrivate()
     {
-        if (_socketId.length() == 0 || !_httpClient)
+        if (_socketId.length() == 0)
         {
             return false;
         }
 
-        HTTPClient http;
+        ConnectionManager &connections = ConnectionManager::getInstance();
+        String connectError;
         snprintf(urlBuffer, sizeof(urlBuffer), "https://%s/broadcasting/auth", _host.c_str());
 
-        if (http.begin(*_httpClient, urlBuffer))
+        HTTPClient *request = connections.beginRequest(urlBuffer, connectError);
+        if (request)
         {
+            HTTPClient &http = *request;
             http.addHeader("Content-Type", "application/json");
             snprintf(headerBuffer, sizeof(headerBuffer), "Bearer %s", _authToken.c_str());
             http.addHeader("Authorization", headerBuffer);
@@ -533,12 +547,12 @@ private:
 
             if (httpCode != 200)
             {
-                http.end();
+                connections.endRequest(request);
                 return false;
             }
 
             String authResponse = http.getString();
-            http.end();
+            connections.endRequest(request);
 
             int authStart = authResponse.indexOf("\"auth\":\"") + 8;
             int authEnd = authResponse.indexOf("\"", authStart);
@@ -888,7 +902,7 @@ private:
 };
 
 // Define static buffers
-char ReverbClient::jsonBuffer[512];
+char ReverbClient::jsonBuffer[1024];
 char ReverbClient::urlBuffer[128];
 char ReverbClient::headerBuffer[256];
 char ReverbClient::channelBuffer[64];
@@ -0,0 +1,355 @@
+#include "SdMaintenance.h"
+#include "AudioController.h"
+#include "BatteryManagement.h"
+#include "ConfigManager.h"
+#include "FileManager.h"
+#include "NfcController.h"
+#include "RequestManager.h"
+#include <algorithm>
+
+// Initialize static members
+SdMaintenance* SdMaintenance::instance = nullptr;
+
+SdMaintenance::SdMaintenance() :
+    state(IDLE),
+    enabled(true),
+    lastCheck(0),
+    passStart(0),
+    nextPassAt(0),
+    nextTrack(0),
+    nextCompact(0),
+    buffer(nullptr),
+    copied(0),
+    passes(0) {
+    resetStats(current);
+    resetStats(last);
+}
+
+SdMaintenance& SdMaintenance::getInstance() {
+    if (instance == nullptr) {
+        instance = new SdMaintenance();
+    }
+    return *instance;
+}
+
+void SdMaintenance::begin() {
+    enabled = ConfigManager::getInstance().getInt("maintenance_enabled", 1) != 0;
+    // Boot is busy enough; the first pass waits until the device has settled
+    nextPassAt = millis() + FIRST_RUN_DELAY_MS;
+}
+
+void SdMaintenance::runNow() {
+    nextPassAt = millis();
+    Serial.println("SdMaintenance: Pass requested, starts when charging and idle");
+}
+
+void SdMaintenance::resetStats(PassStats& stats) {
+    stats.tempsRemoved = 0;
+    stats.tempBytesFreed = 0;
+    stats.filesMeasured = 0;
+    stats.clusters = 0;
+    stats.fragments = 0;
+    stats.fragmentedFiles = 0;
+    stats.worstFragments = 0;
+    stats.worstPath = "";
+    stats.compacted = 0;
+    stats.fragmentsRemoved = 0;
+    stats.bytesRewritten = 0;
+    stats.compactSkipped = 0;
+    stats.durationMs = 0;
+}
+
+bool SdMaintenance::conditionsMet(String& reason) {
+    if (!enabled) {
+        reason = "disabled";
+        return false;
+    }
+    if (!FileManager::getInstance().isSDCardAvailable()) {
+        reason = "no SD card";
+        return false;
+    }
+    if (!BatteryManager::getInstance().getChargingStatus()) {
+        reason = "not charging";
+        return false;
+    }
+    if (NfcController::getInstance().isCardPresent() || !AudioController::getInstance().isStopped()) {
+        reason = "figure docked or audio playing";
+        return false;
+    }
+    FileManager& fileManager = FileManager::getInstance();
+    if (RequestManager::getInstance().isRequestPending() || fileManager.isDownloadInProgress() ||
+        fileManager.getPendingDownloadsCount() > 0) {
+        reason = "requests or downloads in flight";
+        return false;
+    }
+    return true;
+}
+
+void SdMaintenance::update() {
+    unsigned long now = millis();
+    if (now - lastCheck >= CHECK_INTERVAL_MS) {
+        lastCheck = now;
+        enabled = ConfigManager::getInstance().getInt("maintenance_enabled", 1) != 0;
+    } else if (state == IDLE) {
+        return;
+    }
+
+    if (state == IDLE && (long)(now - nextPassAt) < 0) {
+        return;
+    }
+
+    String reason;
+    if (!conditionsMet(reason)) {
+        // A pass is paused, not lost; only a copy in progress has to start over, since
+        // the track may be opened for playback any moment now
+        if (target) {
+            abandonRewrite();
+        }
+        lastSkipReason = reason;
+        return;
+    }
+    lastSkipReason = "";
+
+    switch (state) {
+        case IDLE:
+            startPass();
+            break;
+        case SWEEPING:
+            sweepStep();
+            break;
+        case MEASURING:
+            measureStep();
+            break;
+        case COMPACTING:
+            compactStep();
+            break;
+    }
+}
+
+void SdMaintenance::startPass() {
+    resetStats(current);
+    passStart = millis();
+    pendingDirs.assign(1, "/");
+    tracks.clear();
+    toCompact.clear();
+    nextTrack = 0;
+    nextCompact = 0;
+    state = SWEEPING;
+    Serial.println("SdMaintenance: Pass started");
+}
+
+void SdMaintenance::finishPass() {
+    if (target) {
+        abandonRewrite();
+    }
+    free(buffer);
+    buffer = nullptr;
+    pendingDirs.clear();
+    pendingDirs.shrink_to_fit();
+    tracks.clear();
+    tracks.shrink_to_fit();
+    toCompact.clear();
+    toCompact.shrink_to_fit();
+
+    current.durationMs = millis() - passStart;
+    last = current;
+    passes++;
+    state = IDLE;
+    nextPassAt = millis() + RUN_INTERVAL_MS;
+
+    FileManager& fileManager = FileManager::getInstance();
+    Serial.printf("SdMaintenance: Pass done in %lu ms: %u temps removed (%s), %u of %u tracks fragmented, "
+                  "%u compacted (%u runs merged, %s rewritten)\n",
+                  last.durationMs, last.tempsRemoved, fileManager.formatBytes(last.tempBytesFreed).c_str(),
+                  last.fragmentedFiles, last.filesMeasured, last.compacted, last.fragmentsRemoved,
+                  fileManager.formatBytes(last.bytesRewritten).c_str());
+}
+
+void SdMaintenance::sweepStep() {
+    if (pendingDirs.empty()) {
+        state = MEASURING;
+        return;
+    }
+
+    // One directory per step; a figure's episode directory holds a few dozen entries
+    FileManager& fileManager = FileManager::getInstance();
+    String directory = pendingDirs.back();
+    pendingDirs.pop_back();
+    std::vector<String> files;
+    fileManager.sweepTempFiles(directory, pendingDirs, current.tempsRemoved, current.tempBytesFreed, &files);
+    for (const auto& path : files) {
+        if (!path.endsWith(".wav")) {
+            continue;
+        }
+        size_t size = fileManager.getFileSize(path);
+        if (size >= MIN_TRACK_SIZE) {
+            Track track = {path, size, 0};
+            tracks.push_back(track);
+        }
+    }
+}
+
+void SdMaintenance::measureStep() {
+    FileManager& fileManager = FileManager::getInstance();
+    unsigned long start = millis();
+    while (nextTrack < tracks.size() && millis() - start < STEP_SLICE_MS) {
+        Track& track = tracks[nextTrack++];
+        uint32_t clusters;
+        if (!fileManager.countFragments(track.path, track.fragments, clusters)) {
+            continue;
+        }
+        current.filesMeasured++;
+        current.clusters += clusters;
+        if (track.fragments > 1) {
+            current.fragmentedFiles++;
+            current.fragments += track.fragments - 1;
+        }
+        if (track.fragments > current.worstFragments) {
+            current.worstFragments = track.fragments;
+            current.worstPath = track.path;
+        }
+        if (track.fragments >= COMPACT_MIN_FRAGMENTS) {
+            toCompact.push_back(track);
+        }
+    }
+    if (nextTrack < tracks.size()) {
+        return;
+    }
+
+    std::sort(toCompact.begin(), toCompact.end(),
+              [](const Track& a, const Track& b) { return a.fragments > b.fragments; });
+    if (toCompact.size() > (size_t)MAX_COMPACTIONS_PER_PASS) {
+        toCompact.resize(MAX_COMPACTIONS_PER_PASS);
+    }
+    tracks.clear();
+    tracks.shrink_to_fit();
+    state = COMPACTING;
+}
+
+void SdMaintenance::compactStep() {
+    if (!target) {
+        if (nextCompact >= toCompact.size()) {
+            finishPass();
+        } else if (!startRewrite(toCompact[nextCompact])) {
+            current.compactSkipped++;
+            nextCompact++;
+        }
+        return;
+    }
+
+    const Track& track = toCompact[nextCompact];
+    unsigned long start = millis();
+    while (copied < track.size && millis() - start < STEP_SLICE_MS) {
+        size_t want = track.size - copied;
+        if (want > COPY_BUFFER_SIZE) {
+            want = COPY_BUFFER_SIZE;
+        }
+        size_t got = source.read(buffer, want);
+        if (got == 0 || target.write(buffer, got) != got) {
+            Serial.printf("SdMaintenance: Copy of %s failed at %u bytes\n", track.path.c_str(), copied);
+            endRewrite(false);
+            return;
+        }
+        copied += got;
+    }
+    if (copied >= track.size) {
+        endRewrite(true);
+    }
+}
+
+bool SdMaintenance::startRewrite(const Track& track) {
+    FileManager& fileManager = FileManager::getInstance();
+    if (fileManager.getSDCardFreeSpace() < (uint64_t)track.size + COMPACT_FREE_MARGIN) {
+        return false;
+    }
+    if (buffer == nullptr) {
+        buffer = (uint8_t*)malloc(COPY_BUFFER_SIZE);
+        if (buffer == nullptr) {
+            return false;
+        }
+    }
+    source = fileManager.openFile(track.path, FILE_READ);
+    if (!source || source.size() != track.size) {
+        source.close();
+        return false;
+    }
+    target = fileManager.beginRewrite(track.path, track.size);
+    if (!target) {
+        source.close();
+        return false;
+    }
+    copied = 0;
+    return true;
+}
+
+void SdMaintenance::endRewrite(bool keep) {
+    FileManager& fileManager = FileManager::getInstance();
+    const Track& track = toCompact[nextCompact++];
+    source.close();
+    target.close();
+
+    // Pre-allocation takes free clusters in order, which on a card with scattered free
+    // space can still come out split; only an improvement replaces the original
+    uint32_t fragments = 0;
+    uint32_t clusters;
+    if (keep) {
+        keep = fileManager.countFragments(track.path + ".tmp", fragments, clusters) && fragments < track.fragments;
+    }
+    if (fileManager.finishRewrite(track.path, track.size, keep)) {
+        current.compacted++;
+        current.fragmentsRemoved += track.fragments - fragments;
+        current.bytesRewritten += track.size;
+        Serial.printf("SdMaintenance: Rewrote %s, %u runs -> %u\n", track.path.c_str(), track.fragments, fragments);
+    } else {
+        current.compactSkipped++;
+    }
+}
+
+void SdMaintenance::abandonRewrite() {
+    const Track& track = toCompact[nextCompact];
+    source.close();
+    target.close();
+    FileManager::getInstance().finishRewrite(track.path, track.size, false);
+}
+
+String SdMaintenance::getStatusString() {
+    static const char* stateNames[] = {"idle", "sweeping", "measuring", "compacting"};
+    FileManager& fileManager = FileManager::getInstance();
+    String info = "SD Maintenance:\n";
+    info += "Enabled: " + String(enabled ? "yes" : "no") + "\n";
+    info += "State: " + String(stateNames[state]);
+    if (state == SWEEPING) {
+        info += " (" + String(pendingDirs.size()) + " directories left, " + String(tracks.size()) + " tracks found)";
+    } else if (state == MEASURING) {
+        info += " (" + String(nextTrack) + "/" + String(tracks.size()) + ")";
+    } else if (state == COMPACTING) {
+        info += " (" + String(nextCompact) + "/" + String(toCompact.size()) + ")";
+    }
+    info += "\n";
+    if (!lastSkipReason.isEmpty()) {
+        info += "Waiting: " + lastSkipReason + "\n";
+    }
+    if (state == IDLE) {
+        long wait = (long)(nextPassAt - millis());
+        info += "Next pass in: " + String(wait > 0 ? wait / 1000 : 0) + " s\n";
+    }
+    info += "Passes: " + String(passes) + "\n";
+    if (passes == 0) {
+        return info;
+    }
+
+    info += "Last pass: " + String(last.durationMs / 1000) + " s\n";
+    info += "  Temp files removed: " + String(last.tempsRemoved) + " (" + fileManager.formatBytes(last.tempBytesFreed) + ")\n";
+    info += "  Tracks measured: " + String(last.filesMeasured) + " in " + String(last.clusters) + " clusters\n";
+    if (last.filesMeasured > 0) {
+        info += "  Fragmented: " + String(last.fragmentedFiles) + " (" +
+                String(100.0f * last.fragmentedFiles / last.filesMeasured, 1) + "%), " +
+                String(last.fragments) + " extra runs\n";
+    }
+    if (last.worstFragments > 1) {
+        info += "  Worst: " + last.worstPath + " in " + String(last.worstFragments) + " runs\n";
+    }
+    info += "  Compacted: " + String(last.compacted) + " (" + String(last.fragmentsRemoved) + " runs merged, " +
+            fileManager.formatBytes(last.bytesRewritten) + " rewritten), " + String(last.compactSkipped) + " skipped\n";
+    return info;
+}
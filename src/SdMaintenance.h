@@ -0,0 +1,104 @@
+#ifndef SD_MAINTENANCE_H
+#define SD_MAINTENANCE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <vector>
+
+// Background upkeep of the SD card, run while the device charges with nothing to do.
+//
+// A pass walks the card one directory per step, removing .tmp files nothing can
+// resume from (downloads and manifests leave them beside their targets when power
+// goes), and measures how many cluster runs each track occupies. Tracks split into
+// many runs are then copied, a slice per step, into a pre-allocated file, which
+// replaces the original only if it came out in fewer runs. Any activity (a dock,
+// audio, a request or download, unplugging) pauses the pass; a copy in progress is
+// dropped and redone from the start.
+class SdMaintenance {
+public:
+    static SdMaintenance& getInstance();
+
+    void begin();
+    void update(); // Call from loop()
+
+    void runNow(); // Start a pass at the next idle moment, ignoring the interval
+    String getStatusString();
+
+private:
+    static SdMaintenance* instance;
+
+    static const unsigned long RUN_INTERVAL_MS = 24UL * 60UL * 60UL * 1000UL; // Between complete passes
+    static const unsigned long FIRST_RUN_DELAY_MS = 15UL * 60UL * 1000UL;
+    static const unsigned long CHECK_INTERVAL_MS = 1000; // Config re-read and idle checks between passes
+    static const unsigned long STEP_SLICE_MS = 20;       // Longest a step holds the loop
+    static const size_t COPY_BUFFER_SIZE = 16384;
+    static const size_t MIN_TRACK_SIZE = 262144;        // Smaller files are not worth measuring
+    static const uint32_t COMPACT_MIN_FRAGMENTS = 8;    // Runs before a track counts as heavily fragmented
+    static const int MAX_COMPACTIONS_PER_PASS = 16;
+    static const size_t COMPACT_FREE_MARGIN = 64UL * 1024UL * 1024UL; // Left free beyond the copy
+
+    enum State {
+        IDLE,       // Waiting for the next pass
+        SWEEPING,   // Walking directories: stale temps go, tracks are listed
+        MEASURING,  // Counting each listed track's cluster runs
+        COMPACTING  // Rewriting the worst tracks contiguously
+    };
+
+    struct Track {
+        String path;
+        size_t size;
+        uint32_t fragments;
+    };
+
+    State state;
+    bool enabled; // Config key maintenance_enabled, re-read every CHECK_INTERVAL_MS
+    unsigned long lastCheck;
+    unsigned long passStart;
+    unsigned long nextPassAt;
+    std::vector<String> pendingDirs;
+    std::vector<Track> tracks;
+    size_t nextTrack;
+    std::vector<Track> toCompact; // Most fragmented first
+    size_t nextCompact;
+
+    // The rewrite in progress
+    File source;
+    File target;
+    uint8_t* buffer;
+    size_t copied;
+
+    struct PassStats {
+        uint32_t tempsRemoved;
+        uint64_t tempBytesFreed;
+        uint32_t filesMeasured;
+        uint32_t clusters;
+        uint32_t fragments;       // Runs beyond the first, summed over files
+        uint32_t fragmentedFiles; // In more than one run
+        uint32_t worstFragments;
+        String worstPath;
+        uint32_t compacted;
+        uint32_t fragmentsRemoved;
+        uint64_t bytesRewritten;
+        uint32_t compactSkipped;  // No space, or the copy came out no better
+        unsigned long durationMs;
+    } current, last;
+    uint32_t passes;
+    String lastSkipReason;
+
+    SdMaintenance();
+    SdMaintenance(const SdMaintenance&) = delete;
+    SdMaintenance& operator=(const SdMaintenance&) = delete;
+
+    bool conditionsMet(String& reason);
+    void startPass();
+    void finishPass();
+    void sweepStep();
+    void measureStep();
+    void compactStep();
+    bool startRewrite(const Track& track);
+    void endRewrite(bool keep);
+    void abandonRewrite();
+    static void resetStats(PassStats& stats);
+};
+
+#endif // SD_MAINTENANCE_H
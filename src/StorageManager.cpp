@@ -0,0 +1,337 @@
+#include "StorageManager.h"
+#include "BlobStore.h"
+#include "ConfigManager.h"
+#include "FileManager.h"
+#include <algorithm>
+
+// Initialize static members
+StorageManager* StorageManager::instance = nullptr;
+const char* StorageManager::NVS_NAMESPACE = "storagemgr";
+const char* StorageManager::NVS_LRU_KEY = "lru";
+
+StorageManager::StorageManager() :
+    dockSeq(0),
+    dockedFigure(0),
+    nvsHandle(0),
+    initialized(false) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+StorageManager& StorageManager::getInstance() {
+    if (instance == nullptr) {
+        instance = new StorageManager();
+    }
+    return *instance;
+}
+
+void StorageManager::begin() {
+    // NVS flash is already initialised by FileManager
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvsHandle);
+    if (err != ESP_OK) {
+        Serial.printf("StorageManager: Failed to open NVS handle: %s\n", esp_err_to_name(err));
+        nvsHandle = 0;
+    }
+    loadDockRecords();
+
+    if (FileManager::getInstance().isSDCardAvailable()) {
+        unsigned long start = millis();
+        scanFigures();
+        Serial.printf("StorageManager: %u figures using %s, scanned in %lu ms\n", figures.size(),
+                      FileManager::getInstance().formatBytes(getFiguresBytes()).c_str(), millis() - start);
+    }
+    initialized = true;
+}
+
+StorageManager::FigureUsage* StorageManager::findUsage(uint32_t figureId) {
+    for (auto& usage : figures) {
+        if (usage.figureId == figureId) {
+            return &usage;
+        }
+    }
+    return nullptr;
+}
+
+StorageManager::FigureUsage& StorageManager::usageFor(uint32_t figureId) {
+    FigureUsage* existing = findUsage(figureId);
+    if (existing != nullptr) {
+        return *existing;
+    }
+    FigureUsage usage;
+    usage.figureId = figureId;
+    usage.lastDockSeq = 0;
+    usage.bytes = 0;
+    figures.push_back(usage);
+    return figures.back();
+}
+
+uint64_t StorageManager::getFiguresBytes() const {
+    uint64_t total = BlobStore::getInstance().getStoredBytes(); // Shared audio counts once
+    for (const auto& usage : figures) {
+        total += usage.bytes;
+    }
+    return total;
+}
+
+uint64_t StorageManager::getQuotaBytes() {
+    int quotaMb = ConfigManager::getInstance().getInt("storage_quota_mb", 0);
+    return quotaMb > 0 ? (uint64_t)quotaMb * 1024ULL * 1024ULL : 0;
+}
+
+void StorageManager::noteDock(uint32_t figureId) {
+    if (figureId == 0) {
+        return;
+    }
+    dockedFigure = figureId;
+    usageFor(figureId).lastDockSeq = ++dockSeq;
+    saveDockRecords();
+}
+
+void StorageManager::clearDockedFigure() {
+    dockedFigure = 0;
+}
+
+void StorageManager::onFileAdded(uint32_t figureId, size_t bytes) {
+    if (figureId != 0) {
+        usageFor(figureId).bytes += bytes;
+    }
+}
+
+void StorageManager::onFileRemoved(uint32_t figureId, size_t bytes) {
+    FigureUsage* usage = figureId != 0 ? findUsage(figureId) : nullptr;
+    if (usage != nullptr) {
+        usage->bytes = usage->bytes > bytes ? usage->bytes - bytes : 0;
+    }
+}
+
+void StorageManager::onFigureDeleted(uint32_t figureId) {
+    for (auto it = figures.begin(); it != figures.end(); ++it) {
+        if (it->figureId == figureId) {
+            figures.erase(it);
+            saveDockRecords();
+            return;
+        }
+    }
+}
+
+bool StorageManager::fitsBudget(size_t bytesNeeded) {
+    FileManager& fileManager = FileManager::getInstance();
+    uint64_t reserve = (uint64_t)ConfigManager::getInstance().getInt("storage_reserve_mb", DEFAULT_RESERVE_MB) * 1024ULL * 1024ULL;
+    if (fileManager.getSDCardFreeSpace() < (uint64_t)bytesNeeded + reserve) {
+        return false;
+    }
+    uint64_t quota = getQuotaBytes();
+    return quota == 0 || getFiguresBytes() + bytesNeeded <= quota;
+}
+
+bool StorageManager::ensureSpace(size_t bytesNeeded, uint32_t forFigure) {
+    if (!initialized) {
+        return FileManager::getInstance().getSDCardFreeSpace() >= (uint64_t)bytesNeeded;
+    }
+    if (fitsBudget(bytesNeeded)) {
+        return true;
+    }
+
+    if (ConfigManager::getInstance().getInt("evict_policy", 1) == 0) {
+        stats.refusals++;
+        Serial.printf("StorageManager: No room for %u bytes and eviction is off\n", bytesNeeded);
+        return false;
+    }
+
+    // A download may only push out figures docked longer ago than its own figure, so a
+    // prefetch never evicts anything and a docked figure can evict everything else
+    FigureUsage* own = forFigure != 0 ? findUsage(forFigure) : nullptr;
+    uint32_t ownSeq = own != nullptr ? own->lastDockSeq : 0;
+    if (forFigure == dockedFigure && forFigure != 0) {
+        ownSeq = UINT32_MAX;
+    }
+
+    while (!fitsBudget(bytesNeeded)) {
+        uint32_t victim = 0;
+        uint32_t victimSeq = UINT32_MAX;
+        for (const auto& usage : figures) {
+            if (usage.figureId == forFigure || usage.figureId == dockedFigure ||
+                (usage.bytes == 0 && !BlobStore::getInstance().hasReferences(usage.figureId))) {
+                continue;
+            }
+            if (usage.lastDockSeq < ownSeq && usage.lastDockSeq < victimSeq) {
+                victim = usage.figureId;
+                victimSeq = usage.lastDockSeq;
+            }
+        }
+        if (victim == 0) {
+            stats.refusals++;
+            Serial.printf("StorageManager: No evictable figure left to make room for %u bytes\n", bytesNeeded);
+            return false;
+        }
+        if (!evictFigure(victim)) {
+            stats.refusals++;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool StorageManager::evictFigure(uint32_t figureId) {
+    FigureUsage* usage = findUsage(figureId);
+    uint32_t bytes = usage != nullptr ? usage->bytes : 0;
+    Serial.printf("StorageManager: Evicting figure %u (%u bytes, last dock #%u)\n",
+                  figureId, bytes, usage != nullptr ? usage->lastDockSeq : 0);
+
+    // Takes the whole directory tree along with required files and queued downloads
+    FileManager& fileManager = FileManager::getInstance();
+    bool removed = fileManager.deleteFigureFiles(String(figureId)); // Also drops the usage entry
+    stats.evictions++;
+    stats.bytesEvicted += bytes;
+    return removed;
+}
+
+size_t StorageManager::figureDirectoryBytes(uint32_t figureId) {
+    fs::FS& fs = FileManager::getInstance().getFS();
+    size_t total = 0;
+    File dir = fs.open("/figures/" + String(figureId));
+    if (!dir || !dir.isDirectory()) {
+        return 0;
+    }
+    File episode = dir.openNextFile();
+    while (episode) {
+        if (episode.isDirectory()) {
+            File track = episode.openNextFile();
+            while (track) {
+                total += track.size();
+                track.close();
+                track = episode.openNextFile();
+            }
+        }
+        episode.close();
+        episode = dir.openNextFile();
+    }
+    dir.close();
+    return total;
+}
+
+void StorageManager::scanFigures() {
+    fs::FS& fs = FileManager::getInstance().getFS();
+    File root = fs.open("/figures");
+    if (!root || !root.isDirectory()) {
+        return;
+    }
+
+    // Ids first, so no directory handle is held while sizing the figures
+    std::vector<uint32_t> figureIds;
+    File entry = root.openNextFile();
+    while (entry) {
+        if (entry.isDirectory()) {
+            uint32_t figureId = strtoul(entry.name(), nullptr, 10);
+            if (figureId != 0) {
+                figureIds.push_back(figureId);
+            }
+        }
+        entry.close();
+        entry = root.openNextFile();
+    }
+    root.close();
+
+    for (uint32_t figureId : figureIds) {
+        usageFor(figureId).bytes = figureDirectoryBytes(figureId);
+    }
+}
+
+void StorageManager::saveDockRecords() {
+    if (nvsHandle == 0) {
+        return;
+    }
+
+    // Most recently docked first, figures that were never docked are not worth a slot
+    std::vector<DockRecord> records;
+    for (const auto& usage : figures) {
+        if (usage.lastDockSeq != 0) {
+            DockRecord record = {usage.figureId, usage.lastDockSeq};
+            records.push_back(record);
+        }
+    }
+    std::sort(records.begin(), records.end(), [](const DockRecord& a, const DockRecord& b) {
+        return a.lastDockSeq > b.lastDockSeq;
+    });
+    if (records.size() > (size_t)MAX_TRACKED_FIGURES) {
+        records.resize(MAX_TRACKED_FIGURES);
+    }
+
+    esp_err_t err = nvs_set_blob(nvsHandle, NVS_LRU_KEY, records.data(), records.size() * sizeof(DockRecord));
+    if (err != ESP_OK) {
+        Serial.printf("StorageManager: Failed to save dock records: %s\n", esp_err_to_name(err));
+        return;
+    }
+    nvs_commit(nvsHandle);
+}
+
+void StorageManager::loadDockRecords() {
+    if (nvsHandle == 0) {
+        return;
+    }
+
+    DockRecord records[MAX_TRACKED_FIGURES];
+    size_t size = sizeof(records);
+    esp_err_t err = nvs_get_blob(nvsHandle, NVS_LRU_KEY, records, &size);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return;
+    }
+    if (err != ESP_OK) {
+        Serial.printf("StorageManager: Failed to load dock records: %s\n", esp_err_to_name(err));
+        return;
+    }
+
+    for (size_t i = 0; i < size / sizeof(DockRecord); i++) {
+        usageFor(records[i].figureId).lastDockSeq = records[i].lastDockSeq;
+        dockSeq = max(dockSeq, records[i].lastDockSeq);
+    }
+}
+
+String StorageManager::getStatusString() {
+    FileManager& fileManager = FileManager::getInstance();
+    ConfigManager& config = ConfigManager::getInstance();
+    uint64_t quota = getQuotaBytes();
+
+    String info = "Storage Manager:\n";
+    info += "Policy: " + String(config.getInt("evict_policy", 1) ? "LRU eviction" : "off") + "\n";
+    info += "Figures: " + String(figures.size()) + ", using " + fileManager.formatBytes(getFiguresBytes());
+    if (quota) {
+        info += " of " + fileManager.formatBytes(quota) + " quota\n";
+    } else {
+        info += " (no quota)\n";
+    }
+    info += "Reserve: " + String(config.getInt("storage_reserve_mb", DEFAULT_RESERVE_MB)) + " MB\n";
+    info += "Evictions: " + String(stats.evictions) + " (" + fileManager.formatBytes(stats.bytesEvicted) + "), refusals: " + String(stats.refusals) + "\n";
+
+    // Least recently docked first, the order eviction would take
+    std::vector<FigureUsage> ordered = figures;
+    std::sort(ordered.begin(), ordered.end(), [](const FigureUsage& a, const FigureUsage& b) {
+        return a.lastDockSeq < b.lastDockSeq;
+    });
+    for (const auto& usage : ordered) {
+        info += "  Figure " + String(usage.figureId) + ": " + fileManager.formatBytes(usage.bytes);
+        if (usage.figureId == dockedFigure) {
+            info += ", docked";
+        } else if (usage.lastDockSeq == 0) {
+            info += ", never docked";
+        } else {
+            info += ", last dock #" + String(usage.lastDockSeq);
+        }
+        info += "\n";
+    }
+    return info;
+}
+
+size_t StorageManager::formatReportJson(char* buffer, size_t size) {
+    int written = snprintf(buffer, size,
+                           "{\"policy\":\"%s\",\"quota_mb\":%u,\"used_mb\":%u,\"figures\":%u,\"evictions\":%u}",
+                           ConfigManager::getInstance().getInt("evict_policy", 1) ? "lru" : "off",
+                           (unsigned)(getQuotaBytes() / (1024ULL * 1024ULL)),
+                           (unsigned)(getFiguresBytes() / (1024ULL * 1024ULL)),
+                           (unsigned)figures.size(),
+                           (unsigned)stats.evictions);
+    if (written < 0 || (size_t)written >= size) {
+        buffer[0] = '\0';
+        return 0;
+    }
+    return written;
+}
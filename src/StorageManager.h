@@ -0,0 +1,91 @@
+#ifndef STORAGE_MANAGER_H
+#define STORAGE_MANAGER_H
+
+#include <Arduino.h>
+#include <nvs.h>
+#include <vector>
+
+// Keeps /figures within its storage budget by evicting least recently docked figures.
+//
+// Tracks the bytes each figure occupies on the card and a dock sequence number per
+// figure (persisted in NVS, no wall clock needed); audio shared through BlobStore is
+// counted once, under no figure, and goes with its last figure. Before a download
+// FileManager asks ensureSpace(); when the card or the quota is short, figures docked
+// longer ago than the one being downloaded are deleted oldest first. The docked
+// figure is never evicted, and figures that were never docked only make room for
+// nothing.
+//
+// Settings (ConfigManager):
+//   storage_quota_mb   - budget for /figures and /blobs, 0 = whole card (default)
+//   storage_reserve_mb - free space always left on the card (default 64)
+//   evict_policy       - 0 = off (downloads fail when full), 1 = LRU (default)
+class StorageManager {
+public:
+    static StorageManager& getInstance();
+
+    // Call after FileManager::begin(); sizes every figure directory once
+    void begin();
+
+    // Dock bookkeeping
+    void noteDock(uint32_t figureId);
+    void clearDockedFigure();
+    uint32_t getDockedFigure() const { return dockedFigure; } // 0 = nothing docked
+
+    // Download hooks from FileManager
+    bool ensureSpace(size_t bytesNeeded, uint32_t forFigure);
+    void onFileAdded(uint32_t figureId, size_t bytes);
+    void onFileRemoved(uint32_t figureId, size_t bytes); // Deleted, or overwritten before a new copy is added
+    void onFigureDeleted(uint32_t figureId);
+
+    uint64_t getFiguresBytes() const;
+    uint64_t getQuotaBytes(); // 0 = no quota
+    String getStatusString();
+    size_t formatReportJson(char* buffer, size_t size);
+
+private:
+    static StorageManager* instance;
+
+    static const char* NVS_NAMESPACE;
+    static const char* NVS_LRU_KEY;
+    static const int MAX_TRACKED_FIGURES = 64;
+    static const int DEFAULT_RESERVE_MB = 64;
+
+    struct FigureUsage {
+        uint32_t figureId;
+        uint32_t lastDockSeq; // 0 = never docked (prefetched)
+        uint32_t bytes;       // Not persisted, rebuilt by the scan in begin()
+    };
+
+    // Persisted part of FigureUsage
+    struct DockRecord {
+        uint32_t figureId;
+        uint32_t lastDockSeq;
+    };
+
+    std::vector<FigureUsage> figures;
+    uint32_t dockSeq;
+    uint32_t dockedFigure; // 0 = nothing docked
+    nvs_handle_t nvsHandle;
+    bool initialized;
+
+    struct Stats {
+        uint32_t evictions;
+        uint64_t bytesEvicted;
+        uint32_t refusals; // ensureSpace() could not make room
+    } stats;
+
+    StorageManager();
+    StorageManager(const StorageManager&) = delete;
+    StorageManager& operator=(const StorageManager&) = delete;
+
+    FigureUsage& usageFor(uint32_t figureId); // Creates the entry if needed
+    FigureUsage* findUsage(uint32_t figureId);
+    bool fitsBudget(size_t bytesNeeded);
+    void scanFigures();
+    size_t figureDirectoryBytes(uint32_t figureId);
+    bool evictFigure(uint32_t figureId);
+    void saveDockRecords();
+    void loadDockRecords();
+};
+
+#endif // STORAGE_MANAGER_H
@@ -0,0 +1,234 @@
+#include "StreamInflater.h"
+#include <esp32/rom/crc.h>
+
+StreamInflater::StreamInflater() :
+    decompressor(nullptr),
+    window(nullptr),
+    windowPos(0),
+    inflateFlags(0),
+    format(FORMAT_GZIP),
+    state(STATE_FAILED),
+    error(""),
+    gzipStage(GZIP_FIXED),
+    gzipFlags(0),
+    collected(0),
+    skipBytes(0),
+    crc(0),
+    outputBytes(0) {
+}
+
+StreamInflater::~StreamInflater() {
+    end();
+}
+
+bool StreamInflater::begin(Format streamFormat) {
+    end();
+    decompressor = (tinfl_decompressor*)malloc(sizeof(tinfl_decompressor));
+    window = (uint8_t*)malloc(TINFL_LZ_DICT_SIZE);
+    if (!decompressor || !window) {
+        end();
+        return false;
+    }
+    tinfl_init(decompressor);
+
+    format = streamFormat;
+    state = format == FORMAT_GZIP ? STATE_GZIP_HEADER : STATE_DEFLATE_PROBE;
+    error = "";
+    windowPos = 0;
+    inflateFlags = TINFL_FLAG_HAS_MORE_INPUT;
+    gzipStage = GZIP_FIXED;
+    gzipFlags = 0;
+    collected = 0;
+    skipBytes = 0;
+    crc = 0;
+    outputBytes = 0;
+    return true;
+}
+
+void StreamInflater::end() {
+    free(decompressor);
+    decompressor = nullptr;
+    free(window);
+    window = nullptr;
+}
+
+bool StreamInflater::fail(const char* message) {
+    state = STATE_FAILED;
+    error = message;
+    return false;
+}
+
+bool StreamInflater::write(const uint8_t* data, size_t length, Sink sink) {
+    if (!decompressor) {
+        return fail("Inflater not started");
+    }
+
+    while (length > 0) {
+        switch (state) {
+            case STATE_GZIP_HEADER: {
+                size_t used = parseGzipHeader(data, length);
+                data += used;
+                length -= used;
+                break;
+            }
+
+            case STATE_DEFLATE_PROBE: {
+                header[collected++] = *data++;
+                length--;
+                if (collected < 2) {
+                    break;
+                }
+                // A zlib header is CM 8 with a check value making the pair a multiple of 31
+                bool zlib = (header[0] & 0x0F) == 8 && ((header[0] << 8) | header[1]) % 31 == 0;
+                if (zlib) {
+                    inflateFlags |= TINFL_FLAG_PARSE_ZLIB_HEADER;
+                }
+                state = STATE_INFLATE;
+                const uint8_t* probe = header;
+                size_t probeLength = 2;
+                if (!inflate(probe, probeLength, sink)) {
+                    return false;
+                }
+                break;
+            }
+
+            case STATE_INFLATE:
+                if (!inflate(data, length, sink)) {
+                    return false;
+                }
+                break;
+
+            case STATE_GZIP_TRAILER:
+                header[collected++] = *data++;
+                length--;
+                if (collected == 8) {
+                    uint32_t expectedCrc = header[0] | (header[1] << 8) | (header[2] << 16) | ((uint32_t)header[3] << 24);
+                    uint32_t expectedSize = header[4] | (header[5] << 8) | (header[6] << 16) | ((uint32_t)header[7] << 24);
+                    if (expectedCrc != crc) {
+                        return fail("gzip CRC mismatch");
+                    }
+                    if (expectedSize != outputBytes) {
+                        return fail("gzip length mismatch");
+                    }
+                    state = STATE_FINISHED;
+                }
+                break;
+
+            case STATE_FINISHED:
+                return true; // Anything after the stream (padding, a second member) is ignored
+
+            default:
+                return false;
+        }
+        if (state == STATE_FAILED) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t StreamInflater::parseGzipHeader(const uint8_t* data, size_t length) {
+    size_t used = 0;
+    while (used < length && state == STATE_GZIP_HEADER) {
+        uint8_t b = data[used++];
+        switch (gzipStage) {
+            case GZIP_FIXED:
+                header[collected++] = b;
+                if (collected == 10) {
+                    if (header[0] != 0x1F || header[1] != 0x8B || header[2] != 8) {
+                        fail("Not a gzip stream");
+                    } else if (header[3] & GZIP_RESERVED_FLAGS) {
+                        fail("Unknown gzip flags");
+                    } else {
+                        gzipFlags = header[3];
+                        advanceGzipHeader();
+                    }
+                }
+                break;
+
+            case GZIP_EXTRA_LENGTH:
+                header[collected++] = b;
+                if (collected == 2) {
+                    skipBytes = header[0] | (header[1] << 8);
+                    advanceGzipHeader();
+                }
+                break;
+
+            case GZIP_EXTRA:
+                if (--skipBytes == 0) {
+                    advanceGzipHeader();
+                }
+                break;
+
+            case GZIP_NAME:
+            case GZIP_COMMENT:
+                if (b == 0) {
+                    advanceGzipHeader();
+                }
+                break;
+
+            case GZIP_HEADER_CRC:
+                if (++collected == 2) {
+                    advanceGzipHeader();
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+    return used;
+}
+
+void StreamInflater::advanceGzipHeader() {
+    collected = 0;
+    for (;;) {
+        gzipStage = (GzipStage)(gzipStage + 1);
+        if ((gzipStage == GZIP_EXTRA_LENGTH && (gzipFlags & GZIP_FEXTRA)) ||
+            (gzipStage == GZIP_EXTRA && skipBytes > 0) ||
+            (gzipStage == GZIP_NAME && (gzipFlags & GZIP_FNAME)) ||
+            (gzipStage == GZIP_COMMENT && (gzipFlags & GZIP_FCOMMENT)) ||
+            (gzipStage == GZIP_HEADER_CRC && (gzipFlags & GZIP_FHCRC))) {
+            return;
+        }
+        if (gzipStage == GZIP_HEADER_DONE) {
+            state = STATE_INFLATE; // Raw deflate follows
+            return;
+        }
+    }
+}
+
+bool StreamInflater::inflate(const uint8_t*& data, size_t& length, Sink sink) {
+    for (;;) {
+        size_t inBytes = length;
+        size_t outBytes = TINFL_LZ_DICT_SIZE - windowPos;
+        tinfl_status status = tinfl_decompress(decompressor, data, &inBytes, window, window + windowPos,
+                                               &outBytes, inflateFlags);
+        data += inBytes;
+        length -= inBytes;
+
+        if (outBytes > 0) {
+            if (format == FORMAT_GZIP) {
+                crc = crc32_le(crc, window + windowPos, outBytes);
+            }
+            outputBytes += outBytes;
+            if (!sink(window + windowPos, outBytes)) {
+                return fail("Output not accepted");
+            }
+            windowPos = (windowPos + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+
+        if (status == TINFL_STATUS_DONE) {
+            collected = 0;
+            state = format == FORMAT_GZIP ? STATE_GZIP_TRAILER : STATE_FINISHED;
+            return true;
+        }
+        if (status < 0) {
+            return fail(status == TINFL_STATUS_ADLER32_MISMATCH ? "zlib checksum mismatch" : "Corrupt compressed data");
+        }
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT) {
+            return true; // Everything handed in has been taken
+        }
+        // TINFL_STATUS_HAS_MORE_OUTPUT: the window wrapped, go round for the rest
+    }
+}
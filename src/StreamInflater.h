@@ -0,0 +1,96 @@
+#ifndef STREAM_INFLATER_H
+#define STREAM_INFLATER_H
+
+#include <Arduino.h>
+#include <esp32/rom/miniz.h>
+
+// Streaming gzip/deflate decoder for compressed downloads, built on the copy of
+// miniz's tinfl in the ESP32 ROM so it costs no flash. Output is produced into a
+// 32KB wrapping window (deflate's longest back-reference) and handed to the sink as
+// it appears. Window plus decoder state come to ~43KB of heap, held only between
+// begin() and end().
+//
+// gzip members are checked against their CRC-32 and length trailer, zlib streams
+// against their Adler-32. "deflate" is accepted zlib-wrapped, as HTTP specifies, and
+// raw, as some servers send it anyway.
+class StreamInflater {
+public:
+    enum Format : uint8_t {
+        FORMAT_GZIP,
+        FORMAT_DEFLATE
+    };
+
+    // Receives decoded bytes; returning false stops the stream
+    typedef bool (*Sink)(const uint8_t* data, size_t length);
+
+    static const size_t MEMORY_NEEDED = sizeof(tinfl_decompressor) + TINFL_LZ_DICT_SIZE;
+
+    StreamInflater();
+    ~StreamInflater();
+
+    bool begin(Format format); // false when the heap cannot hold the window
+    void end();
+
+    // Feeds compressed bytes; false on corrupt data or when the sink refused output
+    bool write(const uint8_t* data, size_t length, Sink sink);
+
+    bool isActive() const { return decompressor != nullptr; }
+    bool finished() const { return state == STATE_FINISHED; } // End of stream seen and verified
+    const char* getError() const { return error; }
+    uint32_t getOutputBytes() const { return outputBytes; }
+
+private:
+    StreamInflater(const StreamInflater&) = delete;
+    StreamInflater& operator=(const StreamInflater&) = delete;
+
+    enum State : uint8_t {
+        STATE_GZIP_HEADER = 0,
+        STATE_DEFLATE_PROBE,  // First two bytes tell zlib from raw deflate
+        STATE_INFLATE,
+        STATE_GZIP_TRAILER,
+        STATE_FINISHED,
+        STATE_FAILED
+    };
+
+    // gzip header fields after the fixed 10 bytes, in file order
+    enum GzipStage : uint8_t {
+        GZIP_FIXED = 0,
+        GZIP_EXTRA_LENGTH,
+        GZIP_EXTRA,
+        GZIP_NAME,
+        GZIP_COMMENT,
+        GZIP_HEADER_CRC,
+        GZIP_HEADER_DONE
+    };
+
+    static const uint8_t GZIP_FHCRC = 0x02;
+    static const uint8_t GZIP_FEXTRA = 0x04;
+    static const uint8_t GZIP_FNAME = 0x08;
+    static const uint8_t GZIP_FCOMMENT = 0x10;
+    static const uint8_t GZIP_RESERVED_FLAGS = 0xE0;
+
+    tinfl_decompressor* decompressor;
+    uint8_t* window;
+    size_t windowPos;
+    int inflateFlags;
+
+    Format format;
+    State state;
+    const char* error;
+
+    GzipStage gzipStage;
+    uint8_t gzipFlags;
+    uint8_t header[10]; // Fixed gzip header, extra length, trailer or the deflate probe
+    size_t collected;
+    size_t skipBytes;
+
+    uint32_t crc;
+    uint32_t outputBytes;
+
+    size_t parseGzipHeader(const uint8_t* data, size_t length);
+    void advanceGzipHeader();
+    bool inflate(const uint8_t*& data, size_t& length, Sink sink);
+    bool fail(const char* message);
+};
+
+#endif // STREAM_INFLATER_H
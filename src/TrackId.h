@@ -0,0 +1,84 @@
+#ifndef TRACK_ID_H
+#define TRACK_ID_H
+
+#include <Arduino.h>
+#include <stdlib.h>
+
+// Compact identifier for a figure track stored at /figures/<figure>/<episode>/<track>.wav.
+// Twelve bytes by value instead of a heap String per copy; the path is formatted on demand
+// into a caller-provided (usually stack) buffer.
+struct TrackId {
+    // "/figures/" + three 10-digit ids + two separators + ".wav" + terminator
+    static const size_t PATH_MAX_LEN = 48;
+
+    uint32_t figure;
+    uint32_t episode;
+    uint32_t track;
+
+    TrackId() : figure(0), episode(0), track(0) {}
+    TrackId(uint32_t figureId, uint32_t episodeId, uint32_t trackId)
+        : figure(figureId), episode(episodeId), track(trackId) {}
+
+    // Server ids start at 1, so a zero component means "not a track path"
+    bool isValid() const { return figure != 0 && episode != 0 && track != 0; }
+
+    // Format the local path into buffer, returns the number of characters written
+    size_t formatPath(char* buffer, size_t size) const {
+        int written = snprintf(buffer, size, "/figures/%u/%u/%u.wav",
+                               (unsigned)figure, (unsigned)episode, (unsigned)track);
+        return written > 0 ? (size_t)written : 0;
+    }
+
+    // Convenience for the few APIs that still require a String
+    String toPath() const {
+        char path[PATH_MAX_LEN];
+        formatPath(path, sizeof(path));
+        return String(path);
+    }
+
+    // Parse "/figures/<figure>/<episode>/<track>.wav", returns false for any other layout
+    static bool fromPath(const char* path, TrackId& out) {
+        static const char PREFIX[] = "/figures/";
+        if (path == nullptr || strncmp(path, PREFIX, sizeof(PREFIX) - 1) != 0) {
+            return false;
+        }
+
+        const char* cursor = path + sizeof(PREFIX) - 1;
+        uint32_t parts[3];
+        for (int i = 0; i < 3; i++) {
+            if (*cursor < '0' || *cursor > '9') {
+                return false;
+            }
+            char* end = nullptr;
+            parts[i] = strtoul(cursor, &end, 10);
+            char expected = (i < 2) ? '/' : '.';
+            if (end == nullptr || *end != expected) {
+                return false;
+            }
+            cursor = end + 1;
+        }
+
+        if (strcmp(cursor, "wav") != 0) {
+            return false;
+        }
+
+        out = TrackId(parts[0], parts[1], parts[2]);
+        return out.isValid();
+    }
+
+    static bool fromPath(const String& path, TrackId& out) {
+        return fromPath(path.c_str(), out);
+    }
+
+    bool operator==(const TrackId& other) const {
+        return figure == other.figure && episode == other.episode && track == other.track;
+    }
+    bool operator!=(const TrackId& other) const { return !(*this == other); }
+    bool operator<(const TrackId& other) const {
+        if (figure != other.figure) return figure < other.figure;
+        if (episode != other.episode) return episode < other.episode;
+        return track < other.track;
+    }
+};
+
+#endif // TRACK_ID_H
@@ -9,6 +9,11 @@
 #include "NfcController.h"
 #include "RequestManager.h"
 #include "ReverbClient.h"
+#include "ConnectionManager.h"
+#include "PrefetchScheduler.h"
+#include "SdMaintenance.h"
+#include "StorageManager.h"
+#include "BlobStore.h"
 #include "Buttons.h"
 
 // Use the singleton instance from the header
@@ -47,6 +52,45 @@ void handleChatMessage(const String &message)
 
 // +++ NFC Callback Functions +++
 
+// Dock-to-first-audio latency, split by whether playback came from the catalogue cache
+struct DockLatencyStats
+{
+    unsigned long dockedAt; // millis() of the dock being measured, 0 once audio started
+    uint32_t cachedCount;
+    uint32_t cachedTotalMs;
+    uint32_t networkCount;
+    uint32_t networkTotalMs;
+    uint32_t lastMs;
+    uint32_t maxMs;
+};
+DockLatencyStats dockLatency = {};
+
+void recordDockLatency(bool fromCache)
+{
+    if (dockLatency.dockedAt == 0)
+    {
+        return;
+    }
+    uint32_t latencyMs = millis() - dockLatency.dockedAt;
+    dockLatency.dockedAt = 0;
+    dockLatency.lastMs = latencyMs;
+    if (latencyMs > dockLatency.maxMs)
+    {
+        dockLatency.maxMs = latencyMs;
+    }
+    if (fromCache)
+    {
+        dockLatency.cachedCount++;
+        dockLatency.cachedTotalMs += latencyMs;
+    }
+    else
+    {
+        dockLatency.networkCount++;
+        dockLatency.networkTotalMs += latencyMs;
+    }
+    Serial.printf("Dock-to-audio latency: %u ms (%s)\n", latencyMs, fromCache ? "catalogue cache" : "network");
+}
+
 // Callback function for when figure download is complete
 void onFigureDownloadComplete(const String &uid, const String &figureName, bool success, const String &error, const RequestManager::Figure &figure)
 {
@@ -65,35 +109,53 @@ void onFigureDownloadComplete(const String &uid, const String &figureName, bool
         // Check if the figure is still mounted on the device
         if (nfcController.isCardPresent() && nfcController.currentNFCData().uidString == uid)
         {
-            Serial.println("Figure is still mounted! Starting automatic playback...");
-            
-            // Add delay and heap check to prevent rapid execution
-            delay(300);  // Give system time to stabilize
-
-            // Pulse LED green to indicate success
-            ledController.pulseRapid(0x00FF00, 2); // Green color, 2 rapid pulses
-
             // Create playlist from the figure structure
-            std::vector<String> playlist;
+            std::vector<TrackId> playlist;
+            char trackPath[TrackId::PATH_MAX_LEN];
             for (const auto &episode : figure.episodes)
             {
                 for (const auto &track : episode.tracks)
                 {
-                    playlist.push_back(track.localPath);
-                    Serial.printf("Added to playlist: %s (%s)\n", track.localPath.c_str(), track.name.c_str());
+                    playlist.push_back(track.ref);
+                    BlobStore::localPath(track.ref, track.blobKey, trackPath, sizeof(trackPath));
+                    Serial.printf("Added to playlist: %s (%s)\n", trackPath, track.name.c_str());
                 }
             }
 
-            if (!playlist.empty())
+            if (playlist.empty())
             {
-                // Set the playlist and start playing
-                audioController.setPlaylist(playlist, uid);
-                audioController.play(); // Start playing the first track
-                Serial.printf("Started playing figure '%s' with %d tracks\n", figureName.c_str(), playlist.size());
+                Serial.println("No tracks found in figure structure!");
+            }
+            else if (audioController.hasPlaylist() && audioController.getPlaylistFigureUid() == uid)
+            {
+                // Background revalidation of the figure already playing: patch, don't restart
+                if (audioController.updatePlaylist(std::move(playlist), uid))
+                {
+                    Serial.println("Figure changed on the server, playlist updated in place");
+                }
+                else
+                {
+                    Serial.println("Figure unchanged, playlist kept");
+                }
             }
             else
             {
-                Serial.println("No tracks found in figure structure!");
+                Serial.println("Figure is still mounted! Starting automatic playback...");
+
+                // Add delay and heap check to prevent rapid execution
+                delay(300);  // Give system time to stabilize
+
+                // Pulse LED green to indicate success
+                ledController.pulseRapid(0x00FF00, 2); // Green color, 2 rapid pulses
+
+                // Set the playlist and start playing
+                size_t trackCount = playlist.size();
+                audioController.setPlaylist(std::move(playlist), uid);
+                if (audioController.play()) // Start playing the first track
+                {
+                    recordDockLatency(requestManager.isRevalidationPending());
+                }
+                Serial.printf("Started playing figure '%s' with %d tracks\n", figureName.c_str(), trackCount);
             }
         }
         else
@@ -128,6 +190,11 @@ void afterNFCRead(const NFCData &nfcData)
 
     // Example: Play a sound and turn the LED green
     // audioController.play("/sounds/nfc_success.wav");
+    dockLatency.dockedAt = millis();
+    if (dockLatency.dockedAt == 0)
+    {
+        dockLatency.dockedAt = 1; // 0 means "not measuring"
+    }
     ledController.pulseRapid(0x00FF00, 3); // Green color
     // we need to check if the figure tracks are downloaded and they exist
     // we need to send get request with bearer token to the url :https://portal.tilkietalkie.com/api/units/{nfc_uid}
@@ -143,6 +210,11 @@ void afterDetachNFC()
     Serial.println("=== Hook: afterDetachNFC ===");
     Serial.println("NFC session has ended.");
 
+    // Nothing left to revalidate or measure for this figure
+    requestManager.cancelFigureRequests();
+    StorageManager::getInstance().clearDockedFigure();
+    dockLatency.dockedAt = 0;
+
     // Stop audio and clear the playlist
     audioController.stop();
     audioController.clearPlaylist();
@@ -203,6 +275,18 @@ void setup()
         Serial.println("Audio functionality will not be available.");
     }
 
+    // Shared track audio; counts blob references from the manifests before storage sizes them
+    BlobStore::getInstance().begin();
+
+    // Per-figure storage accounting for LRU eviction, sizes /figures once
+    StorageManager::getInstance().begin();
+
+    // Prefetch likely figures while charging; needs the request and file managers
+    PrefetchScheduler::getInstance().begin();
+
+    // Temp sweeping and track compaction while charging and idle
+    SdMaintenance::getInstance().begin();
+
     // Initialize LED controller
     Serial.println("Initializing LED Controller...");
     ledController.begin();
@@ -397,12 +481,21 @@ void loop()
             Serial.println("  delete  - Delete ALL required files from NVS and storage");
             Serial.println("  deletefig <uid> - Delete all files for a specific figure");
             Serial.println("  dlstats - Show download statistics");
+            Serial.println("  dlbench <url> [runs] - Time downloads of url into /temp (heap, attempts, KB/s)");
+            Serial.println("  dlprogress - Show the progress snapshot of the running download");
+            Serial.println("  ledprogress on|off - Show download progress on the LED");
+            Serial.println("  dlcompress on|off - Ask for gzip/deflate downloads (~43KB heap while decoding)");
             Serial.println("  dlqueue - Show download queue");
             Serial.println("  required- Show required files");
             Serial.println("  download <url> <path> - Download file from URL");
             Serial.println("  addfile <path> <url> - Add required file");
             Serial.println("  checkfiles - Check and download missing files");
-            Serial.println("  cleanup - Clean up temporary files");
+            Serial.println("  cleanup - Remove stale temporary files anywhere on the card");
+            Serial.println("  trackmem - Compare heap use of track paths vs compact track ids");
+            Serial.println("  sdcache - Show SD entry cache statistics");
+            Serial.println("  sdreadbench <path> - Measure sequential read throughput of a file");
+            Serial.println("  sdbus [spi|1bit|4bit|bench|all] - Show, switch or benchmark the SD bus");
+            Serial.println("  sdbench [report on|off] - Benchmark SD throughput/latency, optionally include in device report");
             Serial.println("Audio Commands:");
             Serial.println("  play <path> - Play wav file");
             Serial.println("  pause   - Pause current playback");
@@ -430,6 +523,14 @@ void loop()
             Serial.println("  send <message> - Send message to Reverb API for broadcast");
             Serial.println("  wsstatus - Show WebSocket connection status");
             Serial.println("  testauth - Test stored JWT token authorization with server");
+            Serial.println("  netstats [reset] - Show connection pool reuse and latency statistics");
+            Serial.println("  docklatency - Show dock-to-first-audio latency (cache vs network)");
+            Serial.println("  swr on|off  - Toggle instant playback from cache with background revalidation");
+            Serial.println("  prefetch [now|on|off|floor <MB>] - Prefetch status, start a pass, toggle, set free space floor");
+            Serial.println("  storage - Show per-figure storage use in eviction order");
+            Serial.println("  storage quota|reserve <MB>, storage evict lru|off - Tune the storage budget");
+            Serial.println("  blobs       - Show shared track audio in the blob store");
+            Serial.println("  maintenance [now|on|off] - SD maintenance status and fragmentation, start a pass, toggle");
             Serial.println("Type any command for help\n");
             Serial.flush();
             return; // Skip further processing
@@ -499,6 +600,90 @@ void loop()
                 Serial.println("Cannot start Reverb - WiFi not connected");
             }
         }
+        else if (command == "netstats")
+        {
+            Serial.println(ConnectionManager::getInstance().getStatsString());
+        }
+        else if (command == "netstats reset")
+        {
+            ConnectionManager::getInstance().resetStats();
+            Serial.println("Connection statistics reset");
+        }
+        else if (command == "docklatency")
+        {
+            Serial.println("--- Dock-to-Audio Latency ---");
+            Serial.printf("From cache:   %u docks, avg %u ms\n", dockLatency.cachedCount,
+                          dockLatency.cachedCount ? dockLatency.cachedTotalMs / dockLatency.cachedCount : 0);
+            Serial.printf("From network: %u docks, avg %u ms\n", dockLatency.networkCount,
+                          dockLatency.networkCount ? dockLatency.networkTotalMs / dockLatency.networkCount : 0);
+            Serial.printf("Last: %u ms, max: %u ms\n", dockLatency.lastMs, dockLatency.maxMs);
+            Serial.printf("Stale-while-revalidate: %s\n", config.getInt("swr_playback", 1) ? "on" : "off");
+        }
+        else if (command == "swr on" || command == "swr off")
+        {
+            config.storeInt("swr_playback", command == "swr on" ? 1 : 0);
+            Serial.printf("Stale-while-revalidate playback %s\n", command == "swr on" ? "enabled" : "disabled");
+        }
+        else if (command == "prefetch")
+        {
+            Serial.print(PrefetchScheduler::getInstance().getStatusString());
+        }
+        else if (command == "prefetch now")
+        {
+            PrefetchScheduler::getInstance().runNow();
+        }
+        else if (command == "prefetch on" || command == "prefetch off")
+        {
+            config.storeInt("prefetch_enabled", command == "prefetch on" ? 1 : 0);
+            Serial.printf("Prefetch %s\n", command == "prefetch on" ? "enabled" : "disabled");
+        }
+        else if (command == "storage")
+        {
+            Serial.print(StorageManager::getInstance().getStatusString());
+        }
+        else if (command == "maintenance")
+        {
+            Serial.print(SdMaintenance::getInstance().getStatusString());
+        }
+        else if (command == "maintenance now")
+        {
+            SdMaintenance::getInstance().runNow();
+        }
+        else if (command == "maintenance on" || command == "maintenance off")
+        {
+            config.storeInt("maintenance_enabled", command == "maintenance on" ? 1 : 0);
+            Serial.printf("SD maintenance %s\n", command == "maintenance on" ? "enabled" : "disabled");
+        }
+        else if (command == "blobs")
+        {
+            Serial.print(BlobStore::getInstance().getStatusString());
+        }
+        else if (command.startsWith("storage quota ") || command.startsWith("storage reserve "))
+        {
+            bool quota = command.startsWith("storage quota ");
+            int megabytes = command.substring(quota ? 14 : 16).toInt();
+            config.storeInt(quota ? "storage_quota_mb" : "storage_reserve_mb", megabytes);
+            Serial.printf("Storage %s set to %d MB%s\n", quota ? "quota" : "reserve", megabytes,
+                          quota && megabytes == 0 ? " (whole card)" : "");
+        }
+        else if (command == "storage evict lru" || command == "storage evict off")
+        {
+            config.storeInt("evict_policy", command == "storage evict lru" ? 1 : 0);
+            Serial.printf("Storage eviction %s\n", command == "storage evict lru" ? "set to LRU" : "disabled");
+        }
+        else if (command.startsWith("prefetch floor "))
+        {
+            int floorMb = command.substring(15).toInt();
+            if (floorMb > 0)
+            {
+                config.storeInt("prefetch_min_free_mb", floorMb);
+                Serial.printf("Prefetch keeps at least %d MB free\n", floorMb);
+            }
+            else
+            {
+                Serial.println("Usage: prefetch floor <MB>");
+            }
+        }
         else if (command == "testauth")
         {
             Serial.println("\n--- Testing Authorization ---");
@@ -519,15 +704,15 @@ void loop()
             Serial.println("🔑 JWT Token found, testing with server...");
             Serial.printf("Token length: %d characters\n", token.length());
 
-            // Use the same method as ReverbClient for consistency
-            WiFiClientSecure client;
-            client.setInsecure(); // For testing only
-
-            HTTPClient http;
+            // Use the shared TLS connection, same as ReverbClient
+            ConnectionManager &connections = ConnectionManager::getInstance();
+            String connectError;
             String url = "https://portal.tilkietalkie.com/api/user"; // Simple endpoint to test auth
 
-            if (http.begin(client, url))
+            HTTPClient *request = connections.beginRequest(url, connectError);
+            if (request)
             {
+                HTTPClient &http = *request;
                 http.addHeader("Authorization", "Bearer " + token);
                 http.addHeader("Accept", "application/json");
 
@@ -555,11 +740,11 @@ void loop()
                     Serial.printf("❌ HTTP request failed with error: %d\n", httpCode);
                 }
 
-                http.end();
+                connections.endRequest(request);
             }
             else
             {
-                Serial.println("❌ Failed to connect to server");
+                Serial.printf("❌ Failed to connect to server: %s\n", connectError.c_str());
             }
         }
         else if (command == "factory" && DEBUG)
@@ -1229,11 +1414,191 @@ void loop()
             }
             Serial.println("----------------------------------\n");
         }
+        else if (command == "trackmem")
+        {
+            // Heap cost of one 200-track figure: full path Strings vs compact track ids.
+            // The same list used to be held by RequestManager::Track, the download tracker,
+            // the playlist and FileEntry, so multiply by the number of copies for the total.
+            const int TRACK_COUNT = 200;
+            const int COPIES = 4;
+            Serial.println("\n--- Track Reference Heap Usage (200 tracks) ---");
+
+            size_t heapBefore = ESP.getFreeHeap();
+            size_t stringBytes = 0;
+            {
+                std::vector<String> paths;
+                paths.reserve(TRACK_COUNT);
+                for (int i = 0; i < TRACK_COUNT; i++)
+                {
+                    paths.push_back(TrackId(1042, 300 + i / 20, 5000 + i).toPath());
+                }
+                stringBytes = heapBefore - ESP.getFreeHeap();
+            }
+
+            heapBefore = ESP.getFreeHeap();
+            size_t idBytes = 0;
+            {
+                std::vector<TrackId> ids;
+                ids.reserve(TRACK_COUNT);
+                for (int i = 0; i < TRACK_COUNT; i++)
+                {
+                    ids.push_back(TrackId(1042, 300 + i / 20, 5000 + i));
+                }
+                idBytes = heapBefore - ESP.getFreeHeap();
+            }
+
+            Serial.printf("String paths:  %u bytes per list, ~%u bytes across %d copies\n",
+                          stringBytes, stringBytes * COPIES, COPIES);
+            Serial.printf("TrackId list:  %u bytes per list, ~%u bytes across %d copies\n",
+                          idBytes, idBytes * COPIES, COPIES);
+            if (idBytes > 0)
+            {
+                Serial.printf("Reduction: %.1fx\n", (float)stringBytes / idBytes);
+            }
+            Serial.println("-----------------------------------------------\n");
+        }
         // File Manager commands that were missing
         else if (command == "dlstats")
         {
             Serial.println(fileManager.getDownloadStatsString());
         }
+        else if (command.startsWith("dlbench "))
+        {
+            // dlbench <url> [runs]
+            String args = command.substring(8);
+            args.trim();
+            int space = args.indexOf(' ');
+            String url = space == -1 ? args : args.substring(0, space);
+            int runs = space == -1 ? 3 : args.substring(space + 1).toInt();
+            if (url.startsWith("http://") || url.startsWith("https://"))
+            {
+                Serial.println(fileManager.runDownloadBenchmark(url, runs));
+            }
+            else
+            {
+                Serial.println("Usage: dlbench <url> [runs]");
+                Serial.println("Example: dlbench http://192.168.1.10:8000/bytes/1048576?kbps=200 5");
+            }
+        }
+        else if (command == "dlprogress")
+        {
+            DownloadProgress progress;
+            if (fileManager.getDownloadProgress(progress))
+            {
+                Serial.printf("Task %08x (priority %u): %u/%u bytes, %u B/s, ETA %u s, %u queued\n",
+                              progress.taskId, progress.priority, progress.bytes, progress.total,
+                              progress.bytesPerSecond, progress.etaMs / 1000, progress.queued);
+            }
+            else
+            {
+                Serial.println("No download in progress");
+            }
+        }
+        else if (command == "ledprogress on" || command == "ledprogress off")
+        {
+            ledController.setDownloadIndicator(command == "ledprogress on");
+            Serial.printf("LED download progress %s\n", command == "ledprogress on" ? "enabled" : "disabled");
+        }
+        else if (command == "dlcompress on" || command == "dlcompress off")
+        {
+            config.storeInt("download_compression", command == "dlcompress on" ? 1 : 0);
+            Serial.printf("Compressed downloads %s\n", command == "dlcompress on" ? "enabled" : "disabled");
+        }
+        else if (command == "sdcache")
+        {
+            Serial.println(fileManager.getSDCacheStatsString());
+        }
+        else if (command == "sdbench")
+        {
+            Serial.println(fileManager.benchmarkBus());
+        }
+        else if (command == "sdbench report on" || command == "sdbench report off")
+        {
+            bool enable = command.endsWith("on");
+            config.storeInt("sdbench_report", enable ? 1 : 0);
+            Serial.printf("SD benchmark in device report: %s\n", enable ? "enabled" : "disabled");
+        }
+        else if (command == "sdbus" || command.startsWith("sdbus "))
+        {
+            String arg = command.length() > 6 ? command.substring(6) : "";
+            arg.trim();
+
+            if (arg.isEmpty())
+            {
+                Serial.printf("SD bus: %s\n", FileManager::getBusModeName(fileManager.getBusMode()));
+            }
+            else if (arg == "bench")
+            {
+                Serial.println(fileManager.benchmarkBus());
+            }
+            else if (arg == "all")
+            {
+                // Benchmark every bus the build can use, then go back to where we started
+                SdBusMode original = fileManager.getBusMode();
+                SdBusMode modes[] = {SD_BUS_SPI, SD_BUS_SDMMC_1BIT, SD_BUS_SDMMC_4BIT};
+                for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+                {
+#ifndef SD_SDMMC_WIRED
+                    if (modes[i] != SD_BUS_SPI)
+                    {
+                        Serial.printf("%s: skipped (board not wired for SDMMC)\n", FileManager::getBusModeName(modes[i]));
+                        continue;
+                    }
+#endif
+#ifndef SD_SDMMC_4BIT
+                    if (modes[i] == SD_BUS_SDMMC_4BIT)
+                    {
+                        Serial.printf("%s: skipped (4-bit not enabled)\n", FileManager::getBusModeName(modes[i]));
+                        continue;
+                    }
+#endif
+                    if (fileManager.remountSDCard(modes[i]) && fileManager.getBusMode() == modes[i])
+                    {
+                        Serial.println(fileManager.benchmarkBus());
+                    }
+                    else
+                    {
+                        Serial.printf("%s: mount failed\n", FileManager::getBusModeName(modes[i]));
+                    }
+                }
+                fileManager.remountSDCard(original);
+            }
+            else
+            {
+                SdBusMode mode = SD_BUS_NONE;
+                if (arg == "spi")
+                {
+                    mode = SD_BUS_SPI;
+                }
+                else if (arg == "1bit")
+                {
+                    mode = SD_BUS_SDMMC_1BIT;
+                }
+                else if (arg == "4bit")
+                {
+                    mode = SD_BUS_SDMMC_4BIT;
+                }
+
+                if (mode == SD_BUS_NONE)
+                {
+                    Serial.println("Usage: sdbus [spi|1bit|4bit|bench|all]");
+                }
+                else if (fileManager.remountSDCard(mode))
+                {
+                    Serial.printf("SD bus now: %s\n", FileManager::getBusModeName(fileManager.getBusMode()));
+                }
+                else
+                {
+                    Serial.println("Failed to remount SD card");
+                }
+            }
+        }
+        else if (command.startsWith("sdreadbench "))
+        {
+            String path = command.substring(12);
+            path.trim();
+            Serial.println(fileManager.benchmarkReadThroughput(path));
+        }
         else if (command == "dlqueue")
         {
             fileManager.printDownloadQueue();
@@ -1266,6 +1631,14 @@ void loop()
     // Update file manager
     fileManager.update();
 
+    // Close idle pooled HTTP(S) connections
+    ConnectionManager::getInstance().update();
+
+    // Deliver finished requests, revalidate docked figures and prefetch likely ones
+    requestManager.update();
+    PrefetchScheduler::getInstance().update();
+    SdMaintenance::getInstance().update();
+
     // Update audio controller
     audioController.update();
 
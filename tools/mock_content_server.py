@@ -0,0 +1,228 @@
+#!/usr/bin/env python3
+"""Local stand-in for the content server, for benchmarking FileManager downloads.
+
+Serves synthetic files whose bytes depend only on their offset, so a resumed or
+decompressed download can be checked byte for byte, plus real files from a
+directory. Network conditions are injected per request through the query string,
+with server-wide defaults from the command line:
+
+    latency_ms=N   wait before sending the response headers
+    kbps=N         cap the body rate at N KB/s
+    drop_after=N   close the connection after N body bytes
+    drops=N        only drop the first N requests for this URL (default 1)
+    stall_ms=N     pause this long halfway through the body (stall timeout tests)
+    status=N       answer with status N instead of the file ...
+    fails=N        ... for the first N requests for this URL (default 1)
+    ranges=0       ignore Range headers and always send the whole file
+    chunked=1      send Transfer-Encoding: chunked instead of Content-Length
+    gzip=1         gzip the body when the client accepts it
+
+Paths:
+    /bytes/<size>  synthetic file of <size> bytes
+    /files/<name>  file from --root
+    /stats         per-URL request counters as JSON
+    /reset         clear the counters
+
+Example, with the board on the same network:
+    python3 tools/mock_content_server.py --port 8000 --kbps 300
+    dlbench http://<host>:8000/bytes/1048576?drop_after=300000 5
+"""
+
+import argparse
+import functools
+import gzip
+import json
+import os
+import re
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlsplit
+
+CHUNK = 4096
+
+counters = {}
+counters_lock = threading.Lock()
+
+
+@functools.lru_cache(maxsize=4)
+def synthetic_file(size):
+    """Byte i of every synthetic file is (i * 31 + i // 251) & 0xFF."""
+    return bytes(((i * 31) + (i // 251)) & 0xFF for i in range(size))
+
+
+def count_request(key):
+    with counters_lock:
+        counters[key] = counters.get(key, 0) + 1
+        return counters[key]
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    server_version = "MockContent/1.0"
+
+    def log_message(self, fmt, *args):
+        print("%s %s" % (self.address_string(), fmt % args), flush=True)
+
+    def option(self, query, name, default=0):
+        values = query.get(name)
+        if values:
+            return int(values[0])
+        return getattr(self.server.defaults, name, default)
+
+    def do_GET(self):
+        url = urlsplit(self.path)
+        query = parse_qs(url.query)
+
+        if url.path == "/stats":
+            with counters_lock:
+                self.send_small(200, json.dumps(counters, indent=1).encode(), "application/json")
+            return
+        if url.path == "/reset":
+            with counters_lock:
+                counters.clear()
+            self.send_small(200, b"reset\n", "text/plain")
+            return
+
+        content = self.load(url.path)
+        if content is None:
+            self.send_small(404, b"not found\n", "text/plain")
+            return
+
+        request_number = count_request(self.path)
+
+        latency_ms = self.option(query, "latency_ms")
+        if latency_ms:
+            time.sleep(latency_ms / 1000.0)
+
+        status = self.option(query, "status")
+        if status and request_number <= self.option(query, "fails", 1):
+            self.send_small(status, b"injected failure\n", "text/plain")
+            return
+
+        total = len(content)
+        start = 0
+        end = total - 1
+        partial = False
+        range_header = self.headers.get("Range")
+        if range_header and self.option(query, "ranges", 1):
+            match = re.match(r"bytes=(\d+)-(\d*)$", range_header.strip())
+            if not match or int(match.group(1)) >= total:
+                self.send_response(416)
+                self.send_header("Content-Range", "bytes */%d" % total)
+                self.send_header("Content-Length", "0")
+                self.end_headers()
+                return
+            start = int(match.group(1))
+            if match.group(2):
+                end = min(int(match.group(2)), total - 1)
+            partial = True
+
+        body = content[start:end + 1]
+        encoding = None
+        accept = self.headers.get("Accept-Encoding", "")
+        if self.option(query, "gzip") and "gzip" in accept and not partial:
+            body = gzip.compress(body)
+            encoding = "gzip"
+        chunked = bool(self.option(query, "chunked"))
+
+        self.send_response(206 if partial else 200)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Accept-Ranges", "bytes" if self.option(query, "ranges", 1) else "none")
+        if partial:
+            self.send_header("Content-Range", "bytes %d-%d/%d" % (start, end, total))
+        if encoding:
+            self.send_header("Content-Encoding", encoding)
+        if chunked:
+            self.send_header("Transfer-Encoding", "chunked")
+        else:
+            self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+
+        drop_after = self.option(query, "drop_after")
+        if drop_after and request_number > self.option(query, "drops", 1):
+            drop_after = 0
+        self.send_body(body, chunked, self.option(query, "kbps"), drop_after, self.option(query, "stall_ms"))
+
+    def load(self, path):
+        match = re.match(r"/bytes/(\d+)$", path)
+        if match:
+            size = int(match.group(1))
+            if size > self.server.max_synthetic:
+                return None
+            return synthetic_file(size)
+        if path.startswith("/files/") and self.server.root:
+            name = os.path.normpath(path[len("/files/"):]).lstrip("/")
+            full = os.path.join(self.server.root, name)
+            if not name.startswith("..") and os.path.isfile(full):
+                with open(full, "rb") as f:
+                    return f.read()
+        return None
+
+    def send_small(self, status, body, content_type):
+        self.send_response(status)
+        self.send_header("Content-Type", content_type)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def send_body(self, body, chunked, kbps, drop_after, stall_ms):
+        sent = 0
+        started = time.monotonic()
+        stalled = False
+        while sent < len(body):
+            piece = body[sent:sent + CHUNK]
+            if drop_after and sent + len(piece) > drop_after:
+                piece = piece[:drop_after - sent]
+                if piece:
+                    self.write_piece(piece, chunked)
+                self.log_message("dropped connection after %d body bytes", drop_after)
+                self.close_connection = True
+                return
+            if stall_ms and not stalled and sent >= len(body) // 2:
+                stalled = True
+                time.sleep(stall_ms / 1000.0)
+            self.write_piece(piece, chunked)
+            sent += len(piece)
+            if kbps:
+                # Sleep until the rate so far is back under the cap
+                ahead = sent / (kbps * 1024.0) - (time.monotonic() - started)
+                if ahead > 0:
+                    time.sleep(ahead)
+        if chunked:
+            self.wfile.write(b"0\r\n\r\n")
+
+    def write_piece(self, piece, chunked):
+        if chunked:
+            self.wfile.write(b"%x\r\n" % len(piece) + piece + b"\r\n")
+        else:
+            self.wfile.write(piece)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=8000)
+    parser.add_argument("--root", help="directory served under /files/")
+    parser.add_argument("--max-synthetic", type=int, default=64 * 1024 * 1024,
+                        help="largest /bytes/<size> served (default 64 MB)")
+    for name in ("latency_ms", "kbps", "drop_after", "stall_ms", "chunked", "gzip"):
+        parser.add_argument("--" + name.replace("_", "-"), dest=name, type=int, default=0,
+                            help="default for the %s query option" % name)
+    parser.add_argument("--no-ranges", dest="ranges", action="store_const", const=0, default=1,
+                        help="ignore Range headers unless a request says ranges=1")
+    args = parser.parse_args()
+
+    server = ThreadingHTTPServer((args.host, args.port), Handler)
+    server.defaults = args
+    server.root = args.root
+    server.max_synthetic = args.max_synthetic
+    print("Mock content server on http://%s:%d/" % (args.host, args.port), flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()